@@ -0,0 +1,58 @@
+#! /bin/bash
+
+# Benchmark gammaJetFinalizer on synthetic step 2 ntuples (see bin/syntheticNtuples.cpp).
+# Runs on data and MC samples, and reports events/s, peak RSS and per-stage timing.
+#
+# Usage: ./runBenchmark.sh [number of events] [extra gammaJetFinalizer options]
+# Needs a CMSSW environment with the package built (scram b).
+
+EVENTS=${1:-200000}
+shift
+EXTRA_OPTIONS="$@"
+
+BIN_DIR=$CMSSW_BASE/src/JetMETCorrections/GammaJetFilter/bin
+WORK_DIR=benchmark_${EVENTS}
+
+# The finalizer reads pileup profiles from $CMSSW_BASE: synthetic ones are stored in a private
+# tree, used as $CMSSW_BASE for the MC run only
+PU_BASE=$PWD/$WORK_DIR/base
+PU_DIR=$PU_BASE/src/JetMETCorrections/GammaJetFilter/analysis/PUReweighting
+
+mkdir -p $PU_DIR
+cd $WORK_DIR
+
+ln -sf $BIN_DIR/triggers.xml $BIN_DIR/triggers_mc.xml .
+
+# Inputs are generated once, and kept for the next runs
+if [ ! -f PhotonJet_2ndLevel_synthetic_data.root ]; then
+  syntheticNtuples -n $EVENTS -o PhotonJet_2ndLevel_synthetic_data.root --seed 1 || exit 1
+fi
+
+if [ ! -f PhotonJet_2ndLevel_synthetic_mc.root ]; then
+  syntheticNtuples -n $EVENTS -o PhotonJet_2ndLevel_synthetic_mc.root --mc --seed 2 --pu-profiles $PU_DIR || exit 1
+fi
+
+function run {
+  NAME=$1
+  shift
+
+  /usr/bin/time -f "%M" -o $NAME.rss gammaJetFinalizer --type pf --algo ak5 --chs --timing $@ $EXTRA_OPTIONS > $NAME.log 2>&1
+  if [ $? -ne 0 ]; then
+    echo "$NAME: gammaJetFinalizer failed, see $WORK_DIR/$NAME.log"
+    return
+  fi
+
+  python - $NAME PhotonJet_${NAME}_PFlowAK5chs.root.timing.json $(tail -n 1 $NAME.rss) <<EOF
+import json, sys
+
+name, report, rss = sys.argv[1], json.load(open(sys.argv[2])), int(sys.argv[3])
+print("%s: %d events, %.0f events/s, %.1f MB read, peak RSS %.0f MB" % (name, report["events"], report["events_per_second"], report["bytes_read"] / 1024. ** 2, rss / 1024.))
+
+total = sum(stage["total_ns"] for stage in report["stages"].values())
+for stage, data in sorted(report["stages"].items(), key=lambda item: -item[1]["total_ns"]):
+  print("  %-12s %10.1f ms %6.1f %%   p99 < %8.1f us" % (stage, data["total_ns"] / 1e6, 100. * data["total_ns"] / total, data["p99_ns"] / 1e3))
+EOF
+}
+
+run synthetic_data -i PhotonJet_2ndLevel_synthetic_data.root -d synthetic_data
+CMSSW_BASE=$PU_BASE run synthetic_mc -i PhotonJet_2ndLevel_synthetic_mc.root -d synthetic_mc --mc
@@ -1,5 +1,6 @@
 #include "drawBase.h"
 #include "fitTools.h"
+#include "ElidedHistograms.h"
 
 #include "TColor.h"
 #include "TRegexp.h"
@@ -2727,6 +2728,9 @@ void drawBase::drawHisto_fromHistos(std::vector<TH1*> dataHistos, std::vector<TH
       std::cout << "File: '" << dataFile->GetName() << " does not exist! Skipping." << std::endl;
       return;
     }
+    // Outputs of gammaJetFinalizer --skip-empty: recreate the empty histograms left out
+    ElidedHistograms::restore(dataFile);
+
     dataFiles_.push_back(thisFile);
     std::cout << "-> Added DATA file '" << dataFile->GetName() << "'." << std::endl;
 
@@ -2756,6 +2760,8 @@ void drawBase::drawHisto_fromHistos(std::vector<TH1*> dataHistos, std::vector<TH
       std::cout << "File: '" << mcFile->GetName() << " does not exist! Skipping." << std::endl;
       return;
     }
+    ElidedHistograms::restore(mcFile);
+
     mcFiles_.push_back(thisfile);
 
     std::cout << "-> Added MC file '" << mcFile->GetName()  << "'." << std::endl;
@@ -2779,6 +2785,8 @@ void drawBase::drawHisto_fromHistos(std::vector<TH1*> dataHistos, std::vector<TH
       std::cout << "File: '" << mcFile->GetName() << " does not exist! Skipping." << std::endl;
       return;
     }
+    ElidedHistograms::restore(mcFile);
+
     mcFiles_superimp_.push_back(thisfile);
 
     std::cout << "-> Added (superimposed) MC file '" << mcFile->GetName()  << "'." << std::endl;
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include "drawExtrap.h"
 #include "fitTools.h"
+#include "drawTiming.h"
 #include <TParameter.h>
 #include <TColor.h>
 
@@ -41,12 +42,17 @@ int main(int argc, char* argv[]) {
 
     TCLAP::ValueArg<std::string> resoArg("", "reso-algo", "algo for resolution calculation", false, "RMS99", &allowedResoTypes, cmd);
 
+    TCLAP::SwitchArg timingArg("", "timing", "Report the time spent in each phase", cmd);
+
     TCLAP::UnlabeledValueArg<std::string> dataArg("data_dataset", "data dataset name", true, "Photon_Run2011", "string", cmd);
     TCLAP::UnlabeledValueArg<std::string> mc1Arg("mc1_dataset", "first MC dataset name", true, "G", "string", cmd);
     TCLAP::UnlabeledValueArg<std::string> mc2Arg("mc2_dataset", "second MC dataset name", true, "QCD", "string", cmd);
 
     cmd.parse(argc, argv);
 
+    DrawTiming timing(timingArg.getValue());
+    timing.start("open files");
+
     std::string data_dataset = dataArg.getValue();
     std::string mc_dataset = mc1Arg.getValue();
     std::string mc2_dataset = mc2Arg.getValue();
@@ -157,18 +163,23 @@ int main(int argc, char* argv[]) {
     size_t etaBinningSize = etaBinning.size();
 
     for (size_t i = 0; i < etaBinningSize; i++) {
+      timing.start("extrapolation " + etaBinning.getBinName(i));
       db->set_legendTitle(etaBinning.getBinTitle(i)); 
 
       db->drawResponseExtrap(etaBinning.getBinName(i), etaBinning.getBinTitle(i), false);
       db->drawResponseExtrap(etaBinning.getBinName(i), etaBinning.getBinTitle(i), true);
     }
 
+    timing.start("extrapolation eta013");
     db->set_legendTitle("|#eta| < 1.3");
 
     db->drawResponseExtrap("eta013", "|#eta| < 1.3", false);
     db->drawResponseExtrap("eta013", "|#eta| < 1.3", true);
 
+    timing.start("cleanup");
     delete db;
+
+    timing.print();
   } catch (TCLAP::ArgException &e) {
     std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
     return 1;
@@ -4,6 +4,7 @@
 #include "TError.h"
 #include "drawBase.h"
 #include "fitTools.h"
+#include "drawTiming.h"
 
 #include "etaBinning.h"
 #include "ptBinning.h"
@@ -34,6 +35,10 @@ int main(int argc, char* argv[]) {
     std::cout << "Exiting." << std::endl;
     exit(9811);
   }
+  // Set DRAW_TIMING=1 to get the time spent in each phase
+  DrawTiming timing(getenv("DRAW_TIMING") != NULL);
+  timing.start("open files");
+
   std::string flags = "";
   if (argc == 8) {
     std::string flags_str(argv[7]);
@@ -142,6 +147,7 @@ int main(int argc, char* argv[]) {
   db->set_rebin(5);
 
   // Data / MC comparison
+  timing.start("data / MC comparison");
   db->drawHisto("ptPhoton", "Photon Transverse Momentum", "GeV", "Events", log, 1, "", false, 200);
   db->drawHisto("ptFirstJet", "Jet Transverse Momentum", "GeV", "Events", log);
   db->drawHisto("ptSecondJet", "2nd Jet Transverse Momentum", "GeV", "Events", log);
@@ -191,6 +197,7 @@ int main(int argc, char* argv[]) {
   db->set_rebin(2);
 
   // Balancing
+  timing.start("balancing");
   db->setFolder("analysis/balancing");
   for (size_t i = 0; i < etaBinningSize; i++) {
     db->set_legendTitle(etaBinning.getBinTitle(i));
@@ -210,6 +217,7 @@ int main(int argc, char* argv[]) {
   db->drawHisto_vs_pt(ptBins, "resp_balancing_raw_eta013", "Balancing Response (raw jets)", "", "Events", log);
 
   // MPF
+  timing.start("mpf");
   db->setFolder("analysis/mpf");
   for (size_t i = 0; i < etaBinningSize; i++) {
     db->set_legendTitle(etaBinning.getBinTitle(i));
@@ -228,9 +236,12 @@ int main(int argc, char* argv[]) {
   db->drawHisto_vs_pt(ptBins, "resp_mpf_eta013", "MPF Response", "", "Events", log);
   db->drawHisto_vs_pt(ptBins, "resp_mpf_raw_eta013", "MPF Response (raw ME_{T})", "", "Events", log);
 
+  timing.start("cleanup");
   delete db;
   db = NULL;
 
+  timing.print();
+
   return 0;
 
 }
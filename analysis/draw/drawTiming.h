@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PerfCounters.h"
+
+/**
+ * Wall time and hardware counters spent in each phase of a draw program.
+ *
+ * Phases are consecutive: start() ends the running phase. Hardware counters are reported when
+ * perf_event_open is allowed on this machine. When disabled, nothing is measured.
+ */
+class DrawTiming {
+  public:
+    DrawTiming(bool enabled):
+      mEnabled(enabled), mCounters(false), mCurrent(-1) {
+      if (mEnabled)
+        mCounters = mPerfCounters.open();
+    }
+
+    void start(const std::string& phase) {
+      if (! mEnabled)
+        return;
+
+      stop();
+
+      Phase p;
+      p.name = phase;
+      p.ns = 0;
+      for (int i = 0; i < PerfCounters::NUMBER_OF_COUNTERS; i++) {
+        p.counters[i] = 0;
+      }
+
+      mPhases.push_back(p);
+      mCurrent = mPhases.size() - 1;
+
+      mPerfCounters.read(mStartCounters);
+      mStart = clock::now();
+    }
+
+    void stop() {
+      if (! mEnabled || mCurrent < 0)
+        return;
+
+      Phase& p = mPhases[mCurrent];
+      p.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - mStart).count();
+
+      uint64_t counters[PerfCounters::NUMBER_OF_COUNTERS];
+      if (mPerfCounters.read(counters)) {
+        for (int i = 0; i < PerfCounters::NUMBER_OF_COUNTERS; i++) {
+          p.counters[i] = (counters[i] > mStartCounters[i]) ? counters[i] - mStartCounters[i] : 0;
+        }
+      }
+
+      mCurrent = -1;
+    }
+
+    void print(std::ostream& stream = std::cout) {
+      if (! mEnabled)
+        return;
+
+      stop();
+
+      std::ios::fmtflags flags = stream.flags();
+      stream << std::fixed << std::setprecision(1);
+
+      stream << "Timing:" << std::endl;
+      for (const Phase& p: mPhases) {
+        stream << "  " << std::left << std::setw(24) << p.name << std::right << std::setw(10) << p.ns / 1e6 << " ms";
+
+        if (mCounters) {
+          const uint64_t* c = p.counters;
+          stream << std::setw(10) << c[PerfCounters::CYCLES] / 1e6 << " Mcycles"
+            << "   IPC " << std::setprecision(2) << std::setw(5) << ((c[PerfCounters::CYCLES] > 0) ? static_cast<double>(c[PerfCounters::INSTRUCTIONS]) / c[PerfCounters::CYCLES] : 0) << std::setprecision(1);
+
+          if (mPerfCounters.isSupported(PerfCounters::LLC_MISSES))
+            stream << std::setw(10) << c[PerfCounters::LLC_MISSES] / 1e3 << " k LLC misses";
+          if (mPerfCounters.isSupported(PerfCounters::BRANCH_MISSES))
+            stream << std::setw(10) << c[PerfCounters::BRANCH_MISSES] / 1e3 << " k branch misses";
+        }
+
+        stream << std::endl;
+      }
+
+      if (! mCounters)
+        stream << "  (hardware counters not available)" << std::endl;
+
+      stream.flags(flags);
+    }
+
+  private:
+    typedef std::chrono::steady_clock clock;
+
+    struct Phase {
+      std::string name;
+      uint64_t ns;
+      uint64_t counters[PerfCounters::NUMBER_OF_COUNTERS];
+    };
+
+    bool mEnabled;
+    bool mCounters;
+
+    PerfCounters mPerfCounters;
+    uint64_t mStartCounters[PerfCounters::NUMBER_OF_COUNTERS];
+    clock::time_point mStart;
+
+    std::vector<Phase> mPhases;
+    int mCurrent;
+};
@@ -0,0 +1,198 @@
+#! /bin/bash
+
+# Golden-output regression test of gammaJetFinalizer. Runs it on fixed synthetic step 2 ntuples
+# (see bin/syntheticNtuples.cpp), and compares every histogram, TParameter, graph and tree of the
+# outputs with compareOutputs:
+#  - against reference outputs, produced before the change to check;
+#  - the events copied to the 'misc' tree (trigger names and results vectors included), against
+#    the input analysis tree, event by event, with the default run and with --sync-trees;
+#  - with --sync-trees, against the default run where trees are filled by a dedicated thread;
+#  - with --skip-empty, against the default run;
+#  - split in several jobs run in parallel and merged with hadd, against the single job.
+#
+# Usage: ./runRegression.sh [--update | --reference-bin dir] [reference directory (default: regression_reference)]
+#
+# The reference must be produced by the code before the change, either:
+#  - by running with --update on the unchanged code (the outputs of this run become the reference),
+#    then again once the change is built;
+#  - or with --reference-bin: build the baseline commit in a second CMSSW area, and give the
+#    directory of its gammaJetFinalizer (e.g. $OTHER_CMSSW_BASE/bin/$SCRAM_ARCH). The reference
+#    outputs are then produced by this binary, on the same inputs, before the checks.
+# Without a reference, the check against it fails: the code under test is never taken as reference.
+#
+# Extra compareOutputs options (--rel, --abs, --ignore, ...) can be given in $COMPARE_OPTIONS.
+# Needs a CMSSW environment with the package built (scram b).
+
+UPDATE=0
+REFERENCE_BIN=""
+while [ $# -gt 0 ]; do
+  case $1 in
+    --update)
+      UPDATE=1
+      shift
+      ;;
+    --reference-bin)
+      REFERENCE_BIN=$(readlink -f $2)
+      shift 2
+      ;;
+    *)
+      break
+      ;;
+  esac
+done
+
+if [ -n "$REFERENCE_BIN" ] && [ ! -x $REFERENCE_BIN/gammaJetFinalizer ]; then
+  echo "Error: no gammaJetFinalizer in '$REFERENCE_BIN'"
+  exit 1
+fi
+
+# The reference is only valid for these inputs: don't change them without --update
+EVENTS=20000
+SPLITS="2 3"
+
+mkdir -p ${1:-regression_reference}
+REF_DIR=$(readlink -f ${1:-regression_reference})
+
+BIN_DIR=$CMSSW_BASE/src/JetMETCorrections/GammaJetFilter/bin
+WORK_DIR=$PWD/regression
+
+# Synthetic pileup profiles, used as $CMSSW_BASE for MC runs (see analysis/benchmark/runBenchmark.sh)
+PU_BASE=$WORK_DIR/base
+PU_DIR=$PU_BASE/src/JetMETCorrections/GammaJetFilter/analysis/PUReweighting
+
+mkdir -p $PU_DIR
+cd $WORK_DIR
+
+if [ ! -f PhotonJet_2ndLevel_regression_data.root ]; then
+  syntheticNtuples -n $EVENTS -o PhotonJet_2ndLevel_regression_data.root --seed 1 > /dev/null || exit 1
+fi
+
+if [ ! -f PhotonJet_2ndLevel_regression_mc.root ]; then
+  syntheticNtuples -n $EVENTS -o PhotonJet_2ndLevel_regression_mc.root --mc --seed 2 --pu-profiles $PU_DIR > /dev/null || exit 1
+fi
+
+FAILURES=0
+
+# finalize <run directory> <sample> [gammaJetFinalizer options]
+function finalize {
+  RUN_DIR=$1
+  SAMPLE=$2
+  shift 2
+
+  mkdir -p $RUN_DIR
+  (
+    cd $RUN_DIR
+    ln -sf $BIN_DIR/triggers.xml $BIN_DIR/triggers_mc.xml .
+    if [ "$SAMPLE" == "regression_mc" ]; then
+      export CMSSW_BASE=$PU_BASE
+    fi
+
+    ${FINALIZER:-gammaJetFinalizer} --type pf --algo ak5 --chs -i $WORK_DIR/PhotonJet_2ndLevel_$SAMPLE.root -d $SAMPLE $@ > finalizer_$SAMPLE$LOG_SUFFIX.log 2>&1
+  )
+
+  if [ $? -ne 0 ]; then
+    echo "$RUN_DIR: gammaJetFinalizer failed on $SAMPLE, see $WORK_DIR/$RUN_DIR/finalizer_$SAMPLE$LOG_SUFFIX.log"
+    return 1
+  fi
+}
+
+# check <description> [compareOutputs arguments]
+function check {
+  DESCRIPTION=$1
+  shift
+
+  echo "* $DESCRIPTION"
+  compareOutputs $COMPARE_OPTIONS $@ | sed 's/^/    /'
+  if [ ${PIPESTATUS[0]} -ne 0 ]; then
+    FAILURES=$((FAILURES + 1))
+  fi
+}
+
+function run_sample {
+  SAMPLE=$1
+  shift
+
+  OUTPUT=PhotonJet_${SAMPLE}_PFlowAK5chs.root
+
+  echo "$SAMPLE:"
+
+  if [ -n "$REFERENCE_BIN" ]; then
+    if ! FINALIZER=$REFERENCE_BIN/gammaJetFinalizer finalize reference $SAMPLE $@; then
+      FAILURES=$((FAILURES + 1))
+      return
+    fi
+
+    cp reference/$OUTPUT $REF_DIR/
+    echo "* reference produced by $REFERENCE_BIN/gammaJetFinalizer"
+  fi
+
+  if ! finalize default $SAMPLE $@; then
+    FAILURES=$((FAILURES + 1))
+    return
+  fi
+
+  if [ $UPDATE -eq 1 ]; then
+    cp default/$OUTPUT $REF_DIR/
+    echo "* reference updated: $REF_DIR/$OUTPUT"
+  elif [ ! -f $REF_DIR/$OUTPUT ]; then
+    echo "* against reference: no reference in $REF_DIR, produce it from the baseline code with --update or --reference-bin"
+    FAILURES=$((FAILURES + 1))
+  else
+    check "against reference" $REF_DIR/$OUTPUT default/$OUTPUT
+  fi
+
+  # The finalizer overwrites the event weight of the events it copies
+  check "misc tree against the input" --tree gammaJet/analysis:misc --ignore '/event_weight$' $WORK_DIR/PhotonJet_2ndLevel_$SAMPLE.root default/$OUTPUT
+
+  # Same events, same order: the outputs must be identical
+  if finalize sync_trees $SAMPLE $@ --sync-trees; then
+    check "--sync-trees against default" --exact default/$OUTPUT sync_trees/$OUTPUT
+    check "--sync-trees misc tree against the input" --tree gammaJet/analysis:misc --ignore '/event_weight$' $WORK_DIR/PhotonJet_2ndLevel_$SAMPLE.root sync_trees/$OUTPUT
+  else
+    FAILURES=$((FAILURES + 1))
+  fi
+
+  # Empty histograms left out are recreated from the manifest when reading: same outputs
+  if finalize skip_empty $SAMPLE $@ --skip-empty; then
+    check "--skip-empty against default" --exact default/$OUTPUT skip_empty/$OUTPUT
+  else
+    FAILURES=$((FAILURES + 1))
+  fi
+
+  # hadd sums histograms in a different order (hence the default tolerance) and TParameters, and
+  # appends the points of graphs: graphs are skipped, the histograms they are made from are not
+  for JOBS in $SPLITS; do
+    rm -f jobs_$JOBS/PhotonJet_${SAMPLE}_PFlowAK5chs_part*.root
+
+    PIDS=""
+    for JOB in $(seq 0 $((JOBS - 1))); do
+      LOG_SUFFIX=_part$JOB finalize jobs_$JOBS $SAMPLE $@ --num-jobs $JOBS --job $JOB &
+      PIDS="$PIDS $!"
+    done
+
+    JOBS_FAILED=0
+    for PID in $PIDS; do
+      wait $PID || JOBS_FAILED=1
+    done
+
+    if [ $JOBS_FAILED -ne 0 ] || ! hadd -f jobs_$JOBS/$OUTPUT jobs_$JOBS/PhotonJet_${SAMPLE}_PFlowAK5chs_part*.root > jobs_$JOBS/hadd_$SAMPLE.log 2>&1; then
+      echo "* $JOBS jobs: failed, see $WORK_DIR/jobs_$JOBS"
+      FAILURES=$((FAILURES + 1))
+      continue
+    fi
+
+    check "$JOBS jobs merged against a single job" --parameter-scale $JOBS --ignore '_graph$' default/$OUTPUT jobs_$JOBS/$OUTPUT
+  done
+
+  echo
+}
+
+run_sample regression_data
+run_sample regression_mc --mc
+
+if [ $FAILURES -ne 0 ]; then
+  echo "$FAILURES check(s) failed"
+  exit 1
+fi
+
+echo "All checks passed"
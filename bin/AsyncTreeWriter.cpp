@@ -0,0 +1,371 @@
+#include "AsyncTreeWriter.h"
+
+#include <TBranch.h>
+#include <TBranchElement.h>
+#include <TChain.h>
+#include <TChainElement.h>
+#include <TClass.h>
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TLeaf.h>
+#include <TObjArray.h>
+#include <TROOT.h>
+#include <TTree.h>
+#include <RVersion.h>
+
+#if ROOT_VERSION_CODE < ROOT_VERSION(6, 0, 0)
+#include <TThread.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+
+template<typename T>
+class AsyncTreeWriter::VectorColumn: public AsyncTreeWriter::ObjectColumn {
+  public:
+    // The branch address is the address of the pointer to the input object, as set by CopyAddresses()
+    VectorColumn(TBranchElement* branch, size_t slots):
+      mBranch(branch), mSource(reinterpret_cast<T**>(branch->GetAddress())), mTarget(new T()), mSlots(slots) {
+      mBranch->SetAddress(&mTarget);
+    }
+
+    virtual ~VectorColumn() {
+      mBranch->ResetAddress();
+      delete mTarget;
+    }
+
+    virtual void save(size_t slot) {
+      const T* source = *mSource;
+      if (source)
+        mSlots[slot] = *source;
+      else
+        mSlots[slot].clear();
+    }
+
+    virtual void load(size_t slot) {
+      mTarget->swap(mSlots[slot]);
+    }
+
+  private:
+    TBranchElement* mBranch;
+    T** mSource;
+    T* mTarget;
+    std::vector<T> mSlots;
+};
+
+AsyncTreeWriter::ObjectColumn* AsyncTreeWriter::makeObjectColumn(TBranchElement* branch, size_t slots) {
+  // Split objects have one sub-branch per member
+  TClass* type = TClass::GetClass(branch->GetClassName());
+  if (! type || ! branch->GetAddress() || branch->GetListOfBranches()->GetEntriesFast() > 0)
+    return NULL;
+
+  if (type == TClass::GetClass(typeid(std::vector<std::string>)))
+    return new VectorColumn<std::vector<std::string>>(branch, slots);
+  if (type == TClass::GetClass(typeid(std::vector<bool>)))
+    return new VectorColumn<std::vector<bool>>(branch, slots);
+  if (type == TClass::GetClass(typeid(std::vector<int>)))
+    return new VectorColumn<std::vector<int>>(branch, slots);
+  if (type == TClass::GetClass(typeid(std::vector<unsigned int>)))
+    return new VectorColumn<std::vector<unsigned int>>(branch, slots);
+  if (type == TClass::GetClass(typeid(std::vector<float>)))
+    return new VectorColumn<std::vector<float>>(branch, slots);
+  if (type == TClass::GetClass(typeid(std::vector<double>)))
+    return new VectorColumn<std::vector<double>>(branch, slots);
+
+  return NULL;
+}
+
+AsyncTreeWriter::AsyncTreeWriter(size_t maxQueuedEvents):
+  mOutputFile(NULL), mEventSize(0), mMaxQueuedEvents(std::max<size_t>(1, maxQueuedEvents)), mHead(0), mQueued(0), mRunning(false), mStopping(false) {
+
+}
+
+AsyncTreeWriter::~AsyncTreeWriter() {
+  stop();
+}
+
+// Readers move their arrays when they grow: the address is read at each event, from the chain
+// element which keeps it across files, or from the branch of a plain tree
+const char* AsyncTreeWriter::Column::address() const {
+  return (element) ? static_cast<const char*>(element->GetBaddress()) : inputBranch->GetAddress();
+}
+
+void AsyncTreeWriter::add(TTree* output, TTree* input, int floatBits) {
+  if (! output)
+    return;
+
+  mTrees.push_back(output);
+  if (! mOutputFile)
+    mOutputFile = output->GetCurrentFile();
+
+  // Sizes first, so that arrays can refer to their column
+  std::vector<TBranch*> arrays;
+  TObjArray* branches = output->GetListOfBranches();
+  for (int i = 0; i < branches->GetEntriesFast(); i++) {
+    TBranch* branch = static_cast<TBranch*>(branches->UncheckedAt(i));
+
+    if (branch->InheritsFrom(TBranchElement::Class())) {
+      ObjectColumn* column = makeObjectColumn(static_cast<TBranchElement*>(branch), mMaxQueuedEvents);
+      if (column)
+        mObjectColumns.push_back(std::unique_ptr<ObjectColumn>(column));
+      else if (branch->GetAddress())
+        mUnsupportedBranch = std::string(output->GetName()) + "." + branch->GetName();
+
+      continue;
+    }
+
+    TLeaf* leaf = static_cast<TLeaf*>(branch->GetListOfLeaves()->At(0));
+    if (! branch->GetAddress() || ! leaf)
+      continue;
+
+    if (leaf->GetLeafCount()) {
+      arrays.push_back(branch);
+      continue;
+    }
+
+    Column column;
+    column.branch = branch;
+    column.source = branch->GetAddress();
+    column.size = leaf->GetLenStatic() * leaf->GetLenType();
+    column.element = NULL;
+    column.inputBranch = NULL;
+    column.count = NULL;
+    column.countColumn = 0;
+    column.capacity = 1;
+    column.floatMask = 0xFFFFFFFF;
+    if (floatBits >= 0 && floatBits < 23 && std::string(leaf->GetTypeName()) == "Float_t")
+      column.floatMask <<= (23 - floatBits);
+
+    mColumns.push_back(column);
+  }
+
+  for (TBranch* branch: arrays) {
+    TLeaf* leaf = static_cast<TLeaf*>(branch->GetListOfLeaves()->At(0));
+
+    size_t countColumn = 0;
+    while (countColumn < mColumns.size() && mColumns[countColumn].branch != leaf->GetLeafCount()->GetBranch())
+      countColumn++;
+
+    TChain* chain = dynamic_cast<TChain*>(input);
+    TChainElement* element = (chain) ? static_cast<TChainElement*>(chain->GetStatus()->FindObject(branch->GetName())) : NULL;
+    TBranch* inputBranch = (input && ! chain) ? input->GetBranch(branch->GetName()) : NULL;
+
+    bool read = (element && element->GetBaddress()) || (inputBranch && inputBranch->GetAddress());
+    if (! read || countColumn == mColumns.size() || leaf->GetLeafCount()->GetLenType() != sizeof(int)) {
+      std::cerr << "Warning: can't copy branch '" << output->GetName() << "." << branch->GetName() << "', its content is lost" << std::endl;
+      branch->ResetAddress();
+      continue;
+    }
+
+    Column column;
+    column.branch = branch;
+    column.source = NULL;
+    column.size = leaf->GetLenStatic() * leaf->GetLenType();
+    column.element = element;
+    column.inputBranch = inputBranch;
+    column.count = reinterpret_cast<const int*>(mColumns[countColumn].source);
+    column.countColumn = countColumn;
+    column.capacity = 8;
+    column.floatMask = 0xFFFFFFFF;
+    if (floatBits >= 0 && floatBits < 23 && std::string(leaf->GetTypeName()) == "Float_t")
+      column.floatMask <<= (23 - floatBits);
+
+    mColumns.push_back(column);
+  }
+
+  layout();
+}
+
+// Slot offsets, and output buffers, for the current capacities. The writer thread must be idle
+void AsyncTreeWriter::layout() {
+  mEventSize = 0;
+  for (Column& column: mColumns) {
+    size_t size = column.size * column.capacity;
+    column.offset = mEventSize;
+    mEventSize += size;
+
+    if (column.target.size() < size) {
+      column.target.resize(size);
+      column.branch->SetAddress(column.target.data());
+    }
+  }
+
+  mRing.resize(mEventSize * ((mRunning) ? mMaxQueuedEvents : 1));
+}
+
+// Capacity needed by the arrays of the current input event, or 0 if they fit. Capacities double, to grow only a few times
+size_t AsyncTreeWriter::neededCapacity() const {
+  size_t capacity = 0;
+  for (const Column& column: mColumns) {
+    if (column.count && *column.count > 0 && static_cast<size_t>(*column.count) > column.capacity)
+      capacity = std::max(capacity, std::max(2 * column.capacity, static_cast<size_t>(*column.count)));
+  }
+
+  return capacity;
+}
+
+void AsyncTreeWriter::reserve(size_t capacity) {
+  flush();
+
+  for (Column& column: mColumns) {
+    if (column.count)
+      column.capacity = std::max(column.capacity, capacity);
+  }
+
+  layout();
+}
+
+void AsyncTreeWriter::start() {
+  if (mRunning)
+    return;
+
+  if (! mUnsupportedBranch.empty()) {
+    std::cerr << "Warning: branch '" << mUnsupportedBranch << "' can't be copied, output trees are filled from the event loop" << std::endl;
+    return;
+  }
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6, 0, 0)
+  ROOT::EnableThreadSafety();
+#else
+  TThread::Initialize();
+#endif
+
+  mRing.resize(mEventSize * mMaxQueuedEvents);
+  mHead = 0;
+  mQueued = 0;
+  mStopping = false;
+  mRunning = true;
+
+  mThread = std::thread(&AsyncTreeWriter::run, this);
+}
+
+void AsyncTreeWriter::fill() {
+  // Queued events use the current layout: they're written before the buffers grow
+  size_t capacity = neededCapacity();
+  if (capacity > 0)
+    reserve(capacity);
+
+  if (! mRunning) {
+    // The first slot is used as a scratch buffer
+    save(0);
+    write(0);
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  mNotFull.wait(lock, [this] { return mQueued < mMaxQueuedEvents; });
+
+  // The slot after the queued ones is not touched by the writer thread
+  size_t slot = (mHead + mQueued) % mMaxQueuedEvents;
+  lock.unlock();
+
+  save(slot);
+
+  lock.lock();
+  mQueued++;
+  lock.unlock();
+
+  mNotEmpty.notify_one();
+}
+
+void AsyncTreeWriter::flush() {
+  if (! mRunning)
+    return;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  mNotFull.wait(lock, [this] { return mQueued == 0; });
+}
+
+void AsyncTreeWriter::stop() {
+  if (! mRunning)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mNotEmpty.notify_one();
+
+  mThread.join();
+  mRunning = false;
+}
+
+void AsyncTreeWriter::run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mNotEmpty.wait(lock, [this] { return mQueued > 0 || mStopping; });
+    if (mQueued == 0)
+      break;
+
+    size_t slot = mHead;
+    lock.unlock();
+
+    write(slot);
+
+    lock.lock();
+    mHead = (mHead + 1) % mMaxQueuedEvents;
+    mQueued--;
+    mNotFull.notify_one();
+  }
+}
+
+namespace {
+  // Round to nearest, keeping only the bits of mask. Inf and NaN are left untouched
+  void roundFloats(char* buffer, size_t size, uint32_t mask) {
+    const uint32_t half = (~mask + 1) >> 1;
+    for (size_t offset = 0; offset + sizeof(uint32_t) <= size; offset += sizeof(uint32_t)) {
+      uint32_t bits;
+      std::memcpy(&bits, buffer + offset, sizeof(bits));
+      if ((bits & 0x7F800000) == 0x7F800000)
+        continue;
+
+      bits = (bits + half) & mask;
+      std::memcpy(buffer + offset, &bits, sizeof(bits));
+    }
+  }
+}
+
+void AsyncTreeWriter::save(size_t slot) {
+  char* buffer = mRing.data() + slot * mEventSize;
+  for (const Column& column: mColumns) {
+    if (! column.count) {
+      std::memcpy(buffer + column.offset, column.source, column.size);
+    } else if (*column.count > 0) {
+      std::memcpy(buffer + column.offset, column.address(), *column.count * column.size);
+    }
+  }
+
+  for (auto& column: mObjectColumns) {
+    column->save(slot);
+  }
+}
+
+void AsyncTreeWriter::write(size_t slot) {
+  const char* buffer = mRing.data() + slot * mEventSize;
+  for (Column& column: mColumns) {
+    size_t size = column.size;
+    if (column.count) {
+      int count;
+      std::memcpy(&count, buffer + mColumns[column.countColumn].offset, sizeof(count));
+      size *= std::max(0, count);
+    }
+
+    std::memcpy(column.target.data(), buffer + column.offset, size);
+    if (column.floatMask != 0xFFFFFFFF)
+      roundFloats(column.target.data(), size, column.floatMask);
+  }
+
+  for (auto& column: mObjectColumns) {
+    column->load(slot);
+  }
+
+  // Fill() may write baskets or auto-save the trees: hold the output file as current directory,
+  // whatever the event loop does with gDirectory
+  TDirectory::TContext context(gDirectory, (mOutputFile) ? mOutputFile : gDirectory);
+  for (TTree* tree: mTrees) {
+    tree->Fill();
+  }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TBranch;
+class TBranchElement;
+class TChainElement;
+class TDirectory;
+class TTree;
+
+/**
+ * Fill cloned output trees from a dedicated thread.
+ *
+ * fill() copies the current content of the input buffers into a slot of a bounded ring, and
+ * returns immediately; the writer thread copies the slot into the output trees buffers and
+ * calls Fill() on them, so basket compression no longer stalls the event loop. When the ring
+ * is full, fill() waits for the writer.
+ *
+ * Branch addresses of the output trees must point to the input buffers when they are registered,
+ * as done by cloneTree() or makeCompactTree(). Without start(), fill() is synchronous.
+ *
+ * The writer thread fills the trees with the output file as current directory. Under ROOT 5,
+ * gDirectory and the list of open files are shared by all threads, so the input files must not
+ * change while events are queued: call flush() before the input chains move to their next file.
+ *
+ * Variable size arrays are copied up to their current size. Their buffers start small and double
+ * when an event has more elements, once the queued events are written. The readers grow their own
+ * arrays the same way, so their addresses are taken from the input tree at each event.
+ *
+ * Object branches (the trigger names and results vectors) can't be copied as bytes: each slot
+ * holds a deep copy of the input object, swapped into an object owned by the writer before
+ * Fill(). Other object types stay bound to the input objects, and the trees are then filled
+ * synchronously.
+ */
+class AsyncTreeWriter {
+  public:
+    AsyncTreeWriter(size_t maxQueuedEvents = 1024);
+    ~AsyncTreeWriter();
+
+    /**
+     * Float columns of this tree are rounded to floatBits bits of mantissa (23 keeps full
+     * precision). Fewer bits compress much better.
+     */
+    void add(TTree* output, TTree* input, int floatBits = 23);
+
+    void start();
+
+    // Queue the current content of all registered trees
+    void fill();
+
+    // Wait for all queued events to be written. The writer thread then stays idle until the next fill()
+    void flush();
+
+    // Wait for all queued events to be written, and stop the writer thread
+    void stop();
+
+    // Make room for 'capacity' elements in each variable size array, before entries are read into the output buffers
+    void reserve(size_t capacity);
+
+    const std::vector<TTree*>& trees() const {
+      return mTrees;
+    }
+
+  private:
+    AsyncTreeWriter(const AsyncTreeWriter&);
+    AsyncTreeWriter& operator=(const AsyncTreeWriter&);
+
+    struct Column {
+      TBranch* branch;
+      const char* source;
+      std::vector<char> target;
+      // Bytes of the column, or of one element for variable size arrays
+      size_t size;
+      size_t offset;
+      uint32_t floatMask;
+
+      // Variable size arrays only: where the input array is read from, and the column of its size
+      TChainElement* element;
+      TBranch* inputBranch;
+      const int* count;
+      size_t countColumn;
+      size_t capacity;
+
+      const char* address() const;
+    };
+
+    // Copies of an object branch, one per slot of the ring
+    class ObjectColumn {
+      public:
+        virtual ~ObjectColumn() {}
+
+        // Copy the input object into a slot
+        virtual void save(size_t slot) = 0;
+
+        // Move a slot into the object read by the output branch
+        virtual void load(size_t slot) = 0;
+    };
+
+    template<typename T> class VectorColumn;
+
+    static ObjectColumn* makeObjectColumn(TBranchElement* branch, size_t slots);
+
+    void run();
+    void save(size_t slot);
+    void write(size_t slot);
+
+    size_t neededCapacity() const;
+    void layout();
+
+    std::vector<TTree*> mTrees;
+    TDirectory* mOutputFile;
+    std::vector<Column> mColumns;
+    std::vector<std::unique_ptr<ObjectColumn>> mObjectColumns;
+    size_t mEventSize;
+
+    // Object branch which can't be copied, if any: trees are filled synchronously
+    std::string mUnsupportedBranch;
+
+    // Ring of mMaxQueuedEvents slots of mEventSize bytes
+    std::vector<char> mRing;
+    size_t mMaxQueuedEvents;
+    size_t mHead;
+    size_t mQueued;
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    bool mRunning;
+    bool mStopping;
+};
@@ -0,0 +1,298 @@
+#include "Checkpoint.h"
+
+#include <TClass.h>
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TH1.h>
+#include <TKey.h>
+#include <TLeaf.h>
+#include <TParameter.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+
+namespace {
+  void saveHistograms(TDirectory* from, TDirectory* to) {
+    TIter next(from->GetList());
+    while (TObject* object = next()) {
+      if (object->InheritsFrom(TDirectory::Class())) {
+        saveHistograms(static_cast<TDirectory*>(object), to->mkdir(object->GetName()));
+      } else if (object->InheritsFrom(TH1::Class())) {
+        to->WriteTObject(object);
+      }
+    }
+  }
+
+  bool restoreHistograms(TDirectory* from, TDirectory* to) {
+    TIter next(from->GetListOfKeys());
+    while (TKey* key = static_cast<TKey*>(next())) {
+      TClass* type = TClass::GetClass(key->GetClassName());
+      if (! type)
+        continue;
+
+      TObject* target = to->GetList()->FindObject(key->GetName());
+      if (! target) {
+        std::cerr << "Error: '" << key->GetName() << "' from checkpoint not found in '" << to->GetPath() << "'" << std::endl;
+        return false;
+      }
+
+      if (type->InheritsFrom(TDirectory::Class())) {
+        if (! restoreHistograms(from->GetDirectory(key->GetName()), static_cast<TDirectory*>(target)))
+          return false;
+      } else if (type->InheritsFrom(TH1::Class())) {
+        std::unique_ptr<TH1> saved(static_cast<TH1*>(key->ReadObj()));
+        static_cast<TH1*>(target)->Add(saved.get());
+      }
+    }
+
+    return true;
+  }
+
+  void writeValue(TDirectory* dir, const std::string& name, uint64_t value) {
+    TParameter<Long64_t> parameter(name.c_str(), value);
+    dir->WriteTObject(&parameter);
+  }
+
+  bool readValue(TDirectory* dir, const std::string& name, uint64_t& value) {
+    std::unique_ptr<TParameter<Long64_t>> parameter(static_cast<TParameter<Long64_t>*>(dir->Get(name.c_str())));
+    if (! parameter.get()) {
+      std::cerr << "Error: '" << name << "' not found in checkpoint" << std::endl;
+      return false;
+    }
+
+    value = parameter->GetVal();
+    return true;
+  }
+}
+
+Checkpoint::Checkpoint(const std::string& outputFile):
+  mOutputFile(outputFile), mFileName(outputFile + ".checkpoint"), mPreviousFile(outputFile + ".previous") {
+
+}
+
+void Checkpoint::addCounter(const std::string& name, uint64_t& counter) {
+  mCounters.push_back(std::make_pair(name, &counter));
+}
+
+void Checkpoint::addRuns(const std::string& name, std::set<unsigned int>& runs) {
+  mRuns.push_back(std::make_pair(name, &runs));
+}
+
+void Checkpoint::addTree(TTree* tree) {
+  if (tree)
+    mTrees.push_back(tree);
+}
+
+bool Checkpoint::exists() const {
+  return boost::filesystem::exists(mFileName);
+}
+
+bool Checkpoint::prepareResume() {
+  if (! exists()) {
+    std::cerr << "Error: no checkpoint found ('" << mFileName << "')" << std::endl;
+    return false;
+  }
+
+  // If the previous output is still there, the last resume was interrupted before its first
+  // checkpoint: the output file is incomplete, and the checkpoint still refers to the previous one
+  if (! boost::filesystem::exists(mPreviousFile) && boost::filesystem::exists(mOutputFile)) {
+    if (std::rename(mOutputFile.c_str(), mPreviousFile.c_str()) != 0) {
+      std::cerr << "Error: can't move '" << mOutputFile << "' to '" << mPreviousFile << "'" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+size_t Checkpoint::largestArray() const {
+  TDirectory* current = gDirectory;
+
+  size_t largest = 0;
+  std::unique_ptr<TFile> previous(TFile::Open(mPreviousFile.c_str()));
+  if (previous.get() && ! previous->IsZombie()) {
+    for (TTree* tree: mTrees) {
+      TTree* source = static_cast<TTree*>(previous->Get(tree->GetName()));
+      if (! source)
+        continue;
+
+      TIter next(source->GetListOfLeaves());
+      while (TLeaf* leaf = static_cast<TLeaf*>(next())) {
+        if (leaf->GetLeafCount())
+          largest = std::max(largest, static_cast<size_t>(std::max(0., source->GetMaximum(leaf->GetLeafCount()->GetName()))));
+      }
+    }
+  }
+
+  current->cd();
+  return largest;
+}
+
+bool Checkpoint::restoreTrees() {
+  if (mTrees.empty())
+    return true;
+
+  TDirectory* current = gDirectory;
+
+  std::unique_ptr<TFile> checkpoint(TFile::Open(mFileName.c_str()));
+  std::unique_ptr<TFile> previous(TFile::Open(mPreviousFile.c_str()));
+  if (! checkpoint.get() || ! previous.get() || previous->IsZombie()) {
+    std::cerr << "Error: can't open '" << mPreviousFile << "' to restore output trees" << std::endl;
+    current->cd();
+    return false;
+  }
+
+  bool ok = true;
+  for (TTree* tree: mTrees) {
+    uint64_t entries = 0;
+    TTree* source = static_cast<TTree*>(previous->Get(tree->GetName()));
+    if (! readValue(checkpoint.get(), std::string("tree_") + tree->GetName(), entries) || ! source || static_cast<uint64_t>(source->GetEntries()) < entries) {
+      std::cerr << "Error: can't restore tree '" << tree->GetName() << "'" << std::endl;
+      ok = false;
+      break;
+    }
+
+    // Read the previous entries into the buffers of the output tree
+    tree->CopyAddresses(source);
+    for (uint64_t i = 0; i < entries; i++) {
+      source->GetEntry(i);
+      tree->Fill();
+    }
+    tree->CopyAddresses(source, true);
+  }
+
+  current->cd();
+  return ok;
+}
+
+bool Checkpoint::restore(TDirectory* output, uint64_t from, uint64_t to, uint64_t& nextEntry) {
+  TDirectory* current = gDirectory;
+
+  std::unique_ptr<TFile> checkpoint(TFile::Open(mFileName.c_str()));
+  if (! checkpoint.get() || checkpoint->IsZombie()) {
+    std::cerr << "Error: can't open checkpoint '" << mFileName << "'" << std::endl;
+    current->cd();
+    return false;
+  }
+
+  uint64_t savedFrom = 0, savedTo = 0;
+  bool ok = readValue(checkpoint.get(), "from", savedFrom) && readValue(checkpoint.get(), "to", savedTo) && readValue(checkpoint.get(), "next_entry", nextEntry);
+  if (ok && (savedFrom != from || savedTo != to || nextEntry < from || nextEntry > to)) {
+    std::cerr << "Error: checkpoint was made for entries [" << savedFrom << ", " << savedTo << "[, not [" << from << ", " << to << "[" << std::endl;
+    ok = false;
+  }
+
+  for (size_t i = 0; ok && i < mCounters.size(); i++) {
+    ok = readValue(checkpoint.get(), "counter_" + mCounters[i].first, *mCounters[i].second);
+  }
+
+  for (size_t i = 0; ok && i < mRuns.size(); i++) {
+    TTree* runs = static_cast<TTree*>(checkpoint->Get(("runs_" + mRuns[i].first).c_str()));
+    if (! runs) {
+      ok = false;
+      break;
+    }
+
+    UInt_t run = 0;
+    runs->SetBranchAddress("run", &run);
+    for (Long64_t entry = 0; entry < runs->GetEntries(); entry++) {
+      runs->GetEntry(entry);
+      mRuns[i].second->insert(run);
+    }
+  }
+
+  TDirectory* histograms = checkpoint->GetDirectory("histograms");
+  ok = ok && histograms && restoreHistograms(histograms, output);
+
+  // The previous output file is no longer needed once the restored state is checkpointed again
+  if (ok)
+    ok = save(output, from, to, nextEntry);
+
+  if (ok)
+    std::remove(mPreviousFile.c_str());
+
+  current->cd();
+  return ok;
+}
+
+bool Checkpoint::save(TDirectory* output, uint64_t from, uint64_t to, uint64_t nextEntry) {
+  TDirectory* current = gDirectory;
+
+  // Trees content must be on disk before the checkpoint refers to it
+  for (TTree* tree: mTrees) {
+    tree->AutoSave("SaveSelf");
+  }
+
+  // Unique temporary file, so that jobs sharing an output directory never write into the same one
+  std::string tmpFileName;
+  int fd = BinaryCache::createTemporary(mFileName, tmpFileName);
+  if (fd < 0) {
+    std::cerr << "Error: can't create a temporary file for checkpoint '" << mFileName << "'" << std::endl;
+    current->cd();
+    return false;
+  }
+  close(fd);
+
+  TFile* checkpoint = TFile::Open(tmpFileName.c_str(), "recreate");
+  if (! checkpoint || checkpoint->IsZombie()) {
+    std::cerr << "Error: can't create checkpoint '" << tmpFileName << "'" << std::endl;
+    delete checkpoint;
+    std::remove(tmpFileName.c_str());
+    current->cd();
+    return false;
+  }
+
+  writeValue(checkpoint, "from", from);
+  writeValue(checkpoint, "to", to);
+  writeValue(checkpoint, "next_entry", nextEntry);
+
+  for (const auto& counter: mCounters) {
+    writeValue(checkpoint, "counter_" + counter.first, *counter.second);
+  }
+
+  for (const auto& runs: mRuns) {
+    checkpoint->cd();
+    TTree tree(("runs_" + runs.first).c_str(), runs.first.c_str());
+    UInt_t run = 0;
+    tree.Branch("run", &run, "run/i");
+    for (unsigned int r: *runs.second) {
+      run = r;
+      tree.Fill();
+    }
+    tree.Write();
+    tree.SetDirectory(NULL);
+  }
+
+  for (TTree* tree: mTrees) {
+    writeValue(checkpoint, std::string("tree_") + tree->GetName(), tree->GetEntries());
+  }
+
+  saveHistograms(output, checkpoint->mkdir("histograms"));
+
+  checkpoint->Close();
+  delete checkpoint;
+
+  current->cd();
+
+  if (std::rename(tmpFileName.c_str(), mFileName.c_str()) != 0) {
+    std::cerr << "Error: can't write checkpoint '" << mFileName << "'" << std::endl;
+    std::remove(tmpFileName.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void Checkpoint::remove() {
+  std::remove(mFileName.c_str());
+  std::remove(mPreviousFile.c_str());
+}
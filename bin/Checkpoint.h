@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class TDirectory;
+class TTree;
+
+/**
+ * Sidecar file saving the state of an interrupted finalizer run.
+ *
+ * save() stores all histograms of the output file, the registered counters and the next entry to
+ * process in '<output>.checkpoint'. Output trees are auto-saved in the output file itself, and only
+ * their number of entries goes into the checkpoint.
+ *
+ * To resume, call prepareResume() before the output file is recreated: the previous output is moved
+ * to '<output>.previous'. Then, once the output trees are created, restoreTrees() copies back their
+ * first entries, and once all histograms are booked, restore() adds the saved content and counters.
+ * Entries are read into the buffers of the output trees: they must hold largestArray() elements.
+ */
+class Checkpoint {
+  public:
+    Checkpoint(const std::string& outputFile);
+
+    // Counters and run lists are saved by name
+    void addCounter(const std::string& name, uint64_t& counter);
+    void addRuns(const std::string& name, std::set<unsigned int>& runs);
+    void addTree(TTree* tree);
+
+    bool exists() const;
+
+    bool prepareResume();
+    size_t largestArray() const;
+    bool restoreTrees();
+    bool restore(TDirectory* output, uint64_t from, uint64_t to, uint64_t& nextEntry);
+
+    bool save(TDirectory* output, uint64_t from, uint64_t to, uint64_t nextEntry);
+
+    // Remove the checkpoint once the run is complete
+    void remove();
+
+    const std::string& fileName() const {
+      return mFileName;
+    }
+
+  private:
+    std::string mOutputFile;
+    std::string mFileName;
+    std::string mPreviousFile;
+
+    std::vector<std::pair<std::string, uint64_t*>> mCounters;
+    std::vector<std::pair<std::string, std::set<unsigned int>*>> mRuns;
+    std::vector<TTree*> mTrees;
+};
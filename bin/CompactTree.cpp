@@ -0,0 +1,108 @@
+#include "CompactTree.h"
+
+#include <TChain.h>
+#include <TChainElement.h>
+#include <TBranch.h>
+#include <TLeaf.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+
+std::vector<std::string> getDefaultCompactColumns(bool isMC) {
+  std::vector<std::string> columns = {
+    "analysis.run", "analysis.lumi_block", "analysis.event", "analysis.nvertex", "analysis.event_weight",
+    "misc.rho",
+    "photon.pt", "photon.eta", "photon.phi",
+    "first_jet.pt", "first_jet.eta", "first_jet.phi",
+    "first_jet_raw.pt",
+    "second_jet.pt", "second_jet.eta", "second_jet.phi",
+    "second_jet_raw.pt",
+    "met.et", "met.phi",
+    "met_raw.et", "met_raw.phi"
+  };
+
+  if (isMC) {
+    columns.push_back("analysis.ntrue_interactions");
+    columns.push_back("photon_gen.pt");
+    columns.push_back("first_jet_gen.pt");
+    columns.push_back("second_jet_gen.pt");
+    columns.push_back("met_gen.et");
+  }
+
+  return columns;
+}
+
+std::vector<std::string> parseCompactColumns(const std::string& list) {
+  std::vector<std::string> columns;
+  boost::algorithm::split(columns, list, boost::algorithm::is_any_of(","), boost::algorithm::token_compress_on);
+
+  for (std::string& column: columns) {
+    boost::algorithm::trim(column);
+  }
+  columns.erase(std::remove(columns.begin(), columns.end(), ""), columns.end());
+
+  return columns;
+}
+
+namespace {
+  char getLeafTypeCode(const std::string& type) {
+    static const std::map<std::string, char> codes = {
+      {"Char_t", 'B'}, {"UChar_t", 'b'}, {"Short_t", 'S'}, {"UShort_t", 's'},
+      {"Int_t", 'I'}, {"UInt_t", 'i'}, {"Float_t", 'F'}, {"Double_t", 'D'},
+      {"Long64_t", 'L'}, {"ULong64_t", 'l'}, {"Bool_t", 'O'}
+    };
+
+    std::map<std::string, char>::const_iterator it = codes.find(type);
+    return (it == codes.end()) ? 0 : it->second;
+  }
+
+  void* getBranchAddress(TTree* tree, const std::string& branch) {
+    TChain* chain = dynamic_cast<TChain*>(tree);
+    if (chain) {
+      TChainElement* element = static_cast<TChainElement*>(chain->GetStatus()->FindObject(branch.c_str()));
+      return (element) ? element->GetBaddress() : NULL;
+    }
+
+    TBranch* b = tree->GetBranch(branch.c_str());
+    return (b) ? b->GetAddress() : NULL;
+  }
+}
+
+TTree* makeCompactTree(const std::string& name, const std::map<std::string, TTree*>& inputs, const std::vector<std::string>& columns) {
+  TTree* tree = new TTree(name.c_str(), "Selected events");
+
+  for (const std::string& column: columns) {
+    size_t separator = column.find('.');
+    std::map<std::string, TTree*>::const_iterator input = (separator == std::string::npos) ? inputs.end() : inputs.find(column.substr(0, separator));
+    if (input == inputs.end() || ! input->second) {
+      std::cerr << "Error: unknown tree for column '" << column << "'" << std::endl;
+      delete tree;
+      return NULL;
+    }
+
+    const std::string branch = column.substr(separator + 1);
+    TLeaf* leaf = input->second->GetLeaf(branch.c_str());
+    void* address = getBranchAddress(input->second, branch);
+    if (! leaf || ! address) {
+      std::cerr << "Error: column '" << column << "' not found, or not read" << std::endl;
+      delete tree;
+      return NULL;
+    }
+
+    char code = getLeafTypeCode(leaf->GetTypeName());
+    if (! code || leaf->GetLeafCount() || leaf->GetLenStatic() != 1) {
+      std::cerr << "Error: column '" << column << "' is not a scalar" << std::endl;
+      delete tree;
+      return NULL;
+    }
+
+    std::string outputName = column;
+    std::replace(outputName.begin(), outputName.end(), '.', '_');
+    tree->Branch(outputName.c_str(), address, (outputName + "/" + code).c_str());
+  }
+
+  return tree;
+}
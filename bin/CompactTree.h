@@ -0,0 +1,26 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+class TTree;
+
+/**
+ * Selected events output made of one flat tree, instead of clones of all the input trees.
+ *
+ * Columns are named 'tree.branch' after the step 2 trees (for example 'photon.pt' or
+ * 'misc.rho'), and stored as 'tree_branch'. Only scalar branches are supported.
+ */
+
+// Columns used by the drawing programs
+std::vector<std::string> getDefaultCompactColumns(bool isMC);
+
+// Split a comma separated list of columns
+std::vector<std::string> parseCompactColumns(const std::string& list);
+
+/**
+ * Create a tree whose branches point to the buffers of the input trees, indexed by their
+ * short name. Returns NULL if a column can't be found.
+ */
+TTree* makeCompactTree(const std::string& name, const std::map<std::string, TTree*>& inputs, const std::vector<std::string>& columns);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Counter-based random numbers (Philox4x32-10, see Salmon et al., "Parallel random numbers:
+ * as easy as 1, 2, 3").
+ *
+ * Unlike a sequential generator, there's no state: the number drawn for an event only
+ * depends on the seed and on the event id. The output is thus the same whatever the
+ * order in which events are processed, or how the input is split between jobs.
+ */
+class CounterRandom {
+  public:
+    CounterRandom(uint64_t seed = 0):
+      mKey0(seed), mKey1(seed >> 32) {}
+
+    /**
+     * Uniform number in ]0, 1], like TRandom::Rndm(). Use a different stream for each
+     * independent draw of the same event.
+     */
+    double uniform(uint32_t run, uint32_t lumi, uint32_t event, uint32_t stream = 0) const {
+      uint32_t counter[4] = { event, lumi, run, stream };
+      philox(counter);
+
+      uint64_t bits = ((static_cast<uint64_t>(counter[0]) << 32) | counter[1]) >> 11; // 53 bits
+      return (bits + 1) * (1. / 9007199254740992.); // 2^-53
+    }
+
+    // Raw Philox4x32-10 block, for checking against reference values
+    void philox(uint32_t counter[4]) const {
+      uint32_t key0 = mKey0;
+      uint32_t key1 = mKey1;
+
+      for (int round = 0; round < 10; round++) {
+        uint64_t product0 = static_cast<uint64_t>(0xD2511F53) * counter[0];
+        uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57) * counter[2];
+
+        uint32_t c0 = (product1 >> 32) ^ counter[1] ^ key0;
+        uint32_t c1 = product1;
+        uint32_t c2 = (product0 >> 32) ^ counter[3] ^ key1;
+        uint32_t c3 = product0;
+
+        counter[0] = c0;
+        counter[1] = c1;
+        counter[2] = c2;
+        counter[3] = c3;
+
+        key0 += 0x9E3779B9;
+        key1 += 0xBB67AE85;
+      }
+    }
+
+  private:
+    uint32_t mKey0;
+    uint32_t mKey1;
+};
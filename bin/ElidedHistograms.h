@@ -0,0 +1,231 @@
+#pragma once
+
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TH1F.h>
+#include <TH1D.h>
+#include <TH2F.h>
+#include <TH2D.h>
+#include <TTree.h>
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Empty histograms left out of the finalizer output (--skip-empty).
+ *
+ * Most of the eta x pt x extrapolation bin histograms stay empty, yet they cost as much as the
+ * others to write, merge and open. elide() removes them from the output before it's written, and
+ * books them in the 'elided_histograms' tree: path, class, title and binning. Readers call
+ * restore() once the file is opened, which recreates them in memory, empty, so that Get() finds
+ * every booked histogram. hadd concatenates the trees of all jobs, and keeps a histogram as soon
+ * as one job has filled it.
+ *
+ * Only fixed binning TH1F, TH1D, TH2F and TH2D are elided. Header-only, so that the draw programs
+ * can use it without linking anything from bin/.
+ */
+class ElidedHistograms {
+  public:
+    ElidedHistograms() {}
+
+    // Elided histograms may still be used (by GaussianProfile for its graph): they're kept until now
+    ~ElidedHistograms() {
+      for (TH1* h: mElided) {
+        delete h;
+      }
+    }
+
+    /**
+     * Remove the empty histograms of 'output' and of its subdirectories, and store the manifest in
+     * 'output'. Returns the number of histograms removed.
+     */
+    size_t elide(TDirectory* output) {
+      std::vector<std::pair<std::string, TH1*>> empty;
+      collect(output, "", empty);
+
+      TDirectory* current = gDirectory;
+      output->cd();
+      TTree* manifest = new TTree(treeName(), "Booking of the empty histograms left out of this file");
+
+      Entry entry;
+      entry.branch(manifest);
+
+      for (auto& histogram: empty) {
+        TH1* h = histogram.second;
+        entry.set(histogram.first, h);
+        manifest->Fill();
+
+        h->SetDirectory(NULL);
+        mElided.push_back(h);
+      }
+
+      current->cd();
+
+      return empty.size();
+    }
+
+    /**
+     * Recreate in memory the histograms listed in the manifest of 'file' which are not in the file.
+     * Returns the number of histograms recreated, 0 for files written without --skip-empty.
+     */
+    static size_t restore(TFile* file) {
+      TTree* manifest = static_cast<TTree*>(file->Get(treeName()));
+      if (! manifest)
+        return 0;
+
+      Entry entry;
+      entry.setAddresses(manifest);
+
+      bool addDirectory = TH1::AddDirectoryStatus();
+      TH1::AddDirectory(false);
+
+      size_t restored = 0;
+      for (Long64_t i = 0; i < manifest->GetEntries(); i++) {
+        manifest->GetEntry(i);
+
+        std::string path = entry.path;
+        size_t slash = path.rfind('/');
+        std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+        TDirectory* dir = (slash == std::string::npos) ? file : file->GetDirectory(path.substr(0, slash).c_str());
+        if (! dir || dir->GetListOfKeys()->FindObject(name.c_str()) || dir->GetList()->FindObject(name.c_str()))
+          continue;
+
+        TH1* h = entry.create(name);
+        if (! h)
+          continue;
+
+        h->SetDirectory(dir);
+        restored++;
+      }
+
+      TH1::AddDirectory(addDirectory);
+      delete manifest;
+
+      return restored;
+    }
+
+    static const char* treeName() {
+      return "elided_histograms";
+    }
+
+  private:
+    ElidedHistograms(const ElidedHistograms&);
+    ElidedHistograms& operator=(const ElidedHistograms&);
+
+    struct Entry {
+      char path[1024];
+      char className[8];
+      char title[1024];
+      Int_t nBinsX;
+      Double_t xMin;
+      Double_t xMax;
+      Int_t nBinsY;
+      Double_t yMin;
+      Double_t yMax;
+      Bool_t sumw2;
+
+      void branch(TTree* tree) {
+        tree->Branch("path", path, "path/C");
+        tree->Branch("class", className, "class/C");
+        tree->Branch("title", title, "title/C");
+        tree->Branch("nx", &nBinsX, "nx/I");
+        tree->Branch("xmin", &xMin, "xmin/D");
+        tree->Branch("xmax", &xMax, "xmax/D");
+        tree->Branch("ny", &nBinsY, "ny/I");
+        tree->Branch("ymin", &yMin, "ymin/D");
+        tree->Branch("ymax", &yMax, "ymax/D");
+        tree->Branch("sumw2", &sumw2, "sumw2/O");
+      }
+
+      void setAddresses(TTree* tree) {
+        tree->SetBranchAddress("path", path);
+        tree->SetBranchAddress("class", className);
+        tree->SetBranchAddress("title", title);
+        tree->SetBranchAddress("nx", &nBinsX);
+        tree->SetBranchAddress("xmin", &xMin);
+        tree->SetBranchAddress("xmax", &xMax);
+        tree->SetBranchAddress("ny", &nBinsY);
+        tree->SetBranchAddress("ymin", &yMin);
+        tree->SetBranchAddress("ymax", &yMax);
+        tree->SetBranchAddress("sumw2", &sumw2);
+      }
+
+      void set(const std::string& p, const TH1* h) {
+        copy(path, p.c_str(), sizeof(path));
+        copy(className, h->ClassName(), sizeof(className));
+        copy(title, h->GetTitle(), sizeof(title));
+
+        nBinsX = h->GetNbinsX();
+        xMin = h->GetXaxis()->GetXmin();
+        xMax = h->GetXaxis()->GetXmax();
+        nBinsY = h->GetNbinsY();
+        yMin = h->GetYaxis()->GetXmin();
+        yMax = h->GetYaxis()->GetXmax();
+        sumw2 = h->GetSumw2N() > 0;
+      }
+
+      TH1* create(const std::string& name) const {
+        TH1* h = NULL;
+        if (strcmp(className, "TH1F") == 0)
+          h = new TH1F(name.c_str(), title, nBinsX, xMin, xMax);
+        else if (strcmp(className, "TH1D") == 0)
+          h = new TH1D(name.c_str(), title, nBinsX, xMin, xMax);
+        else if (strcmp(className, "TH2F") == 0)
+          h = new TH2F(name.c_str(), title, nBinsX, xMin, xMax, nBinsY, yMin, yMax);
+        else if (strcmp(className, "TH2D") == 0)
+          h = new TH2D(name.c_str(), title, nBinsX, xMin, xMax, nBinsY, yMin, yMax);
+
+        if (h && sumw2 && h->GetSumw2N() == 0)
+          h->Sumw2();
+
+        return h;
+      }
+
+      static void copy(char* to, const char* from, size_t size) {
+        strncpy(to, from, size - 1);
+        to[size - 1] = '\0';
+      }
+    };
+
+    static bool isElidable(const TH1* h, const std::string& path) {
+      std::string type = h->ClassName();
+      if (type != "TH1F" && type != "TH1D" && type != "TH2F" && type != "TH2D")
+        return false;
+
+      // Names and titles must fit in the manifest
+      if (path.size() >= sizeof(Entry().path) || strlen(h->GetTitle()) >= sizeof(Entry().title))
+        return false;
+
+      if (h->GetXaxis()->IsVariableBinSize() || h->GetYaxis()->IsVariableBinSize())
+        return false;
+
+      if (h->GetEntries() != 0)
+        return false;
+
+      // Under / overflows included
+      for (int cell = 0; cell < h->GetNcells(); cell++) {
+        if (h->GetBinContent(cell) != 0 || h->GetBinError(cell) != 0)
+          return false;
+      }
+
+      return true;
+    }
+
+    static void collect(TDirectory* dir, const std::string& path, std::vector<std::pair<std::string, TH1*>>& empty) {
+      TIter next(dir->GetList());
+      while (TObject* object = next()) {
+        std::string objectPath = path + object->GetName();
+
+        if (object->InheritsFrom(TDirectory::Class())) {
+          collect(static_cast<TDirectory*>(object), objectPath + "/", empty);
+        } else if (object->InheritsFrom(TH1::Class()) && isElidable(static_cast<TH1*>(object), objectPath)) {
+          empty.push_back(std::make_pair(objectPath, static_cast<TH1*>(object)));
+        }
+      }
+    }
+
+    std::vector<TH1*> mElided;
+};
@@ -0,0 +1,194 @@
+#include "Instrumentation.h"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+Instrumentation::Instrumentation():
+  mEnabled(false), mCurrent(-1), mEvents(0), mBytesRead(0) {
+  std::memset(mStages, 0, sizeof(mStages));
+  std::memset(mLastCounters, 0, sizeof(mLastCounters));
+}
+
+bool Instrumentation::enableHardwareCounters() {
+  if (! mCounters.open())
+    return false;
+
+  mCounters.read(mLastCounters);
+  return true;
+}
+
+const char* Instrumentation::getStageName(int stage) {
+  static const char* names[NUMBER_OF_STAGES] = {
+    "read", "jec", "trigger", "pu", "selection", "fill", "tree_write", "checkpoint", "finalize"
+  };
+
+  return (stage >= 0 && stage < NUMBER_OF_STAGES) ? names[stage] : "";
+}
+
+void Instrumentation::endEvent() {
+  for (StageData& data: mStages) {
+    if (! data.inEvent)
+      continue;
+
+    int bucket = 0;
+    for (uint64_t ns = data.eventNs; ns > 0 && bucket < BUCKETS - 1; ns >>= 1) {
+      bucket++;
+    }
+
+    data.events++;
+    data.totalNs += data.eventNs;
+    if (data.eventNs > data.maxNs)
+      data.maxNs = data.eventNs;
+    data.buckets[bucket]++;
+
+    data.eventNs = 0;
+    data.inEvent = false;
+  }
+}
+
+void Instrumentation::readCounters() {
+  uint64_t values[PerfCounters::NUMBER_OF_COUNTERS];
+  if (! mCounters.read(values))
+    return;
+
+  for (int counter = 0; counter < PerfCounters::NUMBER_OF_COUNTERS; counter++) {
+    // Scaled values of a multiplexed group may go backward slightly
+    if (mCurrent >= 0 && values[counter] > mLastCounters[counter])
+      mStages[mCurrent].counters[counter] += values[counter] - mLastCounters[counter];
+    mLastCounters[counter] = values[counter];
+  }
+}
+
+uint64_t Instrumentation::quantile(const StageData& data, double q) const {
+  if (data.events == 0)
+    return 0;
+
+  // Upper edge of the bin containing the quantile: bin b holds [2^(b-1), 2^b[ ns
+  uint64_t threshold = static_cast<uint64_t>(q * data.events);
+  uint64_t sum = 0;
+  for (int bucket = 0; bucket < BUCKETS; bucket++) {
+    sum += data.buckets[bucket];
+    if (sum > threshold)
+      return (bucket == 0) ? 0 : (1ULL << bucket);
+  }
+
+  return data.maxNs;
+}
+
+double Instrumentation::loopSeconds() const {
+  uint64_t ns = 0;
+  for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+    if (stage != FINALIZE)
+      ns += mStages[stage].totalNs;
+  }
+
+  return ns / 1e9;
+}
+
+void Instrumentation::printSummary(std::ostream& stream) const {
+  double elapsed = loopSeconds();
+  uint64_t totalNs = 0;
+  for (const StageData& data: mStages) {
+    totalNs += data.totalNs;
+  }
+
+  std::ios::fmtflags flags = stream.flags();
+  stream << std::fixed << std::setprecision(1);
+
+  stream << "Timing: " << mEvents << " events in " << elapsed << " s (" << ((elapsed > 0) ? mEvents / elapsed : 0) << " events/s), "
+    << mBytesRead / (1024. * 1024.) << " MB read" << std::endl;
+
+  for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+    const StageData& data = mStages[stage];
+    if (data.events == 0)
+      continue;
+
+    stream << "  " << std::left << std::setw(12) << getStageName(stage) << std::right
+      << std::setw(10) << data.totalNs / 1e6 << " ms"
+      << std::setw(7) << ((totalNs > 0) ? 100. * data.totalNs / totalNs : 0) << " %"
+      << "   mean " << std::setw(8) << data.totalNs / 1e3 / data.events << " us"
+      << "   p50 < " << std::setw(8) << quantile(data, 0.5) / 1e3 << " us"
+      << "   p99 < " << std::setw(8) << quantile(data, 0.99) / 1e3 << " us" << std::endl;
+  }
+
+  if (mCounters.isOpen())
+    printCounters(stream);
+
+  stream.flags(flags);
+}
+
+void Instrumentation::printCounters(std::ostream& stream) const {
+  stream << "Hardware counters (per event):" << std::endl;
+
+  for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+    const StageData& data = mStages[stage];
+    if (data.events == 0)
+      continue;
+
+    const uint64_t* counters = data.counters;
+    stream << "  " << std::left << std::setw(12) << getStageName(stage) << std::right
+      << std::setw(12) << static_cast<double>(counters[PerfCounters::CYCLES]) / data.events << " cycles"
+      << std::setw(12) << static_cast<double>(counters[PerfCounters::INSTRUCTIONS]) / data.events << " instr."
+      << "   IPC " << std::setprecision(2) << std::setw(5) << ((counters[PerfCounters::CYCLES] > 0) ? static_cast<double>(counters[PerfCounters::INSTRUCTIONS]) / counters[PerfCounters::CYCLES] : 0)
+      << std::setprecision(1);
+
+    if (mCounters.isSupported(PerfCounters::LLC_MISSES))
+      stream << std::setw(10) << static_cast<double>(counters[PerfCounters::LLC_MISSES]) / data.events << " LLC misses";
+    if (mCounters.isSupported(PerfCounters::BRANCH_MISSES))
+      stream << std::setw(10) << static_cast<double>(counters[PerfCounters::BRANCH_MISSES]) / data.events << " branch misses";
+
+    stream << std::endl;
+  }
+}
+
+bool Instrumentation::writeJSON(const std::string& fileName) const {
+  std::ofstream f(fileName.c_str());
+  if (! f)
+    return false;
+
+  double elapsed = loopSeconds();
+
+  f << "{" << std::endl;
+  f << "  \"events\": " << mEvents << "," << std::endl;
+  f << "  \"loop_seconds\": " << elapsed << "," << std::endl;
+  f << "  \"events_per_second\": " << ((elapsed > 0) ? mEvents / elapsed : 0) << "," << std::endl;
+  f << "  \"bytes_read\": " << mBytesRead << "," << std::endl;
+  f << "  \"stages\": {" << std::endl;
+
+  bool first = true;
+  for (int stage = 0; stage < NUMBER_OF_STAGES; stage++) {
+    const StageData& data = mStages[stage];
+    if (data.events == 0)
+      continue;
+
+    if (! first)
+      f << "," << std::endl;
+    first = false;
+
+    f << "    \"" << getStageName(stage) << "\": {" << std::endl;
+    f << "      \"events\": " << data.events << "," << std::endl;
+    f << "      \"total_ns\": " << data.totalNs << "," << std::endl;
+    f << "      \"max_ns\": " << data.maxNs << "," << std::endl;
+    f << "      \"p50_ns\": " << quantile(data, 0.5) << "," << std::endl;
+    f << "      \"p99_ns\": " << quantile(data, 0.99) << "," << std::endl;
+
+    for (int counter = 0; mCounters.isOpen() && counter < PerfCounters::NUMBER_OF_COUNTERS; counter++) {
+      if (mCounters.isSupported(static_cast<PerfCounters::Counter>(counter)))
+        f << "      \"" << PerfCounters::getCounterName(counter) << "\": " << data.counters[counter] << "," << std::endl;
+    }
+
+    // Bin b counts events with a latency in [2^(b-1), 2^b[ ns
+    f << "      \"log2_ns_histogram\": [";
+    for (int bucket = 0; bucket < BUCKETS; bucket++) {
+      f << ((bucket > 0) ? ", " : "") << data.buckets[bucket];
+    }
+    f << "]" << std::endl;
+    f << "    }";
+  }
+
+  f << std::endl << "  }" << std::endl;
+  f << "}" << std::endl;
+
+  return f.good();
+}
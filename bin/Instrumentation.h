@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "PerfCounters.h"
+
+/**
+ * Per-stage timing of the finalizer event loop, enabled at runtime.
+ *
+ * The event loop calls beginEvent() at the start of each event, then start(stage) each time it
+ * enters a new stage; the running stage ends when the next one starts. Time spent in each stage
+ * is summed per event, and the per-event latencies are stored in histograms with power-of-two
+ * bins. When disabled, each call is a single test.
+ *
+ * Optionally, hardware counters of the event loop thread are read at each stage switch, and summed
+ * per stage. Each read is a system call, so this adds about a microsecond per stage switch.
+ */
+class Instrumentation {
+  public:
+    enum Stage {
+      READ,
+      JEC,
+      TRIGGER,
+      PU,
+      SELECTION,
+      FILL,
+      TREE_WRITE,
+      CHECKPOINT,
+      FINALIZE, // GaussianProfile fitting and output file writing
+      NUMBER_OF_STAGES
+    };
+
+    Instrumentation();
+
+    void setEnabled(bool enabled) {
+      mEnabled = enabled;
+    }
+
+    bool enabled() const {
+      return mEnabled;
+    }
+
+    // Also collect hardware counters; returns false if they are not available
+    bool enableHardwareCounters();
+
+    void beginEvent() {
+      if (! mEnabled)
+        return;
+
+      switchTo(-1);
+      endEvent();
+      mEvents++;
+    }
+
+    void start(Stage stage) {
+      if (! mEnabled)
+        return;
+
+      switchTo(stage);
+    }
+
+    // End the running stage
+    void stop() {
+      if (! mEnabled)
+        return;
+
+      switchTo(-1);
+      endEvent();
+    }
+
+    void setBytesRead(uint64_t bytes) {
+      mBytesRead = bytes;
+    }
+
+    void printSummary(std::ostream& stream) const;
+    bool writeJSON(const std::string& fileName) const;
+
+    static const char* getStageName(int stage);
+
+  private:
+    typedef std::chrono::steady_clock clock;
+
+    static const int BUCKETS = 40;
+
+    struct StageData {
+      uint64_t events;
+      uint64_t totalNs;
+      uint64_t maxNs;
+      uint64_t buckets[BUCKETS];
+
+      // Time spent in the current event
+      uint64_t eventNs;
+      bool inEvent;
+
+      uint64_t counters[PerfCounters::NUMBER_OF_COUNTERS];
+    };
+
+    void switchTo(int stage) {
+      if (mCounters.isOpen())
+        readCounters();
+
+      clock::time_point now = clock::now();
+      if (mCurrent >= 0) {
+        StageData& data = mStages[mCurrent];
+        data.eventNs += std::chrono::duration_cast<std::chrono::nanoseconds>(now - mStageStart).count();
+        data.inEvent = true;
+      }
+
+      mCurrent = stage;
+      mStageStart = now;
+    }
+
+    void endEvent();
+
+    // Add the counts since the last stage switch to the running stage
+    void readCounters();
+
+    void printCounters(std::ostream& stream) const;
+
+    // Approximate quantile of the per-event latency of a stage, in ns
+    uint64_t quantile(const StageData& data, double q) const;
+
+    // Time spent in all stages of the event loop
+    double loopSeconds() const;
+
+    bool mEnabled;
+    int mCurrent;
+    clock::time_point mStageStart;
+
+    uint64_t mEvents;
+    uint64_t mBytesRead;
+    StageData mStages[NUMBER_OF_STAGES];
+
+    PerfCounters mCounters;
+    uint64_t mLastCounters[PerfCounters::NUMBER_OF_COUNTERS];
+};
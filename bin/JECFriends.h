@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+/**
+ * JEC variant friend trees, written by jecFriendTrees and read by gammaJetFinalizer.
+ *
+ * For each input file 'foo.root' and each variant, 'foo_jec_<variant>.root' holds one tree,
+ * 'gammaJet/<postfix>/jec_<variant>', with the same number of entries as the input trees and two
+ * branches: first_jet_pt and second_jet_pt, the raw jets corrected with the variant payloads.
+ */
+
+inline std::string getJECFriendFileName(const std::string& inputFile, const std::string& variant) {
+  std::string base = inputFile;
+  const std::string extension = ".root";
+  if (base.size() > extension.size() && base.compare(base.size() - extension.size(), extension.size(), extension) == 0)
+    base.erase(base.size() - extension.size());
+
+  return base + "_jec_" + variant + ".root";
+}
+
+inline std::string getJECFriendTreeName(const std::string& postfix, const std::string& variant) {
+  return "gammaJet/" + postfix + "/jec_" + variant;
+}
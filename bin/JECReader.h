@@ -1,8 +1,11 @@
 #pragma once
 
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+
 // Custom corrections
 #include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
 #include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
@@ -44,7 +47,11 @@ class XMLSimpleStr {
 };
 
 
-FactorizedJetCorrector* makeFactorizedJetCorrectorFromXML(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC) {
+/**
+ * Resolve the list of payload files to use for this jet algorithm from the XML description.
+ * Returns false on error.
+ */
+bool getJECPayloadsFromXML(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC, std::vector<std::string>& payloads) {
 
   try {
     XMLPlatformUtils::Initialize();
@@ -54,7 +61,7 @@ FactorizedJetCorrector* makeFactorizedJetCorrectorFromXML(const std::string& xml
     std::cout << "Error during initialization! :\n" << message << "\n";
     XMLString::release(&message);
 
-    return NULL;
+    return false;
   }
 
   const std::string mcDataText = (isMC) ? "MC" : "DATA";
@@ -85,7 +92,6 @@ FactorizedJetCorrector* makeFactorizedJetCorrectorFromXML(const std::string& xml
     XMLCh* prefixStr = XMLString::transcode("prefix");
     XMLCh* pathStr = XMLString::transcode("path");
 
-    std::vector<JetCorrectorParameters> correctors;
     XMLSimpleStr prefix(corrections->getAttribute(prefixStr));
     XMLSimpleStr path(corrections->getAttribute(pathStr));
 
@@ -115,8 +121,7 @@ FactorizedJetCorrector* makeFactorizedJetCorrectorFromXML(const std::string& xml
         std::string filename = path.get() + prefix.get() + "_" + mcDataText + "_" + jetAlgo + "_" + name.get() + ".txt";
         //std::string filename = path.get() + prefix.get() + "_" + name.get() + "_" + jetAlgo + ".txt";
         if (!onlyOnData || (onlyOnData && !isMC)) {
-          std::cout << "Using payload '" << filename << "'" << std::endl;
-          correctors.push_back(JetCorrectorParameters(filename));
+          payloads.push_back(filename);
         }
       }
     }
@@ -125,21 +130,185 @@ FactorizedJetCorrector* makeFactorizedJetCorrectorFromXML(const std::string& xml
     XMLString::release(&onlyOnDataStr);
     XMLString::release(&trueStr);
 
-    return new FactorizedJetCorrector(correctors);
+    return true;
 
   } catch (const XMLException& toCatch) {
     char* message = XMLString::transcode(toCatch.getMessage());
     std::cout << "Exception message is: \n" << message << "\n";
     XMLString::release(&message);
-    return NULL;
+    return false;
   } catch (const DOMException& toCatch) {
     char* message = XMLString::transcode(toCatch.msg);
     std::cout << "Exception message is: \n" << message << "\n";
     XMLString::release(&message);
-    return NULL;
+    return false;
   }
 
   XMLPlatformUtils::Terminate();
-  return NULL;
+  return false;
+}
+
+bool readJECParametersFromXML(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC, std::vector<JetCorrectorParameters>& correctors) {
+
+  std::vector<std::string> payloads;
+  if (! getJECPayloadsFromXML(xmlfile, jetAlgo, isMC, payloads))
+    return false;
+
+  for (const std::string& payload: payloads) {
+    std::cout << "Using payload '" << payload << "'" << std::endl;
+    correctors.push_back(JetCorrectorParameters(payload));
+  }
+
+  return true;
+}
+
+FactorizedJetCorrector* makeFactorizedJetCorrectorFromXML(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC) {
+
+  std::vector<JetCorrectorParameters> correctors;
+  if (! readJECParametersFromXML(xmlfile, jetAlgo, isMC, correctors))
+    return NULL;
+
+  return new FactorizedJetCorrector(correctors);
+}
+
+//--------
+
+namespace {
+  const char JEC_MAGIC[8] = {'G', 'J', 'J', 'E', 'C', 'P', 'A', 'Y'};
+  const uint32_t JEC_VERSION = 1;
+}
+
+// Name of the compiled payloads for one jet algorithm, next to the XML description
+std::string getCompiledJECFileName(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC) {
+  return xmlfile + "." + jetAlgo + ((isMC) ? ".MC" : ".DATA") + ".bin";
+}
+
+// Header line of a payload file, as understood by JetCorrectorParameters::Definitions
+std::string getJECDefinitionsLine(const JetCorrectorParameters::Definitions& definitions) {
+  std::stringstream line;
+
+  const std::vector<std::string> binVar = definitions.binVar();
+  line << binVar.size();
+  for (const std::string& var: binVar)
+    line << " " << var;
+
+  const std::vector<std::string> parVar = definitions.parVar();
+  line << " " << parVar.size();
+  for (const std::string& var: parVar)
+    line << " " << var;
+
+  line << " " << definitions.formula() << " " << ((definitions.isResponse()) ? "Response" : "Correction") << " " << definitions.level();
+
+  return line.str();
+}
+
+/**
+ * Write the already parsed parameters of every payload of this jet algorithm. Each payload
+ * is stored with the hash of its text file, so that an updated payload invalidates the
+ * compiled file.
+ */
+bool compileJECPayloads(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC) {
+
+  BinaryCache::MappedFile xml(xmlfile);
+  std::vector<std::string> payloads;
+  if (! xml.isValid() || ! getJECPayloadsFromXML(xmlfile, jetAlgo, isMC, payloads))
+    return false;
+
+  const std::string fileName = getCompiledJECFileName(xmlfile, jetAlgo, isMC);
+  std::string tmpFileName;
+  FILE* f = BinaryCache::create(fileName, tmpFileName);
+  if (! f)
+    return false;
+
+  bool ok = BinaryCache::writeHeader(f, JEC_MAGIC, JEC_VERSION, payloads.size(), xml.hash());
+  for (const std::string& payload: payloads) {
+    BinaryCache::MappedFile payloadFile(payload);
+    if (! payloadFile.isValid()) {
+      std::cout << "Error: failed to open payload '" << payload << "'" << std::endl;
+      ok = false;
+      break;
+    }
+
+    JetCorrectorParameters parameters(payload);
+
+    ok = ok && BinaryCache::write(f, payload);
+    ok = ok && BinaryCache::write(f, payloadFile.hash());
+    ok = ok && BinaryCache::write(f, getJECDefinitionsLine(parameters.definitions()));
+    ok = ok && BinaryCache::write<uint32_t>(f, parameters.size());
+
+    for (unsigned int i = 0; i < parameters.size(); i++) {
+      const JetCorrectorParameters::Record& record = parameters.record(i);
+
+      std::vector<float> xMin, xMax;
+      for (unsigned int var = 0; var < record.nVar(); var++) {
+        xMin.push_back(record.xMin(var));
+        xMax.push_back(record.xMax(var));
+      }
+
+      ok = ok && BinaryCache::write(f, xMin);
+      ok = ok && BinaryCache::write(f, xMax);
+      ok = ok && BinaryCache::write(f, record.parameters());
+    }
+  }
+
+  return BinaryCache::commit(f, tmpFileName, fileName, ok);
+}
+
+/**
+ * Read the compiled payloads, without Xerces nor text parsing. Returns false if there's no
+ * compiled file, or if the XML description or one of the payloads has changed since it was
+ * compiled.
+ */
+bool readCompiledJECParameters(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC, std::vector<JetCorrectorParameters>& correctors) {
+
+  BinaryCache::MappedFile xml(xmlfile);
+  BinaryCache::MappedFile file(getCompiledJECFileName(xmlfile, jetAlgo, isMC));
+  if (! xml.isValid() || ! file.isValid())
+    return false;
+
+  BinaryCache::Reader reader(file.begin(), file.end());
+
+  BinaryCache::Header header;
+  if (! reader.readHeader(JEC_MAGIC, JEC_VERSION, header) || header.sourceHash != xml.hash())
+    return false;
+
+  std::vector<JetCorrectorParameters> compiled;
+  for (uint32_t i = 0; i < header.count && reader.ok(); i++) {
+    std::string payload, definitions;
+    uint64_t payloadHash = 0;
+    uint32_t nRecords = 0;
+    reader.read(payload);
+    reader.read(payloadHash);
+    reader.read(definitions);
+    reader.read(nRecords);
+
+    BinaryCache::MappedFile payloadFile(payload);
+    if (! reader.ok() || ! payloadFile.isValid() || payloadFile.hash() != payloadHash)
+      return false;
+
+    std::vector<JetCorrectorParameters::Record> records;
+    for (uint32_t j = 0; j < nRecords && reader.ok(); j++) {
+      std::vector<float> xMin, xMax, parameters;
+      reader.read(xMin);
+      reader.read(xMax);
+      reader.read(parameters);
+
+      records.push_back(JetCorrectorParameters::Record(xMin.size(), xMin, xMax, parameters));
+    }
+
+    std::cout << "Using payload '" << payload << "' (compiled)" << std::endl;
+    compiled.push_back(JetCorrectorParameters(JetCorrectorParameters::Definitions(definitions), records));
+  }
+
+  if (! reader.ok())
+    return false;
+
+  correctors.insert(correctors.end(), compiled.begin(), compiled.end());
+  return true;
+}
+
+// Compiled payloads if they are up to date, XML description otherwise
+bool readJECParameters(const std::string& xmlfile, const std::string& jetAlgo, const bool isMC, std::vector<JetCorrectorParameters>& correctors) {
+  return readCompiledJECParameters(xmlfile, jetAlgo, isMC, correctors) || readJECParametersFromXML(xmlfile, jetAlgo, isMC, correctors);
 }
 
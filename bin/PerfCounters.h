@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Hardware counters of the calling thread, read with perf_event_open.
+ *
+ * The counters are opened as a single group, so that they are scheduled together and all values
+ * of a read() cover the same interval. Only user space is counted, which works with the default
+ * perf_event_paranoid setting. Counters not supported by the machine (common in virtual machines)
+ * always read as 0; if the leader (cycles) can't be opened, open() fails.
+ *
+ * Header-only, so that it can be used by the draw programs too.
+ */
+class PerfCounters {
+  public:
+    enum Counter {
+      CYCLES,
+      INSTRUCTIONS,
+      LLC_MISSES,
+      BRANCH_MISSES,
+      NUMBER_OF_COUNTERS
+    };
+
+    PerfCounters() {
+      for (int i = 0; i < NUMBER_OF_COUNTERS; i++) {
+        mFd[i] = -1;
+        mSupported[i] = false;
+      }
+    }
+
+    ~PerfCounters() {
+      close();
+    }
+
+    bool open() {
+#ifdef __linux__
+      if (isOpen())
+        return true;
+
+      static const uint64_t configs[NUMBER_OF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+      };
+
+      for (int i = 0; i < NUMBER_OF_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = (i == CYCLES);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        mFd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, mFd[CYCLES], 0);
+        mSupported[i] = (mFd[i] >= 0);
+
+        if (i == CYCLES && ! mSupported[i])
+          return false;
+      }
+
+      ioctl(mFd[CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(mFd[CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    void close() {
+#ifdef __linux__
+      for (int i = 0; i < NUMBER_OF_COUNTERS; i++) {
+        if (mFd[i] >= 0)
+          ::close(mFd[i]);
+        mFd[i] = -1;
+        mSupported[i] = false;
+      }
+#endif
+    }
+
+    bool isOpen() const {
+      return mFd[CYCLES] >= 0;
+    }
+
+    bool isSupported(Counter counter) const {
+      return mSupported[counter];
+    }
+
+    // Counts since open(), scaled up if the group was not always scheduled on the PMU
+    bool read(uint64_t values[NUMBER_OF_COUNTERS]) const {
+      std::memset(values, 0, NUMBER_OF_COUNTERS * sizeof(uint64_t));
+
+#ifdef __linux__
+      if (! isOpen())
+        return false;
+
+      // nr, time_enabled, time_running, then one value per opened counter
+      uint64_t data[3 + NUMBER_OF_COUNTERS];
+      if (::read(mFd[CYCLES], data, sizeof(data)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+        return false;
+
+      double scale = (data[2] > 0) ? static_cast<double>(data[1]) / data[2] : 0.;
+      uint64_t index = 0;
+      for (int i = 0; i < NUMBER_OF_COUNTERS && index < data[0]; i++) {
+        if (mSupported[i])
+          values[i] = static_cast<uint64_t>(data[3 + index++] * scale);
+      }
+
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    static const char* getCounterName(int counter) {
+      static const char* names[NUMBER_OF_COUNTERS] = {
+        "cycles", "instructions", "llc_misses", "branch_misses"
+      };
+
+      return (counter >= 0 && counter < NUMBER_OF_COUNTERS) ? names[counter] : "";
+    }
+
+  private:
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    int mFd[NUMBER_OF_COUNTERS];
+    bool mSupported[NUMBER_OF_COUNTERS];
+};
@@ -0,0 +1,178 @@
+#include "TabulatedJetCorrector.h"
+
+#include "CondFormats/JetMETObjects/interface/FactorizedJetCorrector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+TabulatedJetCorrector::TabulatedJetCorrector(const std::vector<JetCorrectorParameters>& parameters, double tolerance):
+  mCorrector(new FactorizedJetCorrector(parameters)), mValid(false), mMaxRelativeError(0) {
+
+  // pt from 5 GeV to 6.5 TeV, about 9 nodes per e-fold
+  mLogPt = { std::log(5.), std::log(6500.), 64 };
+  mRho = { 0., 50., 21 };
+  mArea = { 0.2, 1.4, 13 };
+
+  if (! canTabulate(parameters))
+    return;
+
+  tabulate();
+  estimateError();
+
+  mValid = mMaxRelativeError <= tolerance;
+}
+
+TabulatedJetCorrector::~TabulatedJetCorrector() {
+
+}
+
+bool TabulatedJetCorrector::canTabulate(const std::vector<JetCorrectorParameters>& parameters) {
+  mEtaEdges.clear();
+
+  for (const JetCorrectorParameters& p: parameters) {
+    const JetCorrectorParameters::Definitions& definitions = p.definitions();
+
+    const std::vector<std::string> binVar = definitions.binVar();
+    if (binVar.size() != 1 || binVar[0] != "JetEta") {
+      std::cout << "Can't tabulate JEC level '" << definitions.level() << "': it's not only binned in JetEta" << std::endl;
+      return false;
+    }
+
+    const std::vector<std::string> parVar = definitions.parVar();
+    for (const std::string& var: parVar) {
+      if (var != "JetPt" && var != "Rho" && var != "JetA") {
+        std::cout << "Can't tabulate JEC level '" << definitions.level() << "': it depends on " << var << std::endl;
+        return false;
+      }
+    }
+
+    for (unsigned int i = 0; i < p.size(); i++) {
+      mEtaEdges.push_back(p.record(i).xMin(0));
+      mEtaEdges.push_back(p.record(i).xMax(0));
+    }
+  }
+
+  std::sort(mEtaEdges.begin(), mEtaEdges.end());
+  mEtaEdges.erase(std::unique(mEtaEdges.begin(), mEtaEdges.end()), mEtaEdges.end());
+
+  return mEtaEdges.size() > 1;
+}
+
+double TabulatedJetCorrector::node(const Axis& axis, double index) {
+  return axis.min + (axis.max - axis.min) * index / (axis.nodes - 1);
+}
+
+bool TabulatedJetCorrector::locate(const Axis& axis, double x, size_t& index, double& fraction) {
+  if (! (x >= axis.min && x <= axis.max))
+    return false;
+
+  double u = (x - axis.min) / (axis.max - axis.min) * (axis.nodes - 1);
+  index = std::min<size_t>(u, axis.nodes - 2);
+  fraction = u - index;
+
+  return true;
+}
+
+void TabulatedJetCorrector::tabulate() {
+  size_t nEta = mEtaEdges.size() - 1;
+  mTable.resize(nEta * mLogPt.nodes * mRho.nodes * mArea.nodes);
+
+  std::vector<float>::iterator it = mTable.begin();
+  for (size_t eta = 0; eta < nEta; eta++) {
+    float etaCenter = 0.5 * (mEtaEdges[eta] + mEtaEdges[eta + 1]);
+
+    for (size_t pt = 0; pt < mLogPt.nodes; pt++) {
+      float ptValue = std::exp(node(mLogPt, pt));
+
+      for (size_t rho = 0; rho < mRho.nodes; rho++) {
+        for (size_t area = 0; area < mArea.nodes; area++) {
+          *it++ = getExactCorrection(etaCenter, ptValue, node(mRho, rho), node(mArea, area));
+        }
+      }
+    }
+  }
+}
+
+void TabulatedJetCorrector::estimateError() {
+  // Cell centers are the farthest points from the nodes: check all of them. Only an estimate,
+  // since a kink of the exact correction may fall between two samples
+  mMaxRelativeError = 0;
+
+  size_t nEta = mEtaEdges.size() - 1;
+  for (size_t eta = 0; eta < nEta; eta++) {
+    float etaCenter = 0.5 * (mEtaEdges[eta] + mEtaEdges[eta + 1]);
+
+    for (size_t pt = 0; pt + 1 < mLogPt.nodes; pt++) {
+      float ptValue = std::exp(node(mLogPt, pt + 0.5));
+
+      for (size_t rho = 0; rho + 1 < mRho.nodes; rho++) {
+        for (size_t area = 0; area + 1 < mArea.nodes; area++) {
+          float rhoValue = node(mRho, rho + 0.5);
+          float areaValue = node(mArea, area + 0.5);
+
+          float exact = getExactCorrection(etaCenter, ptValue, rhoValue, areaValue);
+          float interpolated = 0;
+          if (exact == 0 || ! interpolate(etaCenter, ptValue, rhoValue, areaValue, interpolated))
+            continue;
+
+          mMaxRelativeError = std::max<double>(mMaxRelativeError, std::fabs(interpolated / exact - 1));
+        }
+      }
+    }
+  }
+}
+
+float TabulatedJetCorrector::getExactCorrection(float eta, float pt, float rho, float area) {
+  mCorrector->setJetEta(eta);
+  mCorrector->setJetPt(pt);
+  mCorrector->setRho(rho);
+  mCorrector->setJetA(area);
+
+  return mCorrector->getCorrection();
+}
+
+bool TabulatedJetCorrector::interpolate(float eta, float pt, float rho, float area, float& correction) const {
+  if (! (eta >= mEtaEdges.front() && eta < mEtaEdges.back()) || ! (pt > 0))
+    return false;
+
+  size_t etaBin = std::upper_bound(mEtaEdges.begin(), mEtaEdges.end(), eta) - mEtaEdges.begin() - 1;
+
+  size_t iPt, iRho, iArea;
+  double fPt, fRho, fArea;
+  if (! locate(mLogPt, std::log(pt), iPt, fPt) || ! locate(mRho, rho, iRho, fRho) || ! locate(mArea, area, iArea, fArea))
+    return false;
+
+  const size_t strideArea = 1;
+  const size_t strideRho = mArea.nodes;
+  const size_t stridePt = mRho.nodes * strideRho;
+  const float* cell = &mTable[etaBin * mLogPt.nodes * stridePt + iPt * stridePt + iRho * strideRho + iArea * strideArea];
+
+  // Trilinear interpolation
+  double value = 0;
+  for (size_t corner = 0; corner < 8; corner++) {
+    size_t dPt = (corner >> 2) & 1;
+    size_t dRho = (corner >> 1) & 1;
+    size_t dArea = corner & 1;
+
+    double weight = (dPt ? fPt : 1 - fPt) * (dRho ? fRho : 1 - fRho) * (dArea ? fArea : 1 - fArea);
+    value += weight * cell[dPt * stridePt + dRho * strideRho + dArea * strideArea];
+  }
+
+  correction = value;
+  return true;
+}
+
+float TabulatedJetCorrector::getCorrection(float eta, float pt, float rho, float area) {
+  float correction = 0;
+  if (mValid && interpolate(eta, pt, rho, area, correction))
+    return correction;
+
+  return getExactCorrection(eta, pt, rho, area);
+}
+
+void TabulatedJetCorrector::getCorrections(const Jet* jets, size_t n, float* corrections) {
+  for (size_t i = 0; i < n; i++) {
+    corrections[i] = getCorrection(jets[i].eta, jets[i].pt, jets[i].rho, jets[i].area);
+  }
+}
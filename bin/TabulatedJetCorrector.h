@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "CondFormats/JetMETObjects/interface/JetCorrectorParameters.h"
+
+class FactorizedJetCorrector;
+
+/**
+ * Combined jet energy correction, tabulated once on a (eta, pt, rho, area) grid.
+ *
+ * Corrections are piecewise constant in eta: the grid uses the eta bins of the payloads
+ * themselves, so there's no interpolation in eta. Inside an eta bin, the correction is
+ * interpolated linearly in log(pt), rho and area. Jets outside of the grid are corrected
+ * with the exact FactorizedJetCorrector.
+ *
+ * Only payloads binned in JetEta, with JetPt, Rho and JetA as parameters, can be tabulated
+ * (L1FastJet, L2Relative, L3Absolute, L2L3Residual). The interpolation is checked against the
+ * exact correction at the center of every cell, usually where it is the least accurate: if this
+ * estimate of the relative error goes above the tolerance, the grid is not valid. It is not a
+ * strict bound: the pt clamps of the payloads put kinks between the samples. Check isValid()
+ * before use.
+ */
+class TabulatedJetCorrector {
+  public:
+    struct Jet {
+      float eta;
+      float pt;
+      float rho;
+      float area;
+    };
+
+    struct Axis {
+      double min;
+      double max;
+      size_t nodes;
+    };
+
+    TabulatedJetCorrector(const std::vector<JetCorrectorParameters>& parameters, double tolerance);
+    ~TabulatedJetCorrector();
+
+    bool isValid() const {
+      return mValid;
+    }
+
+    // Estimated error: largest relative difference with the exact correction, over all cell centers
+    double maxRelativeError() const {
+      return mMaxRelativeError;
+    }
+
+    float getCorrection(float eta, float pt, float rho, float area);
+
+    // Correct n jets in one call
+    void getCorrections(const Jet* jets, size_t n, float* corrections);
+
+  private:
+    TabulatedJetCorrector(const TabulatedJetCorrector&);
+    TabulatedJetCorrector& operator=(const TabulatedJetCorrector&);
+
+    bool canTabulate(const std::vector<JetCorrectorParameters>& parameters);
+    void tabulate();
+    void estimateError();
+
+    float getExactCorrection(float eta, float pt, float rho, float area);
+    bool interpolate(float eta, float pt, float rho, float area, float& correction) const;
+
+    static bool locate(const Axis& axis, double x, size_t& index, double& fraction);
+    static double node(const Axis& axis, double index);
+
+    std::unique_ptr<FactorizedJetCorrector> mCorrector;
+
+    bool mValid;
+    double mMaxRelativeError;
+
+    std::vector<float> mEtaEdges;
+    Axis mLogPt;
+    Axis mRho;
+    Axis mArea;
+
+    // [eta bin][pt][rho][area]
+    std::vector<float> mTable;
+};
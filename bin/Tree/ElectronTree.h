@@ -15,18 +15,21 @@
 
 // Header file for the classes stored in the TTree if any.
 
-// Fixed size dimensions of array or collections stored in the TTree if any.
+// Arrays are sized by LeptonTree::Reserve.
 
 class ElectronTree: public LeptonTree {
   public :
 
     // Declaration of leaf types
-    Float_t         isolation[30];   //[n]
+    std::vector<Float_t> isolation;   //[n]
 
     // List of branches
     TBranch        *b_isolation;   //!
 
     virtual void     Init(TTree *tree);
+
+  protected:
+    virtual void     Reserve(size_t capacity);
 };
 
 void ElectronTree::Init(TTree *tree)
@@ -37,7 +40,13 @@ void ElectronTree::Init(TTree *tree)
 
   LeptonTree::Init(tree);
 
-  fChain->SetBranchAddress("isolation", &isolation, &b_isolation);
-
   LeptonTree::InitCache();
 }
+
+void ElectronTree::Reserve(size_t capacity)
+{
+  LeptonTree::Reserve(capacity);
+
+  isolation.resize(mCapacity);
+  fChain->SetBranchAddress("isolation", isolation.data(), &b_isolation);
+}
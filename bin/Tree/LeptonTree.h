@@ -11,9 +11,12 @@
 #include <TChain.h>
 #include <TFile.h>
 
+#include <algorithm>
+#include <vector>
+
 // Header file for the classes stored in the TTree if any.
 
-// Fixed size dimensions of array or collections stored in the TTree if any.
+// Arrays start small, and grow in GetEntry when an event has more leptons.
 
 class LeptonTree {
   public :
@@ -21,15 +24,15 @@ class LeptonTree {
     Int_t           fCurrent; //!current Tree number in a TChain
 
     // Declaration of leaf types
-    Int_t           n;
-    Int_t           id[30];   //[n]
-    Float_t         pt[30];   //[n]
-    Float_t         px[30];   //[n]
-    Float_t         py[30];   //[n]
-    Float_t         pz[30];   //[n]
-    Float_t         eta[30];   //[n]
-    Float_t         phi[30];   //[n]
-    Int_t           charge[30];   //[n]
+    Int_t                n;
+    std::vector<Int_t>   id;   //[n]
+    std::vector<Float_t> pt;   //[n]
+    std::vector<Float_t> px;   //[n]
+    std::vector<Float_t> py;   //[n]
+    std::vector<Float_t> pz;   //[n]
+    std::vector<Float_t> eta;   //[n]
+    std::vector<Float_t> phi;   //[n]
+    std::vector<Int_t>   charge;   //[n]
 
     // List of branches
     TBranch        *b_n;   //!
@@ -48,9 +51,15 @@ class LeptonTree {
 
     virtual void     Init(TTree *tree);
     virtual void     InitCache();
+
+  protected:
+    // Resize the arrays and bind them again. Derived trees add their own arrays
+    virtual void     Reserve(size_t capacity);
+
+    size_t           mCapacity;
 };
 
-LeptonTree::LeptonTree() : fChain(0) 
+LeptonTree::LeptonTree() : fChain(0), mCapacity(0) 
 {
 }
 
@@ -68,6 +77,15 @@ Int_t LeptonTree::GetEntry(Long64_t entry)
   if (!fChain)
     return 0;
 
+  // The size is read first, so that the arrays can grow before they're filled
+  Long64_t localEntry = fChain->LoadTree(entry);
+  if (localEntry < 0)
+    return 0;
+
+  b_n->GetEntry(localEntry);
+  if (n > 0 && static_cast<size_t>(n) > mCapacity)
+    Reserve(std::max(2 * mCapacity, static_cast<size_t>(n)));
+
   return fChain->GetEntry(entry);
 }
 
@@ -81,14 +99,30 @@ void LeptonTree::Init(TTree *tree)
   fChain->SetMakeClass(1);
 
   fChain->SetBranchAddress("n", &n, &b_n);
-  fChain->SetBranchAddress("id", &id, &b_id);
-  fChain->SetBranchAddress("pt", &pt, &b_pt);
-  fChain->SetBranchAddress("px", &px, &b_px);
-  fChain->SetBranchAddress("py", &py, &b_py);
-  fChain->SetBranchAddress("pz", &pz, &b_pz);
-  fChain->SetBranchAddress("eta", &eta, &b_eta);
-  fChain->SetBranchAddress("phi", &phi, &b_phi);
-  fChain->SetBranchAddress("charge", &charge, &b_charge);
+  Reserve(8);
+}
+
+void LeptonTree::Reserve(size_t capacity)
+{
+  mCapacity = capacity;
+
+  id.resize(mCapacity);
+  pt.resize(mCapacity);
+  px.resize(mCapacity);
+  py.resize(mCapacity);
+  pz.resize(mCapacity);
+  eta.resize(mCapacity);
+  phi.resize(mCapacity);
+  charge.resize(mCapacity);
+
+  fChain->SetBranchAddress("id", id.data(), &b_id);
+  fChain->SetBranchAddress("pt", pt.data(), &b_pt);
+  fChain->SetBranchAddress("px", px.data(), &b_px);
+  fChain->SetBranchAddress("py", py.data(), &b_py);
+  fChain->SetBranchAddress("pz", pz.data(), &b_pz);
+  fChain->SetBranchAddress("eta", eta.data(), &b_eta);
+  fChain->SetBranchAddress("phi", phi.data(), &b_phi);
+  fChain->SetBranchAddress("charge", charge.data(), &b_charge);
 }
 
 void LeptonTree::InitCache() {
@@ -13,16 +13,19 @@
 
 // Header file for the classes stored in the TTree if any.
 
-// Fixed size dimensions of array or collections stored in the TTree if any.
+// Arrays are sized by LeptonTree::Reserve.
 
 class MuonTree: public LeptonTree {
   public :
 
     // Declaration of leaf types
-    Float_t         relative_isolation[30];   //[n]
-    Float_t         delta_beta_relative_isolation[30];   //[n]
+    std::vector<Float_t> relative_isolation;   //[n]
+    std::vector<Float_t> delta_beta_relative_isolation;   //[n]
 
     virtual void     Init(TTree *tree);
+
+  protected:
+    virtual void     Reserve(size_t capacity);
 };
 
 void MuonTree::Init(TTree *tree)
@@ -33,8 +36,16 @@ void MuonTree::Init(TTree *tree)
 
   LeptonTree::Init(tree);
 
-  fChain->SetBranchAddress("relative_isolation", &relative_isolation, NULL);
-  fChain->SetBranchAddress("delta_beta_relative_isolation", &relative_isolation, NULL);
-
   LeptonTree::InitCache();
 }
+
+void MuonTree::Reserve(size_t capacity)
+{
+  LeptonTree::Reserve(capacity);
+
+  relative_isolation.resize(mCapacity);
+  delta_beta_relative_isolation.resize(mCapacity);
+
+  fChain->SetBranchAddress("relative_isolation", relative_isolation.data(), NULL);
+  fChain->SetBranchAddress("delta_beta_relative_isolation", delta_beta_relative_isolation.data(), NULL);
+}
@@ -0,0 +1,626 @@
+#include <TFile.h>
+#include <TROOT.h>
+#include <TDirectory.h>
+#include <TKey.h>
+#include <TH1.h>
+#include <TGraph.h>
+#include <TParameter.h>
+#include <TTree.h>
+#include <TLeaf.h>
+#include <TBranchElement.h>
+#include <TClass.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <boost/regex.hpp>
+
+#include "tclap/CmdLine.h"
+
+#include "ElidedHistograms.h"
+
+#define RESET_COLOR "\033[m"
+#define MAKE_RED "\033[31m"
+#define MAKE_BLUE "\033[34m"
+
+// Compare two gammaJetFinalizer output files object by object: histograms bin by bin (content
+// and error), TParameters, graphs point by point, and trees entry by entry (STL vector branches
+// element by element). Used by analysis/regression/runRegression.sh to check that a change does
+// not alter the results.
+//
+// With --tree, only one tree of each file is compared, entries being matched by their key (run,
+// lumi block and event number by default): used to check that the events copied by the finalizer
+// to its output trees are the same as in its input.
+
+struct Options {
+  double absTolerance;
+  double relTolerance;
+  double parameterScale;
+  bool compareTrees;
+  int maxDiffs;
+  std::vector<boost::regex> ignore;
+};
+
+struct Summary {
+  Summary():
+    compared(0), different(0), missing(0), unexpected(0), skipped(0) {}
+
+  int compared;
+  int different;
+  int missing;
+  int unexpected;
+  int skipped;
+};
+
+/**
+ * Differences found in one object. Only the first maxDiffs are printed, but the largest one is
+ * always reported.
+ */
+class ObjectDiff {
+  public:
+    ObjectDiff(const Options& options):
+      mOptions(options), mCount(0), mLargest(-1) {}
+
+    bool equal(double reference, double test) const {
+      if (std::isnan(reference) || std::isnan(test))
+        return std::isnan(reference) && std::isnan(test);
+
+      return std::abs(reference - test) <= mOptions.absTolerance + mOptions.relTolerance * std::max(std::abs(reference), std::abs(test));
+    }
+
+    void compare(const std::string& what, double reference, double test) {
+      if (equal(reference, test))
+        return;
+
+      double delta = std::abs(reference - test);
+      if (delta > mLargest || std::isnan(delta)) {
+        mLargest = delta;
+        mLargestDiff = format(what, reference, test);
+      }
+
+      if (mCount < mOptions.maxDiffs)
+        mDiffs.push_back(format(what, reference, test));
+      mCount++;
+    }
+
+    void structure(const std::string& message) {
+      if (mCount < mOptions.maxDiffs)
+        mDiffs.push_back(message);
+      mCount++;
+    }
+
+    bool empty() const {
+      return mCount == 0;
+    }
+
+    int count() const {
+      return mCount;
+    }
+
+    void print(const std::string& path) const {
+      std::cout << MAKE_RED << path << ": " << mCount << " difference(s)" << RESET_COLOR << std::endl;
+      for (const std::string& diff: mDiffs) {
+        std::cout << "    " << diff << std::endl;
+      }
+
+      if (mCount > static_cast<int>(mDiffs.size()))
+        std::cout << "    ..." << ((mLargestDiff.empty()) ? "" : " (largest: " + mLargestDiff + ")") << std::endl;
+    }
+
+  private:
+    std::string format(const std::string& what, double reference, double test) const {
+      std::stringstream ss;
+      ss << std::setprecision(9) << what << ": " << reference << " -> " << test;
+      if (reference != 0)
+        ss << " (" << std::showpos << std::setprecision(3) << 100. * (test - reference) / std::abs(reference) << "%)";
+
+      return ss.str();
+    }
+
+    const Options& mOptions;
+    int mCount;
+    double mLargest;
+    std::string mLargestDiff;
+    std::vector<std::string> mDiffs;
+};
+
+std::string binName(const TH1* h, int cell) {
+  int x, y, z;
+  h->GetBinXYZ(cell, x, y, z);
+
+  std::stringstream ss;
+  ss << "bin " << x;
+  if (h->GetDimension() > 1)
+    ss << "," << y;
+  if (h->GetDimension() > 2)
+    ss << "," << z;
+
+  return ss.str();
+}
+
+void compareAxis(const char* name, const TAxis* reference, const TAxis* test, ObjectDiff& diff) {
+  if (reference->GetNbins() != test->GetNbins()) {
+    std::stringstream ss;
+    ss << name << " axis: " << reference->GetNbins() << " -> " << test->GetNbins() << " bins";
+    diff.structure(ss.str());
+    return;
+  }
+
+  for (int i = 1; i <= reference->GetNbins() + 1; i++) {
+    diff.compare(std::string(name) + " axis edge " + std::to_string(i), reference->GetBinLowEdge(i), test->GetBinLowEdge(i));
+  }
+}
+
+void compareHistograms(const TH1* reference, const TH1* test, ObjectDiff& diff) {
+  if (reference->GetDimension() != test->GetDimension()) {
+    diff.structure("dimension: " + std::to_string(reference->GetDimension()) + " -> " + std::to_string(test->GetDimension()));
+    return;
+  }
+
+  compareAxis("x", reference->GetXaxis(), test->GetXaxis(), diff);
+  if (reference->GetDimension() > 1)
+    compareAxis("y", reference->GetYaxis(), test->GetYaxis(), diff);
+  if (reference->GetDimension() > 2)
+    compareAxis("z", reference->GetZaxis(), test->GetZaxis(), diff);
+
+  if (! diff.empty())
+    return;
+
+  diff.compare("entries", reference->GetEntries(), test->GetEntries());
+
+  // Under / overflows included
+  for (int cell = 0; cell < reference->GetNcells(); cell++) {
+    diff.compare(binName(reference, cell) + " content", reference->GetBinContent(cell), test->GetBinContent(cell));
+    diff.compare(binName(reference, cell) + " error", reference->GetBinError(cell), test->GetBinError(cell));
+  }
+}
+
+void compareGraphs(const TGraph* reference, const TGraph* test, ObjectDiff& diff) {
+  if (reference->GetN() != test->GetN()) {
+    diff.structure("points: " + std::to_string(reference->GetN()) + " -> " + std::to_string(test->GetN()));
+    return;
+  }
+
+  for (int i = 0; i < reference->GetN(); i++) {
+    std::string point = "point " + std::to_string(i);
+    diff.compare(point + " x", reference->GetX()[i], test->GetX()[i]);
+    diff.compare(point + " y", reference->GetY()[i], test->GetY()[i]);
+    diff.compare(point + " x error", reference->GetErrorX(i), test->GetErrorX(i));
+    diff.compare(point + " y error", reference->GetErrorY(i), test->GetErrorY(i));
+  }
+}
+
+template<typename T>
+bool compareParameter(TObject* reference, TObject* test, double scale, ObjectDiff& diff) {
+  TParameter<T>* r = dynamic_cast<TParameter<T>*>(reference);
+  TParameter<T>* t = dynamic_cast<TParameter<T>*>(test);
+  if (! r || ! t)
+    return false;
+
+  diff.compare("value", r->GetVal(), t->GetVal() / scale);
+  return true;
+}
+
+void compareElement(const std::string& what, double reference, double test, ObjectDiff& diff) {
+  diff.compare(what, reference, test);
+}
+
+void compareElement(const std::string& what, const std::string& reference, const std::string& test, ObjectDiff& diff) {
+  if (reference != test)
+    diff.structure(what + ": '" + reference + "' -> '" + test + "'");
+}
+
+template<typename T>
+bool compareVectors(TClass* type, const std::string& what, const void* reference, const void* test, ObjectDiff& diff) {
+  if (type != TClass::GetClass(typeid(std::vector<T>)))
+    return false;
+
+  const std::vector<T>& r = *static_cast<const std::vector<T>*>(reference);
+  const std::vector<T>& t = *static_cast<const std::vector<T>*>(test);
+  if (r.size() != t.size()) {
+    diff.structure(what + " size: " + std::to_string(r.size()) + " -> " + std::to_string(t.size()));
+    return true;
+  }
+
+  for (size_t i = 0; i < r.size(); i++) {
+    compareElement(what + "[" + std::to_string(i) + "]", r[i], t[i], diff);
+  }
+
+  return true;
+}
+
+// Object branches (STL vectors, like the trigger names and results) are read as objects:
+// TLeaf::GetValue() means nothing for them. Returns false for unsupported types
+bool compareObjects(TClass* type, const std::string& what, const void* reference, const void* test, ObjectDiff& diff) {
+  if (reference && test) {
+    return compareVectors<std::string>(type, what, reference, test, diff) ||
+      compareVectors<bool>(type, what, reference, test, diff) ||
+      compareVectors<int>(type, what, reference, test, diff) ||
+      compareVectors<unsigned int>(type, what, reference, test, diff) ||
+      compareVectors<float>(type, what, reference, test, diff) ||
+      compareVectors<double>(type, what, reference, test, diff);
+  }
+
+  if (reference != test)
+    diff.structure(what + ": not read");
+
+  return true;
+}
+
+bool isSupportedObject(TClass* type) {
+  static const std::vector<TClass*> types = {
+    TClass::GetClass(typeid(std::vector<std::string>)), TClass::GetClass(typeid(std::vector<bool>)),
+    TClass::GetClass(typeid(std::vector<int>)), TClass::GetClass(typeid(std::vector<unsigned int>)),
+    TClass::GetClass(typeid(std::vector<float>)), TClass::GetClass(typeid(std::vector<double>))
+  };
+
+  return type && std::find(types.begin(), types.end(), type) != types.end();
+}
+
+bool isIgnored(const std::string& path, const Options& options) {
+  for (const boost::regex& r: options.ignore) {
+    if (boost::regex_search(path, r))
+      return true;
+  }
+
+  return false;
+}
+
+struct TreeColumns {
+  std::vector<std::pair<TLeaf*, TLeaf*>> leaves;
+  std::vector<std::pair<TBranchElement*, TBranchElement*>> objects;
+};
+
+// Columns of both trees, matched by name, without the ignored ones ('path/branch'). Unsupported
+// object branches are reported, and skipped
+TreeColumns getColumns(TTree* reference, TTree* test, const std::string& path, const Options& options, ObjectDiff& diff) {
+  TreeColumns columns;
+
+  TIter next(reference->GetListOfLeaves());
+  while (TLeaf* leaf = static_cast<TLeaf*>(next())) {
+    if (leaf->GetBranch()->InheritsFrom(TBranchElement::Class()) || isIgnored(path + "/" + leaf->GetBranch()->GetName(), options))
+      continue;
+
+    TLeaf* other = test->GetLeaf(leaf->GetBranch()->GetName(), leaf->GetName());
+    if (! other) {
+      diff.structure(std::string("missing leaf ") + leaf->GetBranch()->GetName() + "." + leaf->GetName());
+      continue;
+    }
+
+    columns.leaves.push_back(std::make_pair(leaf, other));
+  }
+
+  TIter nextTest(test->GetListOfLeaves());
+  while (TLeaf* leaf = static_cast<TLeaf*>(nextTest())) {
+    if (! isIgnored(path + "/" + leaf->GetBranch()->GetName(), options) && ! reference->GetLeaf(leaf->GetBranch()->GetName(), leaf->GetName()))
+      diff.structure(std::string("unexpected leaf ") + leaf->GetBranch()->GetName() + "." + leaf->GetName());
+  }
+
+  TIter nextBranch(reference->GetListOfBranches());
+  while (TBranch* branch = static_cast<TBranch*>(nextBranch())) {
+    if (! branch->InheritsFrom(TBranchElement::Class()) || isIgnored(path + "/" + branch->GetName(), options))
+      continue;
+
+    TBranchElement* r = static_cast<TBranchElement*>(branch);
+    TBranchElement* t = dynamic_cast<TBranchElement*>(test->GetBranch(branch->GetName()));
+    if (! t) {
+      diff.structure(std::string("missing branch ") + branch->GetName());
+      continue;
+    }
+
+    // Split objects would need to be compared member by member
+    TClass* type = TClass::GetClass(r->GetClassName());
+    if (! isSupportedObject(type) || r->GetListOfBranches()->GetEntriesFast() > 0 || strcmp(r->GetClassName(), t->GetClassName()) != 0) {
+      std::cout << MAKE_RED << "Warning: " << path << ": branch " << branch->GetName() << " (" << r->GetClassName() << ") is not supported, not compared" << RESET_COLOR << std::endl;
+      continue;
+    }
+
+    columns.objects.push_back(std::make_pair(r, t));
+  }
+
+  return columns;
+}
+
+void compareEntries(TTree* reference, Long64_t referenceEntry, TTree* test, Long64_t testEntry, const TreeColumns& columns, const std::string& what, ObjectDiff& diff) {
+  reference->GetEntry(referenceEntry);
+  test->GetEntry(testEntry);
+
+  for (auto& pair: columns.leaves) {
+    TLeaf* r = pair.first;
+    TLeaf* t = pair.second;
+    std::string name = what + " " + r->GetBranch()->GetName() + "." + r->GetName();
+
+    int length = r->GetLen();
+    if (length != t->GetLen()) {
+      diff.structure(name + " length: " + std::to_string(length) + " -> " + std::to_string(t->GetLen()));
+      continue;
+    }
+
+    for (int i = 0; i < length; i++) {
+      diff.compare((length > 1) ? name + "[" + std::to_string(i) + "]" : name, r->GetValue(i), t->GetValue(i));
+    }
+  }
+
+  for (auto& pair: columns.objects) {
+    compareObjects(TClass::GetClass(pair.first->GetClassName()), what + " " + pair.first->GetName(), pair.first->GetObject(), pair.second->GetObject(), diff);
+  }
+}
+
+void compareTrees(TTree* reference, TTree* test, const std::string& path, const Options& options, ObjectDiff& diff) {
+  if (reference->GetEntries() != test->GetEntries()) {
+    diff.structure("entries: " + std::to_string(reference->GetEntries()) + " -> " + std::to_string(test->GetEntries()));
+    return;
+  }
+
+  TreeColumns columns = getColumns(reference, test, path, options, diff);
+
+  // Trees can be large: stop reading once enough differences are found
+  for (Long64_t entry = 0; entry < reference->GetEntries(); entry++) {
+    compareEntries(reference, entry, test, entry, columns, "entry " + std::to_string(entry), diff);
+
+    if (diff.count() >= options.maxDiffs)
+      break;
+  }
+}
+
+// Values of the key leaves for one entry, reading only their branches
+bool readKey(const std::vector<TLeaf*>& leaves, Long64_t entry, std::vector<Long64_t>& key) {
+  key.clear();
+  for (TLeaf* leaf: leaves) {
+    if (leaf->GetBranch()->GetEntry(entry) <= 0)
+      return false;
+
+    key.push_back(static_cast<Long64_t>(leaf->GetValue()));
+  }
+
+  return true;
+}
+
+std::string formatKey(const std::vector<std::string>& names, const std::vector<Long64_t>& key) {
+  std::stringstream ss;
+  for (size_t i = 0; i < key.size(); i++) {
+    ss << ((i == 0) ? "" : ", ") << names[i] << " " << key[i];
+  }
+
+  return ss.str();
+}
+
+/**
+ * Compare each entry of 'test' with the entry of 'reference' which has the same key: 'test' may
+ * hold only some of the entries of 'reference', in any order.
+ */
+void compareKeyedTrees(TTree* reference, TTree* test, const std::string& path, const std::vector<std::string>& keyNames, const Options& options, ObjectDiff& diff) {
+  std::vector<TLeaf*> referenceKeys;
+  std::vector<TLeaf*> testKeys;
+  for (const std::string& name: keyNames) {
+    TLeaf* r = reference->GetLeaf(name.c_str());
+    TLeaf* t = test->GetLeaf(name.c_str());
+    if (! r || ! t) {
+      diff.structure("no key leaf " + name);
+      return;
+    }
+
+    referenceKeys.push_back(r);
+    testKeys.push_back(t);
+  }
+
+  std::map<std::vector<Long64_t>, Long64_t> referenceEntries;
+  std::vector<Long64_t> key;
+  for (Long64_t entry = 0; entry < reference->GetEntries(); entry++) {
+    if (! readKey(referenceKeys, entry, key)) {
+      diff.structure("can't read reference entry " + std::to_string(entry));
+      return;
+    }
+
+    if (! referenceEntries.insert(std::make_pair(key, entry)).second)
+      diff.structure("duplicated key in reference: " + formatKey(keyNames, key));
+  }
+
+  TreeColumns columns = getColumns(reference, test, path, options, diff);
+
+  for (Long64_t entry = 0; entry < test->GetEntries(); entry++) {
+    if (! readKey(testKeys, entry, key)) {
+      diff.structure("can't read entry " + std::to_string(entry));
+      return;
+    }
+
+    auto it = referenceEntries.find(key);
+    if (it == referenceEntries.end()) {
+      diff.structure("entry " + std::to_string(entry) + " not in reference: " + formatKey(keyNames, key));
+    } else {
+      compareEntries(reference, it->second, test, entry, columns, "entry " + std::to_string(entry) + " (" + formatKey(keyNames, key) + ")", diff);
+    }
+
+    if (diff.count() >= options.maxDiffs)
+      break;
+  }
+}
+
+// Names of the objects of a directory, without the older cycles. Histograms left out by
+// gammaJetFinalizer --skip-empty are only in memory, and the manifest itself is not compared
+std::set<std::string> getNames(TDirectory* dir) {
+  std::set<std::string> names;
+
+  TIter next(dir->GetListOfKeys());
+  while (TKey* key = static_cast<TKey*>(next())) {
+    names.insert(key->GetName());
+  }
+
+  TIter nextObject(dir->GetList());
+  while (TObject* object = nextObject()) {
+    if (object->InheritsFrom(TH1::Class()))
+      names.insert(object->GetName());
+  }
+
+  if (dir == dir->GetFile())
+    names.erase(ElidedHistograms::treeName());
+
+  return names;
+}
+
+void compareDirectories(TDirectory* reference, TDirectory* test, const std::string& path, const Options& options, Summary& summary) {
+  std::set<std::string> referenceNames = getNames(reference);
+  std::set<std::string> testNames = getNames(test);
+
+  for (const std::string& name: testNames) {
+    std::string objectPath = path + name;
+    if (referenceNames.count(name) == 0 && ! isIgnored(objectPath, options)) {
+      std::cout << MAKE_RED << objectPath << ": not in reference" << RESET_COLOR << std::endl;
+      summary.unexpected++;
+    }
+  }
+
+  for (const std::string& name: referenceNames) {
+    std::string objectPath = path + name;
+    if (isIgnored(objectPath, options)) {
+      summary.skipped++;
+      continue;
+    }
+
+    if (testNames.count(name) == 0) {
+      std::cout << MAKE_RED << objectPath << ": missing" << RESET_COLOR << std::endl;
+      summary.missing++;
+      continue;
+    }
+
+    std::unique_ptr<TObject> r(reference->Get(name.c_str()));
+    std::unique_ptr<TObject> t(test->Get(name.c_str()));
+
+    if (r->InheritsFrom(TDirectory::Class()) && t->InheritsFrom(TDirectory::Class())) {
+      compareDirectories(static_cast<TDirectory*>(r.get()), static_cast<TDirectory*>(t.get()), objectPath + "/", options, summary);
+      // Directories are owned by their file
+      r.release();
+      t.release();
+      continue;
+    }
+
+    ObjectDiff diff(options);
+    summary.compared++;
+
+    if (strcmp(r->ClassName(), t->ClassName()) != 0) {
+      diff.structure(std::string("class: ") + r->ClassName() + " -> " + t->ClassName());
+    } else if (r->InheritsFrom(TH1::Class())) {
+      compareHistograms(static_cast<TH1*>(r.get()), static_cast<TH1*>(t.get()), diff);
+    } else if (r->InheritsFrom(TGraph::Class())) {
+      compareGraphs(static_cast<TGraph*>(r.get()), static_cast<TGraph*>(t.get()), diff);
+    } else if (r->InheritsFrom(TTree::Class())) {
+      if (options.compareTrees) {
+        compareTrees(static_cast<TTree*>(r.get()), static_cast<TTree*>(t.get()), objectPath, options, diff);
+      } else {
+        summary.compared--;
+        summary.skipped++;
+      }
+    } else if (! compareParameter<double>(r.get(), t.get(), options.parameterScale, diff) &&
+        ! compareParameter<float>(r.get(), t.get(), options.parameterScale, diff) &&
+        ! compareParameter<int>(r.get(), t.get(), options.parameterScale, diff) &&
+        ! compareParameter<Long64_t>(r.get(), t.get(), options.parameterScale, diff)) {
+      std::cout << MAKE_RED << "Warning: " << objectPath << ": don't know how to compare a " << r->ClassName() << RESET_COLOR << std::endl;
+      summary.compared--;
+      summary.skipped++;
+    }
+
+    if (! diff.empty()) {
+      diff.print(objectPath);
+      summary.different++;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+
+  try {
+    TCLAP::CmdLine cmd("Compare two gammaJetFinalizer output files, object by object", ' ', "0.1");
+
+    TCLAP::UnlabeledValueArg<std::string> referenceArg("reference", "Reference file", true, "", "string", cmd);
+    TCLAP::UnlabeledValueArg<std::string> testArg("test", "File to check", true, "", "string", cmd);
+
+    TCLAP::ValueArg<double> absToleranceArg("", "abs", "Absolute tolerance on each value (default: 1e-6)", false, 1e-6, "double", cmd);
+    TCLAP::ValueArg<double> relToleranceArg("", "rel", "Relative tolerance on each value (default: 1e-5)", false, 1e-5, "double", cmd);
+    TCLAP::SwitchArg exactArg("", "exact", "No tolerance: values must be identical", cmd);
+    TCLAP::ValueArg<double> parameterScaleArg("", "parameter-scale", "Divide the TParameters of the file to check by this value. hadd sums them, so use the number of jobs when checking merged outputs (default: 1)", false, 1, "double", cmd);
+    TCLAP::MultiArg<std::string> ignoreArg("", "ignore", "Don't compare objects whose path matches this regex", false, "regex", cmd);
+    TCLAP::SwitchArg noTreesArg("", "no-trees", "Don't compare trees", cmd);
+    TCLAP::ValueArg<int> maxDiffsArg("", "max-diffs", "Number of differences printed for each object (default: 5)", false, 5, "int", cmd);
+    TCLAP::ValueArg<std::string> treeArg("", "tree", "Only compare the tree 'reference path:test path' of each file, entries being matched by key (e.g. gammaJet/analysis:misc)", false, "", "string", cmd);
+    TCLAP::ValueArg<std::string> keyArg("", "key", "Comma separated leaves identifying an entry, with --tree (default: run,lumi_block,event)", false, "run,lumi_block,event", "string", cmd);
+
+    cmd.parse(argc, argv);
+
+    Options options;
+    options.absTolerance = (exactArg.getValue()) ? 0 : absToleranceArg.getValue();
+    options.relTolerance = (exactArg.getValue()) ? 0 : relToleranceArg.getValue();
+    options.parameterScale = parameterScaleArg.getValue();
+    options.compareTrees = ! noTreesArg.getValue();
+    options.maxDiffs = maxDiffsArg.getValue();
+    for (const std::string& ignore: ignoreArg.getValue()) {
+      options.ignore.push_back(boost::regex(ignore));
+    }
+
+    TH1::AddDirectory(false);
+
+    std::unique_ptr<TFile> reference(TFile::Open(referenceArg.getValue().c_str()));
+    std::unique_ptr<TFile> test(TFile::Open(testArg.getValue().c_str()));
+    if (! reference || reference->IsZombie() || ! test || test->IsZombie()) {
+      std::cerr << MAKE_RED << "Error: can't open '" << referenceArg.getValue() << "' or '" << testArg.getValue() << "'" << RESET_COLOR << std::endl;
+      return 2;
+    }
+
+    ElidedHistograms::restore(reference.get());
+    ElidedHistograms::restore(test.get());
+
+    Summary summary;
+    if (treeArg.isSet()) {
+      std::string trees = treeArg.getValue();
+      size_t colon = trees.find(':');
+      std::string referencePath = trees.substr(0, colon);
+      std::string testPath = (colon == std::string::npos) ? referencePath : trees.substr(colon + 1);
+
+      std::vector<std::string> keyNames;
+      std::stringstream keys(keyArg.getValue());
+      std::string keyName;
+      while (std::getline(keys, keyName, ',')) {
+        keyNames.push_back(keyName);
+      }
+
+      TTree* r = dynamic_cast<TTree*>(reference->Get(referencePath.c_str()));
+      TTree* t = dynamic_cast<TTree*>(test->Get(testPath.c_str()));
+      if (! r || ! t) {
+        std::cerr << MAKE_RED << "Error: no tree '" << referencePath << "' in '" << referenceArg.getValue() << "' or '" << testPath << "' in '" << testArg.getValue() << "'" << RESET_COLOR << std::endl;
+        return 2;
+      }
+
+      ObjectDiff diff(options);
+      compareKeyedTrees(r, t, testPath, keyNames, options, diff);
+      summary.compared++;
+
+      if (! diff.empty()) {
+        diff.print(testPath);
+        summary.different++;
+      }
+    } else {
+      compareDirectories(reference.get(), test.get(), "", options, summary);
+    }
+
+    bool identical = summary.different == 0 && summary.missing == 0 && summary.unexpected == 0;
+
+    std::cout << ((identical) ? MAKE_BLUE : MAKE_RED) << testArg.getValue() << ": " << summary.compared << " objects compared, "
+      << summary.different << " different, " << summary.missing << " missing, " << summary.unexpected << " not in reference, "
+      << summary.skipped << " skipped" << RESET_COLOR << std::endl;
+
+    return (identical) ? 0 : 1;
+
+  } catch (TCLAP::ArgException& e) {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 2;
+  }
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "tclap/CmdLine.h"
+
+#include "triggers.h"
+#include "JECReader.h"
+
+#define RESET_COLOR "\033[m"
+#define MAKE_RED "\033[31m"
+#define MAKE_BLUE "\033[34m"
+
+// Validate the finalizer configuration files, and write their compiled version next to them.
+// gammaJetFinalizer uses a compiled file only if it's up to date with its source.
+
+template<typename T>
+bool compileTriggers(const std::string& xmlFile) {
+  if (! boost::filesystem::exists(xmlFile)) {
+    std::cout << "'" << xmlFile << "' not found, skipping." << std::endl;
+    return true;
+  }
+
+  T triggers(xmlFile);
+  if (! triggers.compile()) {
+    std::cerr << MAKE_RED << "Failed to compile '" << xmlFile << "'" << RESET_COLOR << std::endl;
+    return false;
+  }
+
+  std::cout << "'" << xmlFile << "' compiled to '" << MAKE_BLUE << compiledFileName(xmlFile) << RESET_COLOR << "'" << std::endl;
+  return true;
+}
+
+int main(int argc, char** argv) {
+
+  try {
+    TCLAP::CmdLine cmd("Compile the configuration files of gammaJetFinalizer", ' ', "0.1");
+
+    TCLAP::MultiArg<std::string> jecAlgoArg("", "jec-algo", "Compile external JEC payloads for this algorithm (for example AK5PFchs)", false, "string", cmd);
+    TCLAP::SwitchArg mcArg("", "mc", "Compile MC JEC payloads", cmd);
+
+    cmd.parse(argc, argv);
+
+    bool ok = compileTriggers<Triggers>("triggers.xml");
+    ok &= compileTriggers<MCTriggers>("triggers_mc.xml");
+
+    const std::string payloadsFile = "jec_payloads.xml";
+    for (const std::string& jecAlgo: jecAlgoArg.getValue()) {
+      if (! compileJECPayloads(payloadsFile, jecAlgo, mcArg.getValue())) {
+        std::cerr << MAKE_RED << "Failed to compile JEC payloads for '" << jecAlgo << "'" << RESET_COLOR << std::endl;
+        ok = false;
+        continue;
+      }
+
+      std::cout << "'" << payloadsFile << "' compiled to '" << MAKE_BLUE << getCompiledJECFileName(payloadsFile, jecAlgo, mcArg.getValue()) << RESET_COLOR << "'" << std::endl;
+    }
+
+    return (ok) ? 0 : 1;
+
+  } catch (TCLAP::ArgException &e) {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 1;
+  }
+}
@@ -7,6 +7,8 @@
 #include <TH2D.h>
 
 #include <fstream>
+#include <limits>
+#include <set>
 #include <sstream>
 
 #include <signal.h>
@@ -37,6 +39,12 @@
 #include "gammaJetFinalizer.h"
 #include "PUReweighter.h"
 #include "JECReader.h"
+#include "TabulatedJetCorrector.h"
+#include "JECFriends.h"
+#include "AsyncTreeWriter.h"
+#include "CompactTree.h"
+#include "Checkpoint.h"
+#include "ElidedHistograms.h"
 
 #include <boost/regex.hpp>
 
@@ -45,14 +53,9 @@
 #define MAKE_BLUE "\033[34m"
 
 #define ADD_TREES true
-#define PROFILE false
 
 #define DELTAPHI_CUT (2.8)
 
-#define TRIGGER_OK                    0
-#define TRIGGER_NOT_FOUND            -1
-#define TRIGGER_FOUND_BUT_PT_OUT     -2
-
 bool EXIT = false;
 
 GammaJetFinalizer::GammaJetFinalizer():
@@ -63,6 +66,16 @@ GammaJetFinalizer::GammaJetFinalizer():
   mNoPUReweighting = false;
   mIsBatchJob = false;
   mUseExternalJECCorrecion = false;
+  mUseTabulatedJEC = false;
+  mTabulatedJECTolerance = 1e-3;
+  mSyncTrees = false;
+  mCompactTrees = false;
+  mCompactFloatBits = 23;
+  mSkipEmptyHistograms = false;
+  mCheckpointEvents = 0;
+  mCheckpointInterval = 0;
+  mResume = false;
+  mUseHardwareCounters = false;
 }
 
 GammaJetFinalizer::~GammaJetFinalizer() {
@@ -108,14 +121,14 @@ void GammaJetFinalizer::runAnalysis() {
 
   if (mIsMC) {
     std::cout << "Parsing triggers_mc.xml ..." << std::endl;
-    if (! mMCTriggers->parse()) {
+    if (! mMCTriggers->load()) {
       std::cerr << "Failed to parse triggers_mc.xml..." << std::endl;
       return;
     }
     std::cout << "done." << std::endl;
   } else {
     std::cout << "Parsing triggers.xml ..." << std::endl;
-    if (! mTriggers->parse()) {
+    if (! mTriggers->load()) {
       std::cerr << "Failed to parse triggers.xml..." << std::endl;
       return;
     }
@@ -236,63 +249,143 @@ void GammaJetFinalizer::runAnalysis() {
   std::string outputFile = (!mIsBatchJob)
     ? TString::Format("PhotonJet_%s_%s.root", mDatasetName.c_str(), postFix.c_str()).Data()
     : TString::Format("PhotonJet_%s_%s_part%02d.root", mDatasetName.c_str(), postFix.c_str(), mCurrentJob).Data();
+
+  // Periodic checkpoints, so that an interrupted run can be resumed
+  Checkpoint checkpoint(outputFile);
+  bool useCheckpoints = mResume || mCheckpointEvents > 0 || mCheckpointInterval > 0;
+  if (mResume) {
+    if (! checkpoint.prepareResume())
+      return;
+  } else if (useCheckpoints && checkpoint.exists()) {
+    std::cout << MAKE_RED << "Warning: checkpoint '" << checkpoint.fileName() << "' will be overwritten. Use --resume to continue the previous run." << RESET_COLOR << std::endl;
+  }
+
   fwlite::TFileService fs(outputFile);
 
+  // Owns the histograms left out of the output: must be destroyed after the GaussianProfiles
+  ElidedHistograms elidedHistograms;
+
 #if ADD_TREES
-  TTree* photonTree = NULL;
-  cloneTree(photon.fChain, photonTree);
+  // Output trees are filled by a dedicated thread, unless --sync-trees is used
+  AsyncTreeWriter treeWriter;
+
+  if (mCompactTrees) {
+    std::map<std::string, TTree*> inputs;
+    inputs["analysis"] = analysis.fChain;
+    inputs["photon"] = photon.fChain;
+    inputs["first_jet"] = firstJet.fChain;
+    inputs["first_jet_raw"] = firstRawJet.fChain;
+    inputs["second_jet"] = secondJet.fChain;
+    inputs["second_jet_raw"] = secondRawJet.fChain;
+    inputs["met"] = MET.fChain;
+    inputs["met_raw"] = rawMET.fChain;
+    inputs["misc"] = misc.fChain;
+    if (mIsMC) {
+      inputs["photon_gen"] = genPhoton.fChain;
+      inputs["first_jet_gen"] = firstGenJet.fChain;
+      inputs["second_jet_gen"] = secondGenJet.fChain;
+      inputs["met_gen"] = genMET.fChain;
+    }
 
-  TTree* genPhotonTree = NULL;
-  if (mIsMC)
-    cloneTree(genPhoton.fChain, genPhotonTree);
+    const std::vector<std::string> columns = (mCompactColumns.empty()) ? getDefaultCompactColumns(mIsMC) : mCompactColumns;
+    TTree* compactTree = makeCompactTree("selected_events", inputs, columns);
+    if (! compactTree)
+      return;
 
-  TTree* firstJetTree = NULL;
-  cloneTree(firstJet.fChain, firstJetTree);
+    treeWriter.add(compactTree, NULL, mCompactFloatBits);
+    std::cout << "Selected events are stored in a compact tree (" << columns.size() << " columns, " << mCompactFloatBits << " bits of mantissa for floats)" << std::endl;
+  } else {
+    TTree* photonTree = NULL;
+    cloneTree(photon.fChain, photonTree);
 
-  TTree* firstGenJetTree = NULL;
-  if (mIsMC)
-    cloneTree(firstGenJet.fChain, firstGenJetTree);
+    TTree* genPhotonTree = NULL;
+    if (mIsMC)
+      cloneTree(genPhoton.fChain, genPhotonTree);
 
-  TTree* firstRawJetTree = NULL;
-  cloneTree(firstRawJet.fChain, firstRawJetTree);
+    TTree* firstJetTree = NULL;
+    cloneTree(firstJet.fChain, firstJetTree);
 
-  TTree* secondJetTree = NULL;
-  cloneTree(secondJet.fChain, secondJetTree);
+    TTree* firstGenJetTree = NULL;
+    if (mIsMC)
+      cloneTree(firstGenJet.fChain, firstGenJetTree);
 
-  TTree* secondGenJetTree = NULL;
-  if (mIsMC)
-    cloneTree(secondGenJet.fChain, secondGenJetTree);
+    TTree* firstRawJetTree = NULL;
+    cloneTree(firstRawJet.fChain, firstRawJetTree);
 
-  TTree* secondRawJetTree = NULL;
-  cloneTree(secondRawJet.fChain, secondRawJetTree);
+    TTree* secondJetTree = NULL;
+    cloneTree(secondJet.fChain, secondJetTree);
 
-  TTree* metTree = NULL;
-  cloneTree(MET.fChain, metTree);
+    TTree* secondGenJetTree = NULL;
+    if (mIsMC)
+      cloneTree(secondGenJet.fChain, secondGenJetTree);
 
-  TTree* rawMetTree = NULL;
-  cloneTree(rawMET.fChain, rawMetTree);
+    TTree* secondRawJetTree = NULL;
+    cloneTree(secondRawJet.fChain, secondRawJetTree);
 
-  TTree* genMetTree = NULL;
-  if (mIsMC)
-    cloneTree(genMET.fChain, genMetTree);
+    TTree* metTree = NULL;
+    cloneTree(MET.fChain, metTree);
 
-  TTree* muonsTree = NULL;
-  cloneTree(muons.fChain, muonsTree);
+    TTree* rawMetTree = NULL;
+    cloneTree(rawMET.fChain, rawMetTree);
 
-  TTree* electronsTree = NULL;
-  cloneTree(electrons.fChain, electronsTree);
+    TTree* genMetTree = NULL;
+    if (mIsMC)
+      cloneTree(genMET.fChain, genMetTree);
+
+    TTree* muonsTree = NULL;
+    cloneTree(muons.fChain, muonsTree);
+
+    TTree* electronsTree = NULL;
+    cloneTree(electrons.fChain, electronsTree);
+
+    TTree* analysisTree = NULL;
+    cloneTree(analysis.fChain, analysisTree);
+    analysisTree->SetName("misc");
+
+    TTree *miscTree = NULL;
+    cloneTree(misc.fChain, miscTree);
+    miscTree->SetName("rho");
+
+    treeWriter.add(photonTree, photon.fChain);
+    treeWriter.add(genPhotonTree, genPhoton.fChain);
+    treeWriter.add(firstJetTree, firstJet.fChain);
+    treeWriter.add(firstGenJetTree, firstGenJet.fChain);
+    treeWriter.add(firstRawJetTree, firstRawJet.fChain);
+    treeWriter.add(secondJetTree, secondJet.fChain);
+    treeWriter.add(secondGenJetTree, secondGenJet.fChain);
+    treeWriter.add(secondRawJetTree, secondRawJet.fChain);
+    treeWriter.add(metTree, MET.fChain);
+    treeWriter.add(rawMetTree, rawMET.fChain);
+    treeWriter.add(genMetTree, genMET.fChain);
+    treeWriter.add(electronsTree, electrons.fChain);
+    treeWriter.add(muonsTree, muons.fChain);
+    treeWriter.add(analysisTree, analysis.fChain);
+    treeWriter.add(miscTree, misc.fChain);
+  }
+
+  for (TTree* tree: treeWriter.trees()) {
+    checkpoint.addTree(tree);
+  }
 
-  TTree* analysisTree = NULL;
-  cloneTree(analysis.fChain, analysisTree);
-  analysisTree->SetName("misc");
+  if (mResume) {
+    // Previous entries are read back through the writer buffers
+    treeWriter.reserve(checkpoint.largestArray());
+    if (! checkpoint.restoreTrees())
+      return;
+  }
 
-  TTree *miscTree = NULL;
-  cloneTree(misc.fChain, miscTree);
-  miscTree->SetName("rho");
+  if (! mSyncTrees)
+    treeWriter.start();
 #endif
 
   FactorizedJetCorrector* jetCorrector = NULL;
+  std::unique_ptr<TabulatedJetCorrector> tabulatedJetCorrector;
   //void* jetCorrector = NULL;
+  if (mUseExternalJECCorrecion && ! mJECFriend.empty()) {
+    std::cout << MAKE_RED << "JEC friend trees are used, external JEC are ignored" << RESET_COLOR << std::endl;
+    mUseExternalJECCorrecion = false;
+  }
+
   if (mUseExternalJECCorrecion) {
 
     std::string jecJetAlgo = "AK5";
@@ -309,7 +402,62 @@ void GammaJetFinalizer::runAnalysis() {
     std::cout << "Using '" << jecJetAlgo << "' algorithm for external JEC" << std::endl;
 
     const std::string payloadsFile = "jec_payloads.xml";
-    jetCorrector = makeFactorizedJetCorrectorFromXML(payloadsFile, jecJetAlgo, mIsMC);
+    std::vector<JetCorrectorParameters> jecParameters;
+    if (! readJECParameters(payloadsFile, jecJetAlgo, mIsMC, jecParameters)) {
+      std::cerr << MAKE_RED << "Error: can't read external JEC payloads from '" << payloadsFile << "'" << RESET_COLOR << std::endl;
+      return;
+    }
+
+    if (mUseTabulatedJEC) {
+      tabulatedJetCorrector.reset(new TabulatedJetCorrector(jecParameters, mTabulatedJECTolerance));
+      if (tabulatedJetCorrector->isValid()) {
+        std::cout << "External JEC tabulated. Maximum relative error: " << MAKE_BLUE << tabulatedJetCorrector->maxRelativeError() << RESET_COLOR << std::endl;
+      } else if (tabulatedJetCorrector->maxRelativeError() > mTabulatedJECTolerance) {
+        std::cout << MAKE_RED << "Relative error of the JEC grid (" << tabulatedJetCorrector->maxRelativeError() << ") above the tolerance (" << mTabulatedJECTolerance << "), using exact external JEC" << RESET_COLOR << std::endl;
+        tabulatedJetCorrector.reset();
+      } else {
+        std::cout << MAKE_RED << "Payloads can't be tabulated, using exact external JEC" << RESET_COLOR << std::endl;
+        tabulatedJetCorrector.reset();
+      }
+    }
+
+    if (! tabulatedJetCorrector)
+      jetCorrector = new FactorizedJetCorrector(jecParameters);
+  }
+
+  // Jets pt already corrected by jecFriendTrees
+  TChain jecFriendChain(getJECFriendTreeName(postFix, mJECFriend).c_str());
+  Float_t jecFriendFirstJetPt = 0, jecFriendSecondJetPt = 0;
+  if (! mJECFriend.empty()) {
+    for (const std::string& file: mInputFiles) {
+      jecFriendChain.Add(getJECFriendFileName(file, mJECFriend).c_str());
+    }
+
+    // Compared file by file: totals can match while two files don't. Once the total number of
+    // entries is known, the chains hold the offset of each of their files
+    bool matching = jecFriendChain.GetEntries() == firstRawJetChain.GetEntries() && jecFriendChain.GetNtrees() == firstRawJetChain.GetNtrees();
+    int mismatch = -1;
+    for (int file = 0; file < std::min(jecFriendChain.GetNtrees(), firstRawJetChain.GetNtrees()); file++) {
+      const Long64_t* friendOffsets = jecFriendChain.GetTreeOffset();
+      const Long64_t* inputOffsets = firstRawJetChain.GetTreeOffset();
+      if (friendOffsets[file + 1] - friendOffsets[file] != inputOffsets[file + 1] - inputOffsets[file]) {
+        mismatch = file;
+        break;
+      }
+    }
+
+    if (! matching || mismatch >= 0) {
+      std::cerr << MAKE_RED << "Error: JEC friend trees for '" << mJECFriend << "' don't match input files";
+      if (mismatch >= 0 && mismatch < static_cast<int>(mInputFiles.size()))
+        std::cerr << " (first mismatch: '" << mInputFiles[mismatch] << "')";
+      std::cerr << ". Run jecFriendTrees again." << RESET_COLOR << std::endl;
+      return;
+    }
+
+    jecFriendChain.SetBranchAddress("first_jet_pt", &jecFriendFirstJetPt);
+    jecFriendChain.SetBranchAddress("second_jet_pt", &jecFriendSecondJetPt);
+
+    std::cout << "Using JEC friend trees '" << MAKE_BLUE << mJECFriend << RESET_COLOR << "'" << std::endl;
   }
 
   std::cout << "Processing..." << std::endl;
@@ -490,6 +638,8 @@ void GammaJetFinalizer::runAnalysis() {
   uint64_t rejectedEventsFromTriggers = 0;
   uint64_t rejectedEventsTriggerNotFound = 0;
   uint64_t rejectedEventsPtOut = 0;
+  uint64_t rejectedEventsRunNotFound = 0;
+  std::set<unsigned int> runsNotFound;
 
   uint64_t passedPhotonJetCut = 0;
   uint64_t passedDeltaPhiCut = 0;
@@ -510,29 +660,105 @@ void GammaJetFinalizer::runAnalysis() {
     std::cout << "Batch mode: running from " << from << " (included) to " << to << " (excluded)" << std::endl;
   }
 
-  clock::time_point start = clock::now();
+  checkpoint.addCounter("passed_events", passedEvents);
+  checkpoint.addCounter("passed_events_from_triggers", passedEventsFromTriggers);
+  checkpoint.addCounter("rejected_events_from_triggers", rejectedEventsFromTriggers);
+  checkpoint.addCounter("rejected_events_trigger_not_found", rejectedEventsTriggerNotFound);
+  checkpoint.addCounter("rejected_events_pt_out", rejectedEventsPtOut);
+  checkpoint.addCounter("rejected_events_run_not_found", rejectedEventsRunNotFound);
+  checkpoint.addCounter("passed_photon_jet_cut", passedPhotonJetCut);
+  checkpoint.addCounter("passed_delta_phi_cut", passedDeltaPhiCut);
+  checkpoint.addCounter("passed_pixel_seed_veto_cut", passedPixelSeedVetoCut);
+  checkpoint.addCounter("passed_muons_cut", passedMuonsCut);
+  checkpoint.addCounter("passed_electrons_cut", passedElectronsCut);
+  checkpoint.addCounter("passed_alpha_cut", passedAlphaCut);
+  checkpoint.addRuns("not_found", runsNotFound);
+
+  uint64_t firstEntry = from;
+  if (mResume) {
+    if (! checkpoint.restore(fs.file(), from, to, firstEntry))
+      return;
+
+    std::cout << "Resuming from entry " << MAKE_BLUE << firstEntry << RESET_COLOR << std::endl;
+  }
+
+  // All entries before 'entry' are processed
+  auto saveCheckpoint = [&](uint64_t entry) {
+#if ADD_TREES
+    treeWriter.flush();
+#endif
+    if (! checkpoint.save(fs.file(), from, to, entry))
+      std::cerr << MAKE_RED << "Error: failed to save checkpoint" << RESET_COLOR << std::endl;
+  };
+
+  uint64_t lastCheckpointEntry = firstEntry;
+  clock::time_point lastCheckpointTime = clock::now();
+  uint64_t nextEntry = to;
+
+  const Long64_t bytesReadAtStart = TFile::GetFileBytesRead();
+
+  if (mUseHardwareCounters && ! mInstrumentation.enableHardwareCounters())
+    std::cerr << MAKE_RED << "Warning: hardware counters are not available (check /proc/sys/kernel/perf_event_paranoid). Only timing will be reported." << RESET_COLOR << std::endl;
+
+#if ADD_TREES
+  // First entry of the input file after the one holding 'entry'. The chains know the offset of
+  // every file once their number of entries is known
+  auto nextInputFile = [&photonChain] (uint64_t entry) {
+    const Long64_t* offsets = photonChain.GetTreeOffset();
+    for (int file = 1; file <= photonChain.GetNtrees(); file++) {
+      if (static_cast<uint64_t>(offsets[file]) > entry)
+        return static_cast<uint64_t>(offsets[file]);
+    }
+
+    return std::numeric_limits<uint64_t>::max();
+  };
 
-#if PROFILE
-  std::chrono::milliseconds t0; 
-  std::chrono::microseconds t1; 
-  std::chrono::microseconds t2;
+  uint64_t nextInputFileEntry = nextInputFile(firstEntry);
 #endif
 
-  for (uint64_t i = from; i < to; i++) {
+  clock::time_point start = clock::now();
+
+  for (uint64_t i = firstEntry; i < to; i++) {
 
     if ((i - from) % 50000 == 0) {
       clock::time_point end = clock::now();
       double elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
       start = end;
       std::cout << "Processing event #" << (i - from + 1) << " of " << (to - from) << " (" << (float) (i - from) / (to - from) * 100 << "%) - " << elapsedTime << " ms" << std::endl;
+
+      if (mInstrumentation.enabled()) {
+        mInstrumentation.setBytesRead(TFile::GetFileBytesRead() - bytesReadAtStart);
+        mInstrumentation.printSummary(std::cout);
+      }
     }
 
+    mInstrumentation.beginEvent();
+
     if (EXIT) {
+      nextEntry = i;
       break;
     }
 
-#if PROFILE
-    auto fooA = clock::now();
+    if (useCheckpoints && i > lastCheckpointEntry) {
+      bool eventsElapsed = mCheckpointEvents > 0 && i - lastCheckpointEntry >= mCheckpointEvents;
+      bool timeElapsed = mCheckpointInterval > 0 && clock::now() - lastCheckpointTime >= std::chrono::seconds(mCheckpointInterval);
+      if (eventsElapsed || timeElapsed) {
+        mInstrumentation.start(Instrumentation::CHECKPOINT);
+        saveCheckpoint(i);
+        lastCheckpointEntry = i;
+        lastCheckpointTime = clock::now();
+      }
+    }
+
+    mInstrumentation.start(Instrumentation::READ);
+
+#if ADD_TREES
+    // The chains are about to open their next file: under ROOT 5, this must not happen while the
+    // tree writer thread is busy (see AsyncTreeWriter)
+    if (i >= nextInputFileEntry) {
+      treeWriter.flush();
+      nextInputFileEntry = nextInputFile(i);
+    }
 #endif
 
     analysis.GetEntry(i);
@@ -559,17 +785,6 @@ void GammaJetFinalizer::runAnalysis() {
 
     misc.GetEntry(i);
 
-#if PROFILE
-    auto fooB = clock::now();
-
-    t0 += std::chrono::duration_cast<std::chrono::milliseconds>(fooB - fooA);
-
-    if ((i - from) % 50000 == 0) {
-      std::cout << "GetEntry() : " << std::chrono::duration_cast<std::chrono::milliseconds>(t0).count() << "ms" << std::endl;
-      t0 = std::chrono::milliseconds::zero();
-    }
-#endif
-
     if (! photon.is_present || ! firstJet.is_present)
       continue;
 
@@ -583,7 +798,26 @@ void GammaJetFinalizer::runAnalysis() {
     }
     */
 
-    if (jetCorrector) {
+    mInstrumentation.start(Instrumentation::JEC);
+
+    if (! mJECFriend.empty()) {
+      jecFriendChain.GetEntry(i);
+
+      firstJet.pt = jecFriendFirstJetPt;
+      secondJet.pt = jecFriendSecondJetPt;
+    } else if (tabulatedJetCorrector) {
+      // Both jets in one call
+      TabulatedJetCorrector::Jet rawJets[2] = {
+        { firstRawJet.eta, firstRawJet.pt, static_cast<float>(misc.rho), firstRawJet.jet_area },
+        { secondRawJet.eta, secondRawJet.pt, static_cast<float>(misc.rho), secondRawJet.jet_area }
+      };
+
+      float corrections[2];
+      tabulatedJetCorrector->getCorrections(rawJets, 2, corrections);
+
+      firstJet.pt = firstRawJet.pt * corrections[0];
+      secondJet.pt = secondRawJet.pt * corrections[1];
+    } else if (jetCorrector) {
       // jetCorrector isn't null. Correct raw jet with jetCorrector and rebuild the corrected jet
       jetCorrector->setJetEta(firstRawJet.eta);
       jetCorrector->setJetPt(firstRawJet.pt);
@@ -604,9 +838,7 @@ void GammaJetFinalizer::runAnalysis() {
       secondJet.pt = secondRawJet.pt * correction;
     }
 
-#if PROFILE
-    fooA = clock::now();
-#endif
+    mInstrumentation.start(Instrumentation::TRIGGER);
 
     int checkTriggerResult = 0;
     std::string passedTrigger;
@@ -646,6 +878,12 @@ void GammaJetFinalizer::runAnalysis() {
           }
           rejectedEventsPtOut++;
           break;
+        case TRIGGER_RUN_NOT_FOUND:
+          if (runsNotFound.insert(analysis.run).second) {
+            std::cout << MAKE_RED << "Error: run " << analysis.run << " not found for triggers selection. Events of this run are rejected." << RESET_COLOR << std::endl;
+          }
+          rejectedEventsRunNotFound++;
+          break;
       }
 
       rejectedEventsFromTriggers++;
@@ -656,6 +894,8 @@ void GammaJetFinalizer::runAnalysis() {
     //if (analysis.nvertex >= 21)
     //  continue;
     
+    mInstrumentation.start(Instrumentation::PU);
+
     if (mIsMC) {
       cleanTriggerName(passedTrigger);
       computePUWeight(passedTrigger);
@@ -664,17 +904,7 @@ void GammaJetFinalizer::runAnalysis() {
       triggerWeight = 1. / triggerWeight;
     }
 
-#if PROFILE
-    fooB = clock::now();
-
-    t1 += std::chrono::duration_cast<std::chrono::microseconds>(fooB - fooA);
-
-    if ((i - from) % 50000 == 0) {
-      std::cout << "Trigger + PU : " << t1.count() / 1000. << " ms" << std::endl;
-      t1 = std::chrono::microseconds::zero();
-    }
-#endif
-
+    mInstrumentation.start(Instrumentation::SELECTION);
 
     double generatorWeight = (mIsMC) ? analysis.generator_weight : 1.;
     if (generatorWeight == 0.)
@@ -686,31 +916,11 @@ void GammaJetFinalizer::runAnalysis() {
     analysis.event_weight = eventWeight;
 #endif
 
-#if PROFILE
-    fooA = clock::now();
-#endif
-
 #if ADD_TREES
     if (mUncutTrees) {
-      photonTree->Fill();
-      if (mIsMC)
-        genPhotonTree->Fill();
-      firstJetTree->Fill();
-      if (mIsMC)
-        firstGenJetTree->Fill();
-      firstRawJetTree->Fill();
-      secondJetTree->Fill();
-      if (mIsMC)
-        secondGenJetTree->Fill();
-      secondRawJetTree->Fill();
-      metTree->Fill();
-      rawMetTree->Fill();
-      if (mIsMC)
-        genMetTree->Fill();
-      electronsTree->Fill();
-      muonsTree->Fill();
-      analysisTree->Fill();
-      miscTree->Fill();
+      mInstrumentation.start(Instrumentation::TREE_WRITE);
+      treeWriter.fill();
+      mInstrumentation.start(Instrumentation::SELECTION);
     }
 #endif
 
@@ -771,6 +981,8 @@ void GammaJetFinalizer::runAnalysis() {
     if (secondJetOK)
       passedAlphaCut++;
 
+    mInstrumentation.start(Instrumentation::FILL);
+
 #if ADD_TREES
     h_nvertex->Fill(analysis.nvertex, oldAnalysisWeight);
 #else
@@ -1038,42 +1250,33 @@ void GammaJetFinalizer::runAnalysis() {
 
 #if ADD_TREES
       if (! mUncutTrees) {
-        photonTree->Fill();
-        if (mIsMC)
-          genPhotonTree->Fill();
-        firstJetTree->Fill();
-        if (mIsMC)
-          firstGenJetTree->Fill();
-        firstRawJetTree->Fill();
-        secondJetTree->Fill();
-        if (mIsMC)
-          secondGenJetTree->Fill();
-        secondRawJetTree->Fill();
-        metTree->Fill();
-        rawMetTree->Fill();
-        if (mIsMC)
-          genMetTree->Fill();
-        electronsTree->Fill();
-        muonsTree->Fill();
-        analysisTree->Fill();
-        miscTree->Fill();
+        mInstrumentation.start(Instrumentation::TREE_WRITE);
+        treeWriter.fill();
       }
 #endif
 
       passedEvents++;
     }
 
-#if PROFILE
-    fooB = clock::now();
+  }
 
-    t2 += std::chrono::duration_cast<std::chrono::microseconds>(fooB - fooA);
+  mInstrumentation.stop();
 
-    if ((i - from) % 50000 == 0) {
-      std::cout << "Remaining : " << t2.count() / 1000. << " ms" << std::endl;
-      t2 = std::chrono::microseconds::zero();
-    }
+#if ADD_TREES
+  mInstrumentation.start(Instrumentation::TREE_WRITE);
+  treeWriter.stop();
+  mInstrumentation.stop();
 #endif
 
+  mInstrumentation.setBytesRead(TFile::GetFileBytesRead() - bytesReadAtStart);
+
+  if (useCheckpoints) {
+    if (nextEntry < to) {
+      saveCheckpoint(nextEntry);
+      std::cout << MAKE_RED << "Interrupted at entry " << nextEntry << ". Run again with --resume to continue." << RESET_COLOR << std::endl;
+    } else {
+      checkpoint.remove();
+    }
   }
 
   std::cout << "Selection efficiency: " << MAKE_RED << (double) passedEvents / (to - from) * 100 << "%" << RESET_COLOR << std::endl;
@@ -1088,6 +1291,37 @@ void GammaJetFinalizer::runAnalysis() {
   std::cout << std::endl;
   std::cout << "Rejected events because trigger was not found: " << MAKE_RED << (double) rejectedEventsTriggerNotFound / (rejectedEventsFromTriggers) * 100 << "%" << RESET_COLOR << std::endl;
   std::cout << "Rejected events because trigger was found but pT was out of range: " << MAKE_RED << (double) rejectedEventsPtOut / (rejectedEventsFromTriggers) * 100 << "%" << RESET_COLOR << std::endl;
+
+  if (! runsNotFound.empty()) {
+    std::cout << "Rejected events because run was not found in triggers selection: " << MAKE_RED << (double) rejectedEventsRunNotFound / (rejectedEventsFromTriggers) * 100 << "%" << RESET_COLOR << std::endl;
+    std::cout << "Runs not found:";
+    for (unsigned int run: runsNotFound) {
+      std::cout << " " << run;
+    }
+    std::cout << std::endl;
+  }
+
+  if (mSkipEmptyHistograms) {
+    size_t elided = elidedHistograms.elide(fs.file());
+    std::cout << "Empty histograms left out of the output: " << MAKE_RED << elided << RESET_COLOR << std::endl;
+  }
+
+  // Profiles are fitted and the output file is written by the destructors below
+  mTimingReportFile = outputFile + ".timing.json";
+  mInstrumentation.start(Instrumentation::FINALIZE);
+}
+
+void GammaJetFinalizer::finishInstrumentation() {
+  if (! mInstrumentation.enabled())
+    return;
+
+  mInstrumentation.stop();
+
+  std::cout << std::endl;
+  mInstrumentation.printSummary(std::cout);
+
+  if (! mTimingReportFile.empty() && ! mInstrumentation.writeJSON(mTimingReportFile))
+    std::cerr << MAKE_RED << "Error: can't write timing report '" << mTimingReportFile << "'" << RESET_COLOR << std::endl;
 }
 
 template<typename T>
@@ -1308,73 +1542,33 @@ void GammaJetFinalizer::checkInputFiles() {
 int GammaJetFinalizer::checkTrigger(std::string& passedTrigger, float& weight) {
 
   if (! mIsMC) {
-    const PathVector& mandatoryTriggers = mTriggers->getTriggers(analysis.run);
-
     // Method 2:
     // - With the photon p_t, find the trigger it should pass
     // - Then, look on trigger list if it pass it or not (only for data)
+    const PathData* mandatoryTrigger = NULL;
+    int result = checkDataTrigger(*mTriggers, analysis.run, photon.pt, *analysis.trigger_names, *analysis.trigger_results, mandatoryTrigger);
 
-    //if (! mIsMC) {
-
-    const PathData* mandatoryTrigger = nullptr;
-    for (auto& path: mandatoryTriggers) {
-      if (path.second.range.in(photon.pt)) {
-        mandatoryTrigger = &path;
-      }
-    }
-
-    if (!mandatoryTrigger)
-      return TRIGGER_NOT_FOUND;
-
-    weight = mandatoryTrigger->second.weight;
+    if (mandatoryTrigger)
+      weight = mandatoryTrigger->second.weight;
 
-    // This photon must pass mandatoryTrigger.first
-    size_t size = analysis.trigger_names->size();
-    for (int i = size - 1; i >= 0; i--) {
-      bool passed = analysis.trigger_results->at(i);
-      if (! passed)
-        continue;
+    if (result == TRIGGER_OK)
+      passedTrigger = mandatoryTrigger->first.str();
 
-      if (boost::regex_match(analysis.trigger_names->at(i), mandatoryTrigger->first)) {
-        passedTrigger = mandatoryTrigger->first.str();
-        return TRIGGER_OK;
-      }
-    }
+    return result;
   } else {
-    const std::map<Range<float>, std::vector<MCTrigger>>& triggers = mMCTriggers->getTriggers();
-
-    const std::vector<MCTrigger>* mandatoryTrigger = nullptr;
-    for (auto& path: triggers) {
-      if (path.first.in(photon.pt)) {
-        mandatoryTrigger = &path.second;
-      }
-    }
+    const MCTriggerRange* mandatoryTrigger = mMCTriggers->find(photon.pt);
 
     if (!mandatoryTrigger)
       return TRIGGER_NOT_FOUND;
 
     weight = 1;
 
-    if (mandatoryTrigger->size() > 1) {
-      double random = mRandomGenerator.Rndm();
-
-      double weight_low = 0;
-      double weight_high = 0;
-      for (int32_t i = 0; i < (int32_t) mandatoryTrigger->size(); i++) {
-        if (i - 1 >= 0)
-          weight_low += (*mandatoryTrigger)[i - 1].weight;
-        weight_high += (*mandatoryTrigger)[i].weight;
-
-        if (random > weight_low && random <= weight_high) {
-          passedTrigger = (*mandatoryTrigger)[i].name.str();
-          return TRIGGER_OK;
-        }
-      }
-
-      throw new std::exception(); // This should NEVER happened
+    if (mandatoryTrigger->triggers.size() > 1) {
+      passedTrigger = mandatoryTrigger->sample(mRandomGenerator.uniform(analysis.run, analysis.lumi_block, analysis.event)).name.str();
+      return TRIGGER_OK;
     }
 
-    passedTrigger = mandatoryTrigger->at(0).name.str();
+    passedTrigger = mandatoryTrigger->triggers[0].name.str();
     return TRIGGER_OK;
   }
 
@@ -1431,6 +1625,8 @@ int main(int argc, char** argv) {
   sigIntHandler.sa_flags = 0;
 
   sigaction(SIGINT, &sigIntHandler, NULL);
+  // Sent by batch systems before killing a job
+  sigaction(SIGTERM, &sigIntHandler, NULL);
 
   try {
     TCLAP::CmdLine cmd("Step 3 of Gamma+Jet analysis", ' ', "0.1");
@@ -1462,12 +1658,25 @@ int main(int argc, char** argv) {
 
     TCLAP::SwitchArg mcComparisonArg("", "mc-comp", "Cut photon pt to avoid trigger prescale issues", cmd);
     TCLAP::SwitchArg externalJECArg("", "jec", "Use external JEC", cmd);
+    TCLAP::ValueArg<std::string> jecFriendArg("", "jec-friend", "Use jets pt corrected by jecFriendTrees for this JEC variant", false, "", "string", cmd);
+    TCLAP::SwitchArg tabulatedJECArg("", "jec-grid", "Evaluate external JEC on a precomputed grid instead of the exact formulas", cmd);
+    TCLAP::ValueArg<double> tabulatedJECToleranceArg("", "jec-grid-tolerance", "Largest relative error of the JEC grid, checked at startup. Above it, exact external JEC are used (default: 1e-3)", false, 1e-3, "double", cmd);
 
     TCLAP::ValueArg<float> alphaCutArg("", "alpha", "P_t^{second jet} / p_t^{photon} cut (default: 0.2)", false, 0.2, "float", cmd);
 
     TCLAP::SwitchArg chsArg("", "chs", "Use CHS branches", cmd);
     TCLAP::SwitchArg verboseArg("v", "verbose", "Enable verbose mode", cmd);
     TCLAP::SwitchArg uncutTreesArg("", "uncut-trees", "Fill trees before second jet cut", cmd);
+    TCLAP::SwitchArg compactTreesArg("", "compact-trees", "Store selected events in a single tree, with only the columns used for plots", cmd);
+    TCLAP::ValueArg<std::string> compactColumnsArg("", "compact-columns", "Comma separated list of columns of the compact tree, as tree.branch (default: see CompactTree.cpp)", false, "", "string", cmd);
+    TCLAP::ValueArg<int> compactFloatBitsArg("", "compact-float-bits", "Bits of mantissa kept for floats in the compact tree, from 0 to 23 (default: 23)", false, 23, "int", cmd);
+    TCLAP::ValueArg<int> checkpointEventsArg("", "checkpoint-events", "Save a checkpoint every N events (default: never)", false, 0, "int", cmd);
+    TCLAP::ValueArg<int> checkpointIntervalArg("", "checkpoint-interval", "Save a checkpoint every N seconds (default: never)", false, 0, "int", cmd);
+    TCLAP::SwitchArg resumeArg("", "resume", "Resume from the last checkpoint", cmd);
+    TCLAP::SwitchArg syncTreesArg("", "sync-trees", "Fill output trees from the event loop instead of a dedicated thread", cmd);
+    TCLAP::SwitchArg skipEmptyArg("", "skip-empty", "Don't write empty histograms, only their booking. Draw programs recreate them when reading the file", cmd);
+    TCLAP::SwitchArg timingArg("", "timing", "Report the time spent in each stage of the event loop", cmd);
+    TCLAP::SwitchArg perfCountersArg("", "perf-counters", "Also report hardware counters (cycles, instructions, cache and branch misses) for each stage. Implies --timing", cmd);
 
     cmd.parse(argc, argv);
 
@@ -1490,15 +1699,23 @@ int main(int argc, char** argv) {
     finalizer.setMC(mcArg.getValue());
     finalizer.setMCComparison(mcComparisonArg.getValue());
     finalizer.setUseExternalJEC(externalJECArg.getValue());
+    finalizer.setUseTabulatedJEC(tabulatedJECArg.getValue(), tabulatedJECToleranceArg.getValue());
+    finalizer.setJECFriend(jecFriendArg.getValue());
     finalizer.setAlphaCut(alphaCutArg.getValue());
     finalizer.setCHS(chsArg.getValue());
     finalizer.setVerbose(verboseArg.getValue());
     finalizer.setUncutTrees(uncutTreesArg.getValue());
+    finalizer.setSyncTrees(syncTreesArg.getValue());
+    finalizer.setSkipEmptyHistograms(skipEmptyArg.getValue());
+    finalizer.setTiming(timingArg.getValue(), perfCountersArg.getValue());
+    finalizer.setCheckpoint(checkpointEventsArg.getValue(), checkpointIntervalArg.getValue(), resumeArg.getValue());
+    finalizer.setCompactTrees(compactTreesArg.getValue(), parseCompactColumns(compactColumnsArg.getValue()), compactFloatBitsArg.getValue());
     if (totalJobsArg.isSet() && currentJobArg.isSet()) {
       finalizer.setBatchJob(currentJobArg.getValue(), totalJobsArg.getValue());
     }
 
     finalizer.runAnalysis();
+    finalizer.finishInstrumentation();
 
   } catch (TCLAP::ArgException &e) {
     std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
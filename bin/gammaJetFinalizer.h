@@ -1,7 +1,5 @@
 #pragma once
 
-#include <TRandom3.h>
-
 #include "Tree/AnalysisTree.h"
 #include "Tree/PhotonTree.h"
 #include "Tree/JetTree.h"
@@ -18,7 +16,11 @@
 #include "newExtrapBinning.h"
 #include "triggers.h"
 #include "GaussianProfile.h"
+#include "CounterRandom.h"
+#include "Instrumentation.h"
 
+#include <algorithm>
+#include <string>
 #include <vector>
 #include <memory>
 #include <unordered_map>
@@ -99,6 +101,15 @@ class GammaJetFinalizer
       mUseExternalJECCorrecion = useExternalJEC;
     }
 
+    void setUseTabulatedJEC(bool useTabulatedJEC, double tolerance) {
+      mUseTabulatedJEC = useTabulatedJEC;
+      mTabulatedJECTolerance = tolerance;
+    }
+
+    void setJECFriend(const std::string& variant) {
+      mJECFriend = variant;
+    }
+
     void setBatchJob(int currentJob, int totalJobs) {
       mIsBatchJob = true;
       mCurrentJob = currentJob;
@@ -121,8 +132,36 @@ class GammaJetFinalizer
       mUncutTrees = uncutTrees;
     }
 
+    void setSyncTrees(bool syncTrees) {
+      mSyncTrees = syncTrees;
+    }
+
+    void setSkipEmptyHistograms(bool skipEmpty) {
+      mSkipEmptyHistograms = skipEmpty;
+    }
+
+    void setCheckpoint(int events, int seconds, bool resume) {
+      mCheckpointEvents = std::max(0, events);
+      mCheckpointInterval = std::max(0, seconds);
+      mResume = resume;
+    }
+
+    void setCompactTrees(bool compactTrees, const std::vector<std::string>& columns, int floatBits) {
+      mCompactTrees = compactTrees;
+      mCompactColumns = columns;
+      mCompactFloatBits = std::min(23, std::max(0, floatBits));
+    }
+
+    void setTiming(bool timing, bool hardwareCounters) {
+      mInstrumentation.setEnabled(timing || hardwareCounters);
+      mUseHardwareCounters = hardwareCounters;
+    }
+
     void runAnalysis();
 
+    // Print and save the timing report, once the output file is written
+    void finishInstrumentation();
+
   private:
     void checkInputFiles();
     void loadFiles(TChain& chain);
@@ -192,12 +231,27 @@ class GammaJetFinalizer
     int mTotalJobs;
     int mCurrentJob;
     bool mUseExternalJECCorrecion;
+    bool mUseTabulatedJEC;
+    double mTabulatedJECTolerance;
+    std::string mJECFriend;
 
     float  mAlphaCut;
     bool   mDoMCComparison;
     bool   mUseCHS;
     bool   mVerbose;
     bool   mUncutTrees;
+    bool   mSyncTrees;
+    bool   mCompactTrees;
+    std::vector<std::string> mCompactColumns;
+    int    mCompactFloatBits;
+    bool   mSkipEmptyHistograms;
+    uint64_t mCheckpointEvents;
+    int    mCheckpointInterval;
+    bool   mResume;
+
+    Instrumentation mInstrumentation;
+    bool   mUseHardwareCounters;
+    std::string mTimingReportFile;
 
     std::unordered_map<std::string, boost::shared_ptr<PUReweighter>> mLumiReweighting;
     float mPUWeight;
@@ -218,5 +272,5 @@ class GammaJetFinalizer
     // Triggers on data
     Triggers* mTriggers;
     MCTriggers* mMCTriggers;
-    TRandom3 mRandomGenerator;
+    CounterRandom mRandomGenerator; // Keyed by event id, so results do not depend on how the input is split
 };
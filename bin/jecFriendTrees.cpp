@@ -0,0 +1,357 @@
+#include <TFile.h>
+#include <TROOT.h>
+#include <TTree.h>
+#include <TDirectory.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include "tclap/CmdLine.h"
+
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+
+#include "JECReader.h"
+#include "JECFriends.h"
+#include "TabulatedJetCorrector.h"
+
+#define RESET_COLOR "\033[m"
+#define MAKE_RED "\033[31m"
+#define MAKE_BLUE "\033[34m"
+
+// Evaluate JEC payload sets once over the raw jets of step 2 ntuples, and store the corrected
+// pt as friend trees. gammaJetFinalizer --jec-friend <variant> then uses them instead of
+// correcting the jets itself. See JECFriends.h for the layout.
+
+struct Variant {
+  std::string name;
+  std::string payloadsFile;
+
+  std::shared_ptr<FactorizedJetCorrector> corrector;
+  std::shared_ptr<TabulatedJetCorrector> tabulatedCorrector;
+
+  float correct(float eta, float pt, float rho, float area, unsigned int npv) {
+    if (pt <= 0)
+      return pt;
+
+    if (tabulatedCorrector)
+      return pt * tabulatedCorrector->getCorrection(eta, pt, rho, area);
+
+    corrector->setJetEta(eta);
+    corrector->setJetPt(pt);
+    corrector->setRho(rho);
+    corrector->setJetA(area);
+    corrector->setNPV(npv);
+
+    return pt * corrector->getCorrection();
+  }
+};
+
+struct RawJet {
+  Float_t pt;
+  Float_t eta;
+  Float_t jet_area;
+
+  void bind(TTree* tree) {
+    tree->SetBranchStatus("*", 0);
+    tree->SetBranchStatus("pt", 1);
+    tree->SetBranchStatus("eta", 1);
+    tree->SetBranchStatus("jet_area", 1);
+
+    tree->SetBranchAddress("pt", &pt);
+    tree->SetBranchAddress("eta", &eta);
+    tree->SetBranchAddress("jet_area", &jet_area);
+  }
+};
+
+std::vector<std::string> readInputFiles(const std::string& list) {
+  std::ifstream f(list.c_str());
+  std::string line;
+  std::vector<std::string> files;
+  while (std::getline(f, line)) {
+    boost::algorithm::trim(line);
+    if (line.length() == 0 || line[0] == '#')
+      continue;
+
+    files.push_back(line);
+  }
+
+  return files;
+}
+
+template<typename T>
+T* getTree(TFile* file, const std::string& name) {
+  T* tree = static_cast<T*>(file->Get(name.c_str()));
+  if (! tree)
+    std::cerr << MAKE_RED << "Error: tree '" << name << "' not found in '" << file->GetName() << "'" << RESET_COLOR << std::endl;
+
+  return tree;
+}
+
+bool processFile(const std::string& inputFile, const std::string& postfix, std::vector<Variant>& variants) {
+  std::unique_ptr<TFile> input(TFile::Open(inputFile.c_str()));
+  if (! input.get() || input->IsZombie()) {
+    std::cerr << MAKE_RED << "Error: can't open '" << inputFile << "'" << RESET_COLOR << std::endl;
+    return false;
+  }
+
+  TTree* analysisTree = getTree<TTree>(input.get(), "gammaJet/analysis");
+  TTree* firstRawJetTree = getTree<TTree>(input.get(), "gammaJet/" + postfix + "/first_jet_raw");
+  TTree* secondRawJetTree = getTree<TTree>(input.get(), "gammaJet/" + postfix + "/second_jet_raw");
+  TTree* miscTree = getTree<TTree>(input.get(), "gammaJet/" + postfix + "/misc");
+  if (! analysisTree || ! firstRawJetTree || ! secondRawJetTree || ! miscTree)
+    return false;
+
+  Long64_t entries = firstRawJetTree->GetEntries();
+  if (secondRawJetTree->GetEntries() != entries || miscTree->GetEntries() != entries || analysisTree->GetEntries() != entries) {
+    std::cerr << MAKE_RED << "Error: trees inside '" << inputFile << "' don't have the same number of entries" << RESET_COLOR << std::endl;
+    return false;
+  }
+
+  UInt_t nvertex = 0;
+  analysisTree->SetBranchStatus("*", 0);
+  analysisTree->SetBranchStatus("nvertex", 1);
+  analysisTree->SetBranchAddress("nvertex", &nvertex);
+
+  Double_t rho = 0;
+  miscTree->SetBranchStatus("*", 0);
+  miscTree->SetBranchStatus("rho", 1);
+  miscTree->SetBranchAddress("rho", &rho);
+
+  RawJet firstRawJet, secondRawJet;
+  firstRawJet.bind(firstRawJetTree);
+  secondRawJet.bind(secondRawJetTree);
+
+  struct Output {
+    std::string fileName;
+    std::string tmpFileName;
+    TFile* file;
+    TTree* tree;
+    Float_t firstJetPt;
+    Float_t secondJetPt;
+  };
+
+  std::vector<Output> outputs(variants.size());
+
+  // On error, nothing of this input file must be left behind
+  auto discardOutputs = [&outputs] () {
+    for (Output& output: outputs) {
+      if (output.file) {
+        output.file->Close();
+        delete output.file;
+        output.file = NULL;
+      }
+
+      if (! output.tmpFileName.empty())
+        std::remove(output.tmpFileName.c_str());
+    }
+  };
+
+  for (size_t v = 0; v < variants.size(); v++) {
+    Output& output = outputs[v];
+    output.fileName = getJECFriendFileName(inputFile, variants[v].name);
+    output.file = NULL;
+
+    // Unique temporary file, so that concurrent jobs never write into the same one
+    int fd = BinaryCache::createTemporary(output.fileName, output.tmpFileName);
+    if (fd < 0) {
+      std::cerr << MAKE_RED << "Error: can't create a temporary file for '" << output.fileName << "'" << RESET_COLOR << std::endl;
+      discardOutputs();
+      return false;
+    }
+    close(fd);
+
+    output.file = TFile::Open(output.tmpFileName.c_str(), "recreate");
+    if (! output.file || output.file->IsZombie()) {
+      std::cerr << MAKE_RED << "Error: can't create '" << output.tmpFileName << "'" << RESET_COLOR << std::endl;
+      discardOutputs();
+      return false;
+    }
+
+    TDirectory* dir = output.file->mkdir("gammaJet")->mkdir(postfix.c_str());
+    dir->cd();
+
+    output.tree = new TTree(("jec_" + variants[v].name).c_str(), ("JEC variant " + variants[v].name).c_str());
+    output.tree->Branch("first_jet_pt", &output.firstJetPt, "first_jet_pt/F");
+    output.tree->Branch("second_jet_pt", &output.secondJetPt, "second_jet_pt/F");
+  }
+
+  for (Long64_t i = 0; i < entries; i++) {
+    analysisTree->GetEntry(i);
+    miscTree->GetEntry(i);
+    firstRawJetTree->GetEntry(i);
+    secondRawJetTree->GetEntry(i);
+
+    for (size_t v = 0; v < variants.size(); v++) {
+      outputs[v].firstJetPt = variants[v].correct(firstRawJet.eta, firstRawJet.pt, rho, firstRawJet.jet_area, nvertex);
+      outputs[v].secondJetPt = variants[v].correct(secondRawJet.eta, secondRawJet.pt, rho, secondRawJet.jet_area, nvertex);
+      outputs[v].tree->Fill();
+    }
+  }
+
+  bool ok = true;
+  for (Output& output: outputs) {
+    output.file->cd();
+    output.file->Write();
+    output.file->Close();
+    delete output.file;
+
+    if (std::rename(output.tmpFileName.c_str(), output.fileName.c_str()) != 0) {
+      std::cerr << MAKE_RED << "Error: can't write '" << output.fileName << "'" << RESET_COLOR << std::endl;
+      std::remove(output.tmpFileName.c_str());
+      ok = false;
+    }
+  }
+
+  if (ok)
+    std::cout << "'" << inputFile << "' done (" << entries << " entries)" << std::endl;
+
+  return ok;
+}
+
+bool processFiles(const std::vector<std::string>& files, size_t worker, size_t workers, const std::string& postfix, std::vector<Variant>& variants) {
+  bool ok = true;
+  for (size_t i = worker; i < files.size(); i += workers) {
+    ok &= processFile(files[i], postfix, variants);
+  }
+
+  return ok;
+}
+
+int main(int argc, char** argv) {
+
+  try {
+    TCLAP::CmdLine cmd("Evaluate JEC variants over step 2 ntuples, and store corrected jets pt as friend trees", ' ', "0.1");
+
+    TCLAP::MultiArg<std::string> inputArg("i", "in", "Input file", true, "string");
+    TCLAP::ValueArg<std::string> inputListArg("", "input-list", "Text file containing input files", true, "input.list", "string");
+    cmd.xorAdd(inputArg, inputListArg);
+
+    std::vector<std::string> jetTypes;
+    jetTypes.push_back("pf");
+    jetTypes.push_back("calo");
+    TCLAP::ValuesConstraint<std::string> allowedJetTypes(jetTypes);
+
+    TCLAP::ValueArg<std::string> typeArg("", "type", "jet type", true, "pf", &allowedJetTypes, cmd);
+
+    std::vector<std::string> algoTypes;
+    algoTypes.push_back("ak5");
+    algoTypes.push_back("ak7");
+    TCLAP::ValuesConstraint<std::string> allowedAlgoTypes(algoTypes);
+
+    TCLAP::ValueArg<std::string> algoArg("", "algo", "jet algo", true, "ak5", &allowedAlgoTypes, cmd);
+
+    TCLAP::SwitchArg mcArg("", "mc", "MC?", cmd);
+    TCLAP::SwitchArg chsArg("", "chs", "Use CHS branches", cmd);
+
+    TCLAP::MultiArg<std::string> variantArg("", "variant", "JEC variant, as name:payloads.xml (default: nominal:jec_payloads.xml)", false, "string", cmd);
+    TCLAP::SwitchArg tabulatedJECArg("", "jec-grid", "Evaluate JEC on a precomputed grid instead of the exact formulas", cmd);
+    TCLAP::ValueArg<double> tabulatedJECToleranceArg("", "jec-grid-tolerance", "Largest relative error of the JEC grid, checked at startup. Above it, exact JEC are used (default: 1e-3)", false, 1e-3, "double", cmd);
+    TCLAP::ValueArg<int> jobsArg("j", "jobs", "Number of files processed in parallel", false, 1, "int", cmd);
+
+    cmd.parse(argc, argv);
+
+    std::vector<std::string> files = (inputArg.isSet()) ? inputArg.getValue() : readInputFiles(inputListArg.getValue());
+    if (files.empty()) {
+      std::cerr << MAKE_RED << "Error: no input files" << RESET_COLOR << std::endl;
+      return 1;
+    }
+
+    bool isPF = typeArg.getValue() == "pf";
+    std::string postfix = std::string(isPF ? "PFlow" : "Calo") + ((algoArg.getValue() == "ak5") ? "AK5" : "AK7");
+    std::string jecJetAlgo = std::string((algoArg.getValue() == "ak5") ? "AK5" : "AK7") + (isPF ? "PF" : "Calo");
+    if (chsArg.getValue()) {
+      postfix += "chs";
+      if (isPF)
+        jecJetAlgo += "chs";
+    }
+
+    std::vector<std::string> variantSpecs = variantArg.getValue();
+    if (variantSpecs.empty())
+      variantSpecs.push_back("nominal:jec_payloads.xml");
+
+    std::vector<Variant> variants;
+    for (const std::string& spec: variantSpecs) {
+      size_t separator = spec.find(':');
+      if (separator == 0 || separator == std::string::npos || separator + 1 == spec.size()) {
+        std::cerr << MAKE_RED << "Error: invalid variant '" << spec << "', expected name:payloads.xml" << RESET_COLOR << std::endl;
+        return 1;
+      }
+
+      Variant variant;
+      variant.name = spec.substr(0, separator);
+      variant.payloadsFile = spec.substr(separator + 1);
+
+      std::vector<JetCorrectorParameters> parameters;
+      if (! readJECParameters(variant.payloadsFile, jecJetAlgo, mcArg.getValue(), parameters)) {
+        std::cerr << MAKE_RED << "Error: can't read '" << jecJetAlgo << "' payloads from '" << variant.payloadsFile << "'" << RESET_COLOR << std::endl;
+        return 1;
+      }
+
+      if (tabulatedJECArg.getValue()) {
+        variant.tabulatedCorrector.reset(new TabulatedJetCorrector(parameters, tabulatedJECToleranceArg.getValue()));
+        if (variant.tabulatedCorrector->isValid()) {
+          std::cout << "Variant '" << variant.name << "' tabulated. Maximum relative error: " << MAKE_BLUE << variant.tabulatedCorrector->maxRelativeError() << RESET_COLOR << std::endl;
+        } else if (variant.tabulatedCorrector->maxRelativeError() > tabulatedJECToleranceArg.getValue()) {
+          std::cout << MAKE_RED << "Variant '" << variant.name << "': relative error of the grid (" << variant.tabulatedCorrector->maxRelativeError() << ") above the tolerance, using exact JEC" << RESET_COLOR << std::endl;
+          variant.tabulatedCorrector.reset();
+        } else {
+          std::cout << MAKE_RED << "Variant '" << variant.name << "' can't be tabulated, using exact JEC" << RESET_COLOR << std::endl;
+          variant.tabulatedCorrector.reset();
+        }
+      }
+
+      if (! variant.tabulatedCorrector)
+        variant.corrector.reset(new FactorizedJetCorrector(parameters));
+
+      std::cout << "Variant '" << MAKE_BLUE << variant.name << RESET_COLOR << "' from '" << variant.payloadsFile << "'" << std::endl;
+      variants.push_back(variant);
+    }
+
+    // ROOT I/O is not thread safe, so files are dispatched to worker processes. Correctors
+    // are built once above, and shared with the workers
+    size_t workers = std::max(1, std::min<int>(jobsArg.getValue(), files.size()));
+    if (workers == 1)
+      return processFiles(files, 0, 1, postfix, variants) ? 0 : 1;
+
+    std::vector<pid_t> children;
+    for (size_t worker = 0; worker < workers; worker++) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::cerr << MAKE_RED << "Error: can't start worker " << worker << RESET_COLOR << std::endl;
+        break;
+      }
+
+      if (pid == 0) {
+        bool ok = processFiles(files, worker, workers, postfix, variants);
+        std::cout.flush();
+        _exit((ok) ? 0 : 1);
+      }
+
+      children.push_back(pid);
+    }
+
+    bool ok = children.size() == workers;
+    for (pid_t pid: children) {
+      int status = 0;
+      waitpid(pid, &status, 0);
+      ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    return (ok) ? 0 : 1;
+
+  } catch (TCLAP::ArgException &e) {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 1;
+  }
+}
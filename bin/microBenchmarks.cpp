@@ -0,0 +1,435 @@
+#include <TF1.h>
+#include <TFile.h>
+#include <TH1D.h>
+#include <TH1F.h>
+#include <TMath.h>
+#include <TROOT.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+
+#include "tclap/CmdLine.h"
+
+#include "PhysicsTools/FWLite/interface/TFileService.h"
+
+#include "etaBinning.h"
+#include "ptBinning.h"
+#include "extrapBinning.h"
+#include "triggers.h"
+#include "PUReweighter.h"
+#include "GaussianProfile.h"
+#include "CounterRandom.h"
+
+#include "../analysis/draw/fitTools.h"
+
+#define RESET_COLOR "\033[m"
+#define MAKE_RED "\033[31m"
+#define MAKE_BLUE "\033[34m"
+
+// Micro-benchmarks of the finalizer hot kernels, on inputs shaped like real events. Each
+// benchmark reports the time and the number of heap allocations per call. Results can be saved,
+// and compared with a previous run to validate an optimisation before a full production pass.
+
+// Allocations are counted by replacing the global operator new. Only allocations made through
+// new are seen; this is the case for all C++ code, ROOT included.
+static uint64_t gAllocations = 0;
+
+void* operator new(size_t size) {
+  gAllocations++;
+  void* p = std::malloc(size ? size : 1);
+  if (! p)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+// Results are accumulated here, so that the compiler can't drop the benchmarked calls
+static volatile double gSink = 0;
+
+struct Benchmark {
+  std::string name;
+  std::function<void(uint64_t iterations)> run;
+};
+
+struct Result {
+  double ns;
+  double allocations;
+};
+
+// Inputs are drawn once, with the same spectra as the synthetic ntuples, then cycled through
+struct Inputs {
+  static const size_t SIZE = 4096;
+
+  std::vector<float> photonPt;
+  std::vector<float> secondJetPt;
+  std::vector<float> jetEta;
+  std::vector<int> ptBin;
+  std::vector<unsigned int> run;
+  std::vector<float> trueInteractions;
+  std::vector<float> response;
+
+  std::vector<std::vector<std::string>> triggerNames;
+  std::vector<std::vector<bool>> triggerResults;
+
+  Inputs() {
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> gauss(0, 1);
+    std::exponential_distribution<double> alpha(10.);
+
+    const char* menu[] = {
+      "HLT_Photon30_CaloIdVL_v1", "HLT_Photon30_CaloIdVL_IsoL_v1", "HLT_Photon50_CaloIdVL_IsoL_v1", "HLT_Photon75_CaloIdVL_IsoL_v1",
+      "HLT_Photon90_CaloIdVL_v1", "HLT_Photon90_CaloIdVL_IsoL_v1", "HLT_Photon135_v1", "HLT_Photon150_v1"
+    };
+    const float thresholds[] = { 30, 30, 50, 75, 90, 90, 135, 150 };
+
+    PtBinning ptBinning;
+    for (size_t i = 0; i < SIZE; i++) {
+      // Power law of index 3 between 40 and 2000 GeV
+      double a = std::pow(40., -2);
+      double b = std::pow(2000., -2);
+      float pt = std::pow(a + uniform(random) * (b - a), -0.5);
+
+      photonPt.push_back(pt);
+      secondJetPt.push_back(alpha(random) * pt);
+      jetEta.push_back(std::max(-4.7, std::min(4.7, 1.8 * gauss(random))));
+      ptBin.push_back(std::max(0, ptBinning.getPtBin(pt)));
+      run.push_back(190456 + static_cast<unsigned int>(uniform(random) * (208686 - 190456)));
+      trueInteractions.push_back(std::max(0., 20 + 4.5 * gauss(random)));
+      response.push_back(0.9 + 0.12 * gauss(random));
+
+      triggerNames.push_back(std::vector<std::string>(menu, menu + 8));
+      std::vector<bool> results;
+      for (float threshold: thresholds) {
+        results.push_back(pt * (1 + 0.05 * gauss(random)) > threshold);
+      }
+      triggerResults.push_back(results);
+    }
+  }
+};
+
+static Result measure(const Benchmark& benchmark, double minSeconds, int repeats) {
+  typedef std::chrono::steady_clock clock;
+
+  auto time = [&benchmark](uint64_t iterations) {
+    clock::time_point start = clock::now();
+    benchmark.run(iterations);
+    return std::chrono::duration<double>(clock::now() - start).count();
+  };
+
+  // Warm up, and find a number of iterations lasting at least minSeconds
+  uint64_t iterations = 1;
+  double seconds = time(iterations);
+  while (seconds < minSeconds / 10) {
+    iterations *= 10;
+    seconds = time(iterations);
+  }
+  iterations = std::max<uint64_t>(1, static_cast<uint64_t>(iterations * minSeconds / seconds));
+
+  // Best of several runs, less sensitive to the noise of the machine
+  Result result = { 0, 0 };
+  for (int i = 0; i < repeats; i++) {
+    uint64_t allocations = gAllocations;
+    double ns = time(iterations) * 1e9 / iterations;
+
+    if (i == 0) {
+      result.ns = ns;
+      result.allocations = static_cast<double>(gAllocations - allocations) / iterations;
+    } else {
+      result.ns = std::min(result.ns, ns);
+    }
+  }
+
+  return result;
+}
+
+static std::map<std::string, Result> readBaseline(const std::string& fileName) {
+  std::map<std::string, Result> baseline;
+
+  std::ifstream f(fileName.c_str());
+  std::string line;
+  while (std::getline(f, line)) {
+    // name <tab> ns/op <tab> allocations/op
+    size_t tab = line.find('\t');
+    if (line.empty() || line[0] == '#' || tab == std::string::npos)
+      continue;
+
+    Result result;
+    std::istringstream values(line.substr(tab + 1));
+    if (values >> result.ns >> result.allocations)
+      baseline[line.substr(0, tab)] = result;
+  }
+
+  return baseline;
+}
+
+int main(int argc, char** argv) {
+
+  try {
+    TCLAP::CmdLine cmd("Micro-benchmarks of the finalizer hot kernels", ' ', "0.1");
+
+    TCLAP::ValueArg<std::string> filterArg("", "filter", "Only run benchmarks whose name matches this regular expression", false, ".*", "string", cmd);
+    TCLAP::ValueArg<double> minTimeArg("", "min-time", "Minimal duration of each measurement, in seconds (default: 0.2)", false, 0.2, "float", cmd);
+    TCLAP::ValueArg<int> repeatArg("", "repeat", "Number of measurements per benchmark, the best one is kept (default: 5)", false, 5, "int", cmd);
+    TCLAP::ValueArg<std::string> triggersArg("", "triggers", "Data triggers configuration (default: triggers.xml)", false, "triggers.xml", "string", cmd);
+    TCLAP::ValueArg<std::string> mcTriggersArg("", "mc-triggers", "MC triggers configuration (default: triggers_mc.xml)", false, "triggers_mc.xml", "string", cmd);
+    TCLAP::ValueArg<std::string> saveArg("", "save", "Save results in this file, to be used later as a baseline", false, "", "string", cmd);
+    TCLAP::ValueArg<std::string> compareArg("", "compare", "Compare results with a baseline saved with --save. Exit with an error on regressions", false, "", "string", cmd);
+    TCLAP::ValueArg<double> toleranceArg("", "tolerance", "Slowdown allowed when comparing with a baseline, in percent (default: 10)", false, 10, "float", cmd);
+
+    cmd.parse(argc, argv);
+
+    std::map<std::string, Result> baseline;
+    if (compareArg.isSet()) {
+      baseline = readBaseline(compareArg.getValue());
+      if (baseline.empty()) {
+        std::cerr << MAKE_RED << "Error: no results in baseline '" << compareArg.getValue() << "'" << RESET_COLOR << std::endl;
+        return 1;
+      }
+    }
+
+    gROOT->SetBatch(true);
+
+    const Inputs inputs;
+    const size_t mask = Inputs::SIZE - 1;
+
+    PtBinning ptBinning;
+    EtaBinning etaBinning;
+    ExtrapBinning extrapBinning;
+    extrapBinning.initialize(ptBinning, "PFlow");
+
+    Triggers triggers(triggersArg.getValue());
+    bool hasTriggers = triggers.load();
+    MCTriggers mcTriggers(mcTriggersArg.getValue());
+    bool hasMCTriggers = mcTriggers.load();
+    CounterRandom random;
+
+    // Scratch files: a pileup profile for PUReweighter, and a directory for GaussianProfile
+    boost::filesystem::path tmp = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("microBenchmarks-%%%%%%%%");
+    const std::string pileupFile = tmp.string() + "_pileup.root";
+    const std::string profileFile = tmp.string() + "_profiles.root";
+    {
+      TFile f(pileupFile.c_str(), "recreate");
+      TH1D pileup("pileup", "pileup", 75, 0, 75);
+      for (int bin = 1; bin <= pileup.GetNbinsX(); bin++) {
+        pileup.SetBinContent(bin, TMath::PoissonI(bin - 1, 20));
+      }
+      pileup.Write();
+    }
+    PUReweighter reweighter(pileupFile);
+
+    std::unique_ptr<fwlite::TFileService> fs(new fwlite::TFileService(profileFile));
+    std::vector<double> ptEdges;
+    for (size_t i = 0; i < ptBinning.size(); i++) {
+      ptEdges.push_back(ptBinning.getBinValue(i).first);
+    }
+    ptEdges.push_back(ptBinning.getBinValue(ptBinning.size() - 1).second);
+
+    // Profiles write themselves in their directory when destroyed, so they must go before fs
+    std::unique_ptr<GaussianProfile> fillProfile(new GaussianProfile("fill", ptEdges.size() - 1, ptEdges.data(), 150, 0., 2.));
+    fillProfile->initialize(*fs);
+    std::unique_ptr<GaussianProfile> graphProfile(new GaussianProfile("graph", ptEdges.size() - 1, ptEdges.data(), 150, 0., 2.));
+    graphProfile->initialize(*fs);
+    for (size_t i = 0; i < 100 * Inputs::SIZE; i++) {
+      graphProfile->fill(inputs.photonPt[i & mask], inputs.response[i & mask]);
+    }
+
+    // Response distribution of one bin, as fitted by the draw programs
+    TH1F projection("projection", "projection", 100, 0., 2.);
+    projection.SetDirectory(NULL);
+    for (size_t i = 0; i < 20000; i++) {
+      projection.Fill(inputs.response[i & mask]);
+    }
+    TF1 gaussian("gaussian", "gaus", 0., 2.);
+
+    std::vector<Benchmark> benchmarks;
+
+    benchmarks.push_back({"PtBinning::getPtBin", [&](uint64_t n) {
+      int sum = 0;
+      for (uint64_t i = 0; i < n; i++) {
+        sum += ptBinning.getPtBin(inputs.photonPt[i & mask]);
+      }
+      gSink += sum;
+    }});
+
+    benchmarks.push_back({"EtaBinning::getBin", [&](uint64_t n) {
+      int sum = 0;
+      for (uint64_t i = 0; i < n; i++) {
+        sum += etaBinning.getBin(inputs.jetEta[i & mask]);
+      }
+      gSink += sum;
+    }});
+
+    benchmarks.push_back({"ExtrapBinning::getBin", [&](uint64_t n) {
+      int sum = 0;
+      for (uint64_t i = 0; i < n; i++) {
+        sum += extrapBinning.getBin(inputs.photonPt[i & mask], inputs.secondJetPt[i & mask], inputs.ptBin[i & mask]);
+      }
+      gSink += sum;
+    }});
+
+    if (hasTriggers) {
+      benchmarks.push_back({"Triggers::getTriggers", [&](uint64_t n) {
+        size_t sum = 0;
+        for (uint64_t i = 0; i < n; i++) {
+          const RunTriggers* runTriggers = triggers.getTriggers(inputs.run[i & mask]);
+          sum += (runTriggers) ? reinterpret_cast<size_t>(runTriggers->find(inputs.photonPt[i & mask])) : 0;
+        }
+        gSink += sum;
+      }});
+
+      benchmarks.push_back({"checkTrigger (data)", [&](uint64_t n) {
+        float sum = 0;
+        for (uint64_t i = 0; i < n; i++) {
+          const PathData* mandatoryTrigger = NULL;
+          size_t j = i & mask;
+          if (checkDataTrigger(triggers, inputs.run[j], inputs.photonPt[j], inputs.triggerNames[j], inputs.triggerResults[j], mandatoryTrigger) == TRIGGER_OK)
+            sum += mandatoryTrigger->second.weight;
+        }
+        gSink += sum;
+      }});
+    } else {
+      std::cerr << MAKE_RED << "Warning: can't load '" << triggersArg.getValue() << "'. Data trigger benchmarks are skipped." << RESET_COLOR << std::endl;
+    }
+
+    if (hasMCTriggers) {
+      benchmarks.push_back({"checkTrigger (MC)", [&](uint64_t n) {
+        size_t sum = 0;
+        for (uint64_t i = 0; i < n; i++) {
+          const MCTriggerRange* range = mcTriggers.find(inputs.photonPt[i & mask]);
+          if (range)
+            sum += range->sample(random.uniform(1, i >> 10, i)).name.size();
+        }
+        gSink += sum;
+      }});
+    } else {
+      std::cerr << MAKE_RED << "Warning: can't load '" << mcTriggersArg.getValue() << "'. MC trigger benchmarks are skipped." << RESET_COLOR << std::endl;
+    }
+
+    benchmarks.push_back({"PUReweighter::weight", [&](uint64_t n) {
+      double sum = 0;
+      for (uint64_t i = 0; i < n; i++) {
+        sum += reweighter.weight(inputs.trueInteractions[i & mask]);
+      }
+      gSink += sum;
+    }});
+
+    benchmarks.push_back({"GaussianProfile::fill", [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++) {
+        fillProfile->fill(inputs.photonPt[i & mask], inputs.response[i & mask]);
+      }
+    }});
+
+    // write() fits all bins again once the profile has changed
+    benchmarks.push_back({"GaussianProfile::createGraph", [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++) {
+        graphProfile->fill(inputs.photonPt[i & mask], inputs.response[i & mask]);
+        graphProfile->write();
+      }
+    }});
+
+    benchmarks.push_back({"fitTools::getTruncatedMeanAndRMS", [&](uint64_t n) {
+      float sum = 0;
+      for (uint64_t i = 0; i < n; i++) {
+        float mean, meanError, rms, rmsError;
+        fitTools::getTruncatedMeanAndRMS(&projection, mean, meanError, rms, rmsError);
+        sum += mean + rms;
+      }
+      gSink += sum;
+    }});
+
+    benchmarks.push_back({"fitTools::fitProjection", [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++) {
+        gaussian.SetParameters(projection.GetMaximum(), projection.GetMean(), projection.GetRMS());
+        fitTools::fitProjection(&projection, &gaussian);
+      }
+      gSink += gaussian.GetParameter(1);
+    }});
+
+    std::ofstream save;
+    if (saveArg.isSet()) {
+      save.open(saveArg.getValue().c_str());
+      save << "# name\tns/op\tallocations/op" << std::endl;
+    }
+
+    std::cout << std::left << std::setw(36) << "Benchmark" << std::right << std::setw(14) << "ns/op" << std::setw(12) << "allocs/op";
+    if (! baseline.empty())
+      std::cout << std::setw(16) << "baseline ns/op" << std::setw(10) << "change";
+    std::cout << std::endl;
+
+    boost::regex filter(filterArg.getValue());
+    int regressions = 0;
+    for (const Benchmark& benchmark: benchmarks) {
+      if (! boost::regex_search(benchmark.name, filter))
+        continue;
+
+      Result result = measure(benchmark, minTimeArg.getValue(), std::max(1, repeatArg.getValue()));
+
+      std::cout << std::left << std::setw(36) << benchmark.name << std::right << std::fixed
+        << std::setprecision(1) << std::setw(14) << result.ns << std::setprecision(2) << std::setw(12) << result.allocations;
+
+      auto it = baseline.find(benchmark.name);
+      if (it != baseline.end()) {
+        double change = 100. * (result.ns - it->second.ns) / it->second.ns;
+        // Allocation counts of ROOT calls vary slightly from run to run
+        bool moreAllocations = result.allocations > it->second.allocations + 0.5;
+        bool regression = change > toleranceArg.getValue() || moreAllocations;
+        regressions += regression;
+
+        std::cout << std::setprecision(1) << std::setw(16) << it->second.ns << ((regression) ? MAKE_RED : MAKE_BLUE)
+          << std::setw(9) << std::showpos << change << "%" << std::noshowpos << RESET_COLOR;
+        if (moreAllocations)
+          std::cout << MAKE_RED << " (more allocations)" << RESET_COLOR;
+      }
+      std::cout << std::endl;
+
+      if (save.is_open())
+        save << benchmark.name << "\t" << result.ns << "\t" << result.allocations << std::endl;
+    }
+
+    fillProfile.reset();
+    graphProfile.reset();
+    fs.reset();
+    std::remove(pileupFile.c_str());
+    std::remove(profileFile.c_str());
+
+    if (regressions > 0) {
+      std::cout << MAKE_RED << regressions << " regression(s) compared to '" << compareArg.getValue() << "'" << RESET_COLOR << std::endl;
+      return 1;
+    }
+
+  } catch (TCLAP::ArgException &e) {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,373 @@
+#include <TFile.h>
+#include <TH1D.h>
+#include <TLorentzVector.h>
+#include <TMath.h>
+#include <TParameter.h>
+#include <TVector2.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/regex.hpp>
+
+#include "tclap/CmdLine.h"
+
+#include "FWCore/FWLite/interface/AutoLibraryLoader.h"
+#include "PhysicsTools/FWLite/interface/TFileService.h"
+
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetEvent.h"
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetTreeWriter.h"
+
+#define RESET_COLOR "\033[m"
+#define MAKE_RED "\033[31m"
+#define MAKE_BLUE "\033[34m"
+
+// Write step 2 ntuples with random gamma + jet events, through the same GammaJetTreeWriter as
+// GammaJetFilter, so that gammaJetFinalizer can be run and benchmarked without grid access.
+// Physics is only realistic enough to exercise all the selection paths of the finalizer.
+
+// Default trigger menu, matching triggers.xml and triggers_mc.xml
+static const char* DEFAULT_MENU = "HLT_Photon30_CaloIdVL_v1,HLT_Photon30_CaloIdVL_IsoL_v1,HLT_Photon50_CaloIdVL_IsoL_v1,HLT_Photon75_CaloIdVL_IsoL_v1,"
+  "HLT_Photon90_CaloIdVL_v1,HLT_Photon90_CaloIdVL_IsoL_v1,HLT_Photon135_v1,HLT_Photon150_v1";
+
+struct MenuTrigger {
+  std::string name;
+  float threshold;
+};
+
+struct Options {
+  bool isMC;
+  uint64_t events;
+  std::vector<std::string> collections;
+  std::vector<MenuTrigger> menu;
+
+  float ptMin;
+  float ptMax;
+  float ptIndex;
+
+  float pileup;
+  unsigned int runFrom;
+  unsigned int runTo;
+};
+
+class Generator {
+  public:
+    Generator(const Options& options, uint64_t seed):
+      mOptions(options), mRandom(seed) {}
+
+    void generate(uint64_t index, GammaJetEvent& event);
+
+  private:
+    double uniform(double min, double max) {
+      return std::uniform_real_distribution<double>(min, max)(mRandom);
+    }
+
+    double gauss(double mean, double sigma) {
+      return std::normal_distribution<double>(mean, sigma)(mRandom);
+    }
+
+    bool chance(double probability) {
+      return uniform(0, 1) < probability;
+    }
+
+    // Falling power law spectrum between min and max
+    double powerLaw(double min, double max, double index) {
+      double a = std::pow(min, 1 - index);
+      double b = std::pow(max, 1 - index);
+      return std::pow(a + uniform(0, 1) * (b - a), 1 / (1 - index));
+    }
+
+    void setP4(ParticleData& particle, double pt, double eta, double phi, double mass = 0) {
+      TLorentzVector p4;
+      p4.SetPtEtaPhiM(pt, eta, phi, mass);
+
+      particle.is_present = 1;
+      particle.et = p4.Et();
+      particle.pt = p4.Pt();
+      particle.eta = p4.Eta();
+      particle.phi = p4.Phi();
+      particle.px = p4.Px();
+      particle.py = p4.Py();
+      particle.pz = p4.Pz();
+      particle.e = p4.E();
+    }
+
+    void generateJet(JetData& jet, JetData& rawJet, double rawPt, double eta, double phi, double rho);
+    void generateLeptons(LeptonsData& leptons, double probability, bool isMuon);
+
+    const Options& mOptions;
+    std::mt19937_64 mRandom;
+};
+
+void Generator::generateJet(JetData& jet, JetData& rawJet, double rawPt, double eta, double phi, double rho) {
+  double area = gauss(0.78, 0.05);
+
+  // L1 offset, then a relative correction rising at low pt and in the forward region
+  double offsetPt = std::max(1., rawPt - rho * area);
+  double correction = (1.05 + 0.3 / std::sqrt(offsetPt) + 0.02 * std::fabs(eta)) * offsetPt / rawPt;
+
+  setP4(rawJet, rawPt, eta, phi, 0.1 * rawPt);
+  setP4(jet, rawPt * correction, eta, phi, 0.1 * rawPt * correction);
+
+  rawJet.jet_area = jet.jet_area = area;
+
+  jet.btag_tc_high_eff = gauss(0, 2);
+  jet.btag_tc_high_pur = gauss(0, 2);
+  jet.btag_ssv_high_eff = (chance(0.1)) ? uniform(1, 5) : -1;
+  jet.btag_ssv_high_pur = (chance(0.05)) ? uniform(1, 5) : -1;
+  jet.btag_jet_probability = uniform(0, 2);
+  jet.btag_jet_b_probability = uniform(0, 6);
+  jet.btag_csv = uniform(0, 1);
+  jet.qg_tag_mlp = uniform(0, 1);
+  jet.qg_tag_likelihood = uniform(0, 1);
+}
+
+void Generator::generateLeptons(LeptonsData& leptons, double probability, bool isMuon) {
+  size_t n = (chance(probability)) ? 1 : 0;
+  leptons.resize(n);
+
+  for (size_t i = 0; i < n; i++) {
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(uniform(10, 50), uniform(-2.4, 2.4), uniform(-M_PI, M_PI), (isMuon) ? 0.106 : 0.0005);
+
+    leptons.id[i] = 1;
+    leptons.isolation[i] = uniform(0, 0.2);
+    leptons.delta_beta_isolation[i] = (isMuon) ? uniform(0, 0.2) : 0;
+    leptons.pt[i] = p4.Pt();
+    leptons.px[i] = p4.Px();
+    leptons.py[i] = p4.Py();
+    leptons.pz[i] = p4.Pz();
+    leptons.eta[i] = p4.Eta();
+    leptons.phi[i] = p4.Phi();
+    leptons.charge[i] = (chance(0.5)) ? 1 : -1;
+  }
+}
+
+void Generator::generate(uint64_t index, GammaJetEvent& event) {
+
+  // Pileup
+  AnalysisData& analysis = event.analysis;
+  analysis.ntrue_interactions = std::max(0., gauss(mOptions.pileup, std::sqrt(mOptions.pileup)));
+  analysis.nvertex = 1 + std::poisson_distribution<unsigned int>(std::max(0.01, 0.7 * analysis.ntrue_interactions))(mRandom);
+  analysis.pu_nvertex = (mOptions.isMC) ? static_cast<int>(analysis.ntrue_interactions) : -1;
+  double rho = std::max(0., gauss(1. + 0.5 * analysis.ntrue_interactions, 2.));
+
+  // Runs are spread evenly over the requested range, with 1000 events per lumi block
+  uint64_t runs = mOptions.runTo - mOptions.runFrom + 1;
+  analysis.run = mOptions.runFrom + (index * runs) / mOptions.events;
+  analysis.lumi_block = 1 + index / 1000;
+  analysis.event = index + 1;
+
+  analysis.event_weight = (mOptions.isMC) ? 1. / mOptions.events : 1.;
+  analysis.generator_weight = 1.;
+
+  // Photon
+  PhotonData& photon = event.photon;
+  double photonPt = powerLaw(mOptions.ptMin, mOptions.ptMax, mOptions.ptIndex);
+  double photonEta = uniform(-1.3, 1.3);
+  double photonPhi = uniform(-M_PI, M_PI);
+  setP4(photon, photonPt, photonEta, photonPhi);
+
+  bool isPrompt = chance(0.9);
+  photon.has_pixel_seed = chance(0.02);
+  photon.hasMatchedPromptElectron = photon.has_pixel_seed;
+  photon.rho = rho;
+  photon.hadTowOverEm = std::fabs(gauss(0, (isPrompt) ? 0.01 : 0.04));
+  photon.sigmaIetaIeta = gauss((isPrompt) ? 0.009 : 0.012, 0.001);
+  photon.chargedHadronsIsolation = std::fabs(gauss(0, (isPrompt) ? 0.3 : 3));
+  photon.neutralHadronsIsolation = std::fabs(gauss(0, (isPrompt) ? 1 : 10)) + 0.04 * photonPt;
+  photon.photonIsolation = std::fabs(gauss(0, (isPrompt) ? 0.5 : 5)) + 0.005 * photonPt;
+
+  if (mOptions.isMC)
+    setP4(event.genPhoton, photonPt * gauss(1, 0.01), photonEta, photonPhi);
+
+  // Triggers. Every path of the menu is stored, and fires above its threshold
+  analysis.trigger_names.clear();
+  analysis.trigger_results.clear();
+  for (const MenuTrigger& trigger: mOptions.menu) {
+    analysis.trigger_names.push_back(trigger.name);
+    analysis.trigger_results.push_back(photonPt * gauss(1, 0.05) > trigger.threshold);
+  }
+
+  generateLeptons(event.muons, 0.01, true);
+  generateLeptons(event.electrons, 0.02, false);
+
+  // Jets. The same event is seen by all jet collections, with slightly different responses
+  event.jets.resize(mOptions.collections.size());
+
+  double alpha = std::exponential_distribution<double>(10.)(mRandom);
+  double firstPhi = TVector2::Phi_mpi_pi(photonPhi + M_PI + gauss(0, 0.1));
+  double firstEta = std::max(-4.7, std::min(4.7, gauss(0, 1.8)));
+  double secondPhi = uniform(-M_PI, M_PI);
+  double secondEta = std::max(-4.7, std::min(4.7, gauss(0, 2.2)));
+  bool hasSecondJet = chance(0.9);
+
+  for (JetCollectionData& data: event.jets) {
+    data = JetCollectionData();
+    data.rho = rho;
+
+    double response = std::max(0.2, gauss(0.9, 0.12));
+    double firstRawPt = photonPt * response;
+    double secondRawPt = std::max(5., alpha * photonPt * response);
+
+    generateJet(data.firstJet, data.firstRawJet, firstRawPt, firstEta, firstPhi, rho);
+    if (hasSecondJet)
+      generateJet(data.secondJet, data.secondRawJet, secondRawPt, secondEta, secondPhi, rho);
+
+    // Raw MET balances the photon and the raw jets, up to the resolution
+    TVector2 rawMet(-photon.px - data.firstRawJet.px - data.secondRawJet.px + gauss(0, 10), -photon.py - data.firstRawJet.py - data.secondRawJet.py + gauss(0, 10));
+    TVector2 met = rawMet - TVector2(data.firstJet.px - data.firstRawJet.px + data.secondJet.px - data.secondRawJet.px, data.firstJet.py - data.firstRawJet.py + data.secondJet.py - data.secondRawJet.py);
+    setP4(data.rawMet, rawMet.Mod(), 0, rawMet.Phi());
+    setP4(data.met, met.Mod(), 0, met.Phi());
+
+    if (mOptions.isMC) {
+      setP4(data.firstGenJet, firstRawPt / response * gauss(1, 0.02), firstEta, firstPhi);
+      data.firstGenJet.parton_flavour = data.firstGenJet.parton_pdg_id = (chance(0.7)) ? 21 : 1 + mRandom() % 5;
+      data.firstGenJet.parton_p4.SetPtEtaPhiM(data.firstGenJet.pt, firstEta, firstPhi, 0);
+
+      if (hasSecondJet) {
+        setP4(data.secondGenJet, secondRawPt / response, secondEta, secondPhi);
+        data.secondGenJet.parton_flavour = data.secondGenJet.parton_pdg_id = 21;
+        data.secondGenJet.parton_p4.SetPtEtaPhiM(data.secondGenJet.pt, secondEta, secondPhi, 0);
+      }
+
+      setP4(data.genMet, std::fabs(gauss(0, 5)), 0, uniform(-M_PI, M_PI));
+    }
+
+    JetSelectionMonitoring& monitoring = data.monitoring;
+    monitoring.hasFirstGoodJet = true;
+    monitoring.firstGoodJetDeltaPhi = std::fabs(TVector2::Phi_mpi_pi(firstPhi - photonPhi));
+    monitoring.firstGoodJetDeltaR = std::sqrt(std::pow(firstEta - photonEta, 2) + std::pow(monitoring.firstGoodJetDeltaPhi, 2));
+    monitoring.firstGoodJetDeltaPt = std::fabs(data.firstJet.pt - photonPt);
+    monitoring.selectedFirstJetIndex = 0;
+    monitoring.selectedFirstJetDeltaPhi = monitoring.firstGoodJetDeltaPhi;
+    monitoring.selectedFirstJetDeltaR = monitoring.firstGoodJetDeltaR;
+  }
+}
+
+// Data pileup profiles, named as gammaJetFinalizer expects them for each path of the menu
+bool writePUProfiles(const std::string& dir, const Options& options) {
+  TH1D profile("pileup", "pileup", 75, 0, 75);
+  for (int bin = 1; bin <= profile.GetNbinsX(); bin++) {
+    profile.SetBinContent(bin, TMath::PoissonI(bin - 1, options.pileup));
+  }
+
+  boost::regex version("_v[0-9]+$");
+  for (const MenuTrigger& trigger: options.menu) {
+    std::string name = boost::regex_replace(trigger.name, version, "");
+    std::string fileName = dir + "/pu_truth_data_photon_2012_true_" + name + "_75bins.root";
+
+    TFile* f = TFile::Open(fileName.c_str(), "recreate");
+    if (! f || f->IsZombie()) {
+      std::cerr << MAKE_RED << "Error: can't create '" << fileName << "'" << RESET_COLOR << std::endl;
+      delete f;
+      return false;
+    }
+
+    f->WriteTObject(&profile);
+    f->Close();
+    delete f;
+  }
+
+  return true;
+}
+
+int main(int argc, char** argv) {
+
+  try {
+    TCLAP::CmdLine cmd("Generate synthetic step 2 ntuples, for gammaJetFinalizer benchmarks", ' ', "0.1");
+
+    TCLAP::ValueArg<std::string> outputArg("o", "output", "Output file", false, "PhotonJet_2ndLevel_synthetic.root", "string", cmd);
+    TCLAP::ValueArg<uint64_t> eventsArg("n", "events", "Number of events", false, 100000, "int", cmd);
+    TCLAP::SwitchArg mcArg("", "mc", "Generate MC ntuples, with gen trees", cmd);
+    TCLAP::ValueArg<std::string> collectionsArg("", "collections", "Comma separated list of jet collections (default: PFlowAK5chs)", false, "PFlowAK5chs", "string", cmd);
+    TCLAP::ValueArg<std::string> menuArg("", "menu", "Comma separated list of trigger paths, with their threshold in the name (default: 2012 photon paths)", false, DEFAULT_MENU, "string", cmd);
+    TCLAP::ValueArg<float> ptMinArg("", "pt-min", "Minimal photon pt (default: 40)", false, 40, "float", cmd);
+    TCLAP::ValueArg<float> ptMaxArg("", "pt-max", "Maximal photon pt (default: 2000)", false, 2000, "float", cmd);
+    TCLAP::ValueArg<float> ptIndexArg("", "pt-index", "Index of the photon pt power law (default: 3)", false, 3, "float", cmd);
+    TCLAP::ValueArg<float> pileupArg("", "pileup", "Mean number of true interactions (default: 20)", false, 20, "float", cmd);
+    TCLAP::ValueArg<std::string> runsArg("", "runs", "Run range, as from:to (default: 190456:208686 for data, 1:1 for MC)", false, "", "string", cmd);
+    TCLAP::ValueArg<double> lumiArg("", "lumi", "Integrated luminosity, in pb^-1 (default: 19700)", false, 19700, "float", cmd);
+    TCLAP::ValueArg<std::string> puProfilesArg("", "pu-profiles", "Also write data pileup profiles for each path in this directory, for MC reweighting", false, "", "string", cmd);
+    TCLAP::ValueArg<uint64_t> seedArg("", "seed", "Random seed (default: 1)", false, 1, "int", cmd);
+
+    cmd.parse(argc, argv);
+
+    Options options;
+    options.isMC = mcArg.getValue();
+    options.events = eventsArg.getValue();
+    options.ptMin = ptMinArg.getValue();
+    options.ptMax = ptMaxArg.getValue();
+    options.ptIndex = ptIndexArg.getValue();
+    options.pileup = std::max(0.f, pileupArg.getValue());
+
+    if (options.events == 0 || options.ptMin <= 0 || options.ptMax <= options.ptMin || options.ptIndex == 1) {
+      std::cerr << MAKE_RED << "Error: invalid number of events or pt spectrum" << RESET_COLOR << std::endl;
+      return 1;
+    }
+
+    boost::split(options.collections, collectionsArg.getValue(), boost::is_any_of(","), boost::token_compress_on);
+
+    std::vector<std::string> names;
+    boost::split(names, menuArg.getValue(), boost::is_any_of(","), boost::token_compress_on);
+    boost::regex threshold("Photon([0-9]+)");
+    for (const std::string& name: names) {
+      boost::smatch match;
+      if (! boost::regex_search(name, match, threshold)) {
+        std::cerr << MAKE_RED << "Error: no threshold in trigger path '" << name << "'" << RESET_COLOR << std::endl;
+        return 1;
+      }
+
+      options.menu.push_back({name, std::stof(match[1].str())});
+    }
+
+    options.runFrom = (options.isMC) ? 1 : 190456;
+    options.runTo = (options.isMC) ? 1 : 208686;
+    if (runsArg.isSet() && (sscanf(runsArg.getValue().c_str(), "%u:%u", &options.runFrom, &options.runTo) != 2 || options.runTo < options.runFrom)) {
+      std::cerr << MAKE_RED << "Error: invalid run range '" << runsArg.getValue() << "'" << RESET_COLOR << std::endl;
+      return 1;
+    }
+
+    if (puProfilesArg.isSet() && ! writePUProfiles(puProfilesArg.getValue(), options))
+      return 1;
+
+    AutoLibraryLoader::enable();
+
+    {
+      fwlite::TFileService fs(outputArg.getValue());
+      TFileDirectory dir = fs.mkdir("gammaJet");
+
+      // Luminosity is stored in µb^-1
+      dir.make<TParameter<double>>("total_luminosity", (options.isMC) ? 0. : lumiArg.getValue() * 1e6);
+
+      GammaJetTreeWriter writer(dir, options.collections, options.isMC, false);
+
+      dir.make<TParameter<long long>>("total_events", options.events);
+      dir.make<TParameter<long long>>("passed_events", options.events);
+
+      Generator generator(options, seedArg.getValue());
+      GammaJetEvent event;
+      for (uint64_t i = 0; i < options.events; i++) {
+        if (i % 100000 == 0)
+          std::cout << "Generating event #" << (i + 1) << " of " << options.events << std::endl;
+
+        generator.generate(i, event);
+        writer.write(event);
+      }
+    }
+
+    std::cout << "Written " << MAKE_BLUE << options.events << RESET_COLOR << " events in '" << outputArg.getValue() << "'" << std::endl;
+
+  } catch (TCLAP::ArgException &e) {
+    std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -1,14 +1,53 @@
 #include <iostream>
 #include <string>
-#include <exception>
-#include <cassert>
+#include <algorithm>
 
 #include "tinyxml2.h"
 
 #include "triggers.h"
 
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+
 using namespace tinyxml2;
 
+namespace {
+  const char TRIGGERS_MAGIC[8] = {'G', 'J', 'T', 'R', 'I', 'G', 'D', 'T'};
+  const char MC_TRIGGERS_MAGIC[8] = {'G', 'J', 'T', 'R', 'I', 'G', 'M', 'C'};
+  const uint32_t VERSION = 1;
+
+  bool hashFile(const std::string& fileName, uint64_t& hash) {
+    BinaryCache::MappedFile file(fileName);
+    if (! file.isValid())
+      return false;
+
+    hash = file.hash();
+    return true;
+  }
+
+  template<typename T> bool loadTriggers(T& triggers, const std::string& xmlFile) {
+    uint64_t hash = 0;
+    if (hashFile(xmlFile, hash) && triggers.read(compiledFileName(xmlFile), hash)) {
+      std::cout << "Using compiled configuration '" << compiledFileName(xmlFile) << "'" << std::endl;
+      return true;
+    }
+
+    return triggers.parse();
+  }
+
+  template<typename T> bool compileTriggers(T& triggers, const std::string& xmlFile) {
+    uint64_t hash = 0;
+    if (! triggers.parse() || ! hashFile(xmlFile, hash))
+      return false;
+
+    if (! triggers.write(compiledFileName(xmlFile), hash)) {
+      std::cout << "Error: failed to write '" << compiledFileName(xmlFile) << "'" << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+}
+
 bool Triggers::parse() {
   XMLDocument doc;
   if (doc.LoadFile(mXmlFile.c_str())) {
@@ -20,18 +59,33 @@ bool Triggers::parse() {
   if (! root)
     return false;
 
+  mTriggers.clear();
+
   const XMLElement* runs = root->FirstChildElement("runs");
   for (; runs; runs = runs->NextSiblingElement("runs")) {
     parseRunsElement(runs);
   }
 
+  std::sort(mTriggers.begin(), mTriggers.end(), [] (const RunTriggers& a, const RunTriggers& b) {
+      return a.runs < b.runs;
+  });
+
+  for (size_t i = 1; i < mTriggers.size(); i++) {
+    if (mTriggers[i].runs.from() <= mTriggers[i - 1].runs.to()) {
+      std::cout << "Error: run ranges " << mTriggers[i - 1].runs << " and " << mTriggers[i].runs << " overlap in " << mXmlFile << std::endl;
+      return false;
+    }
+  }
+
+  buildIndexes();
+
   return true;
 }
 
 bool Triggers::parseRunsElement(const XMLElement* runs) {
   Range<unsigned> runRange(runs->UnsignedAttribute("from"), runs->UnsignedAttribute("to"));
 
-  PathVector runPaths;
+  RunTriggers runTriggers { runRange, PathVector(), RangeIndex<float>() };
 
   const XMLElement* paths = runs->FirstChildElement("path");
   for (; paths; paths = paths->NextSiblingElement("path")) {
@@ -45,70 +99,106 @@ bool Triggers::parseRunsElement(const XMLElement* runs) {
 
     Trigger t { ptRange, weight };
 
-    runPaths.push_back(std::make_pair(boost::regex(name, boost::regex_constants::icase), t));
+    runTriggers.paths.push_back(std::make_pair(boost::regex(name, boost::regex_constants::icase), t));
   }
 
-  mTriggers[runRange] = runPaths;
+  mTriggers.push_back(runTriggers);
   return true;
 }
 
-const PathVector& Triggers::getTriggers(unsigned int run) {
-  if (mCachedRange && mCachedRange->in(run)) {
-    return *mCachedVector;
+void Triggers::buildIndexes() {
+  std::vector<Range<unsigned int>> runRanges;
+  for (RunTriggers& triggers: mTriggers) {
+    std::vector<Range<float>> ptRanges;
+    for (const PathData& path: triggers.paths) {
+      ptRanges.push_back(path.second.range);
+    }
+
+    triggers.ptIndex.build(ptRanges);
+    runRanges.push_back(triggers.runs);
   }
 
-  for (auto& trigger: mTriggers) {
-    const Range<unsigned int>& runRange = trigger.first;
+  mRunIndex.build(runRanges);
+}
 
-    if (runRange.in(run)) {
+bool Triggers::load() {
+  return loadTriggers(*this, mXmlFile);
+}
 
-      mCachedRange = &runRange;
-      mCachedVector = &trigger.second;
+bool Triggers::compile() {
+  return compileTriggers(*this, mXmlFile);
+}
 
-      return *mCachedVector;
-    }
-  }
+bool Triggers::read(const std::string& fileName, uint64_t sourceHash) {
+  BinaryCache::MappedFile file(fileName);
+  if (! file.isValid())
+    return false;
 
-  std::cout << "Error: run " << run << " not found for triggers selection" << std::endl;
-  assert(false);
-}
+  BinaryCache::Reader reader(file.begin(), file.end());
 
-/*const Regexp& Triggers::getHLTPath(unsigned int run, float pt) {
-  const PathVector* paths = NULL;
-  if (mCachedRange && mCachedRange->in(run)) {
-    paths = mCachedVector;
-  } else {
-    for (auto& trigger: mTriggers) {
-      const Range<unsigned int>& runRange = trigger.first;
+  BinaryCache::Header header;
+  if (! reader.readHeader(TRIGGERS_MAGIC, VERSION, header) || header.sourceHash != sourceHash)
+    return false;
 
-      if (runRange.in(run)) {
-        mCachedRange = &runRange;
-        mCachedVector = &trigger.second;
-        paths = mCachedVector;
-        break;
-      }
+  std::vector<RunTriggers> triggers;
+  for (uint32_t i = 0; i < header.count && reader.ok(); i++) {
+    uint32_t runFrom = 0, runTo = 0, nPaths = 0;
+    reader.read(runFrom);
+    reader.read(runTo);
+    reader.read(nPaths);
+
+    RunTriggers runTriggers { Range<unsigned int>(runFrom, runTo), PathVector(), RangeIndex<float>() };
+    for (uint32_t j = 0; j < nPaths && reader.ok(); j++) {
+      std::string name;
+      float ptFrom = 0, ptTo = 0, weight = 0;
+      reader.read(name);
+      reader.read(ptFrom);
+      reader.read(ptTo);
+      reader.read(weight);
+
+      Trigger t { Range<float>(ptFrom, ptTo), weight };
+      runTriggers.paths.push_back(std::make_pair(boost::regex(name, boost::regex_constants::icase), t));
     }
-  }
 
-  if (! paths) {
-    throw new std::exception();
+    triggers.push_back(runTriggers);
   }
 
-  for (auto& path: *paths) {
-    const Range<float>& ptRange = path.second;
-    if (ptRange.in(pt)) {
-      return path.first;
+  if (! reader.ok())
+    return false;
+
+  mTriggers.swap(triggers);
+  buildIndexes();
+
+  return true;
+}
+
+bool Triggers::write(const std::string& fileName, uint64_t sourceHash) const {
+  std::string tmpFileName;
+  FILE* f = BinaryCache::create(fileName, tmpFileName);
+  if (! f)
+    return false;
+
+  bool ok = BinaryCache::writeHeader(f, TRIGGERS_MAGIC, VERSION, mTriggers.size(), sourceHash);
+  for (const RunTriggers& triggers: mTriggers) {
+    ok = ok && BinaryCache::write<uint32_t>(f, triggers.runs.from());
+    ok = ok && BinaryCache::write<uint32_t>(f, triggers.runs.to());
+    ok = ok && BinaryCache::write<uint32_t>(f, triggers.paths.size());
+
+    for (const PathData& path: triggers.paths) {
+      ok = ok && BinaryCache::write(f, path.first.str());
+      ok = ok && BinaryCache::write(f, path.second.range.from());
+      ok = ok && BinaryCache::write(f, path.second.range.to());
+      ok = ok && BinaryCache::write(f, path.second.weight);
     }
   }
 
-  throw new std::exception(); // Not found
-}*/
-
+  return BinaryCache::commit(f, tmpFileName, fileName, ok);
+}
 
 void Triggers::print() {
   for (auto& trigger: mTriggers) {
-    const Range<unsigned int>& runRange = trigger.first;
-    const auto& paths = trigger.second;
+    const Range<unsigned int>& runRange = trigger.runs;
+    const auto& paths = trigger.paths;
 
     std::cout << "Runs: " << runRange << std::endl;
     for (auto& path: paths) {
@@ -131,15 +221,25 @@ bool MCTriggers::parse() {
   if (! root)
     return false;
 
+  std::map<Range<float>, std::vector<MCTrigger>> triggers;
+
   const XMLElement* path = root->FirstChildElement("path");
   for (; path; path = path->NextSiblingElement("path")) {
-    parsePathElement(path);
+    parsePathElement(path, triggers);
+  }
+
+  mTriggers.clear();
+  for (auto& trigger: triggers) {
+    MCTriggerRange range { trigger.first, trigger.second, std::vector<double>() };
+    mTriggers.push_back(range);
   }
 
+  buildIndexes();
+
   return true;
 }
 
-bool MCTriggers::parsePathElement(const XMLElement* path) {
+bool MCTriggers::parsePathElement(const XMLElement* path, std::map<Range<float>, std::vector<MCTrigger>>& triggers) {
 
   // Parse pt
   const XMLElement* pt = path->FirstChildElement("pt");
@@ -153,16 +253,137 @@ bool MCTriggers::parsePathElement(const XMLElement* path) {
     name->QueryDoubleAttribute("weight", &weight);
 
     MCTrigger t {boost::regex(n, boost::regex_constants::icase), weight};
-    mTriggers[ptRange].push_back(t);
+    triggers[ptRange].push_back(t);
+  }
+
+  return true;
+}
+
+void MCTriggers::buildIndexes() {
+  std::vector<Range<float>> ranges;
+  for (MCTriggerRange& range: mTriggers) {
+    range.cumulativeWeights.clear();
+
+    double sum = 0;
+    for (const MCTrigger& t: range.triggers) {
+      sum += t.weight;
+      range.cumulativeWeights.push_back(sum);
+    }
+
+    for (double& weight: range.cumulativeWeights) {
+      weight /= sum;
+    }
+    range.cumulativeWeights.back() = 1.;
+
+    ranges.push_back(range.range);
+  }
+
+  // When ranges overlap, the one with the highest lower bound wins
+  mIndex.build(ranges);
+}
+
+bool MCTriggers::load() {
+  return loadTriggers(*this, mXmlFile);
+}
+
+bool MCTriggers::compile() {
+  return compileTriggers(*this, mXmlFile);
+}
+
+bool MCTriggers::read(const std::string& fileName, uint64_t sourceHash) {
+  BinaryCache::MappedFile file(fileName);
+  if (! file.isValid())
+    return false;
+
+  BinaryCache::Reader reader(file.begin(), file.end());
+
+  BinaryCache::Header header;
+  if (! reader.readHeader(MC_TRIGGERS_MAGIC, VERSION, header) || header.sourceHash != sourceHash)
+    return false;
+
+  std::vector<MCTriggerRange> triggers;
+  for (uint32_t i = 0; i < header.count && reader.ok(); i++) {
+    float ptFrom = 0, ptTo = 0;
+    uint32_t nTriggers = 0;
+    reader.read(ptFrom);
+    reader.read(ptTo);
+    reader.read(nTriggers);
+
+    MCTriggerRange range { Range<float>(ptFrom, ptTo), std::vector<MCTrigger>(), std::vector<double>() };
+    for (uint32_t j = 0; j < nTriggers && reader.ok(); j++) {
+      std::string name;
+      double weight = 0;
+      reader.read(name);
+      reader.read(weight);
+
+      MCTrigger t {boost::regex(name, boost::regex_constants::icase), weight};
+      range.triggers.push_back(t);
+    }
+
+    // Ranges without any trigger can't be sampled
+    if (range.triggers.empty())
+      return false;
+
+    triggers.push_back(range);
   }
 
+  if (! reader.ok())
+    return false;
+
+  mTriggers.swap(triggers);
+  buildIndexes();
+
   return true;
 }
 
+bool MCTriggers::write(const std::string& fileName, uint64_t sourceHash) const {
+  std::string tmpFileName;
+  FILE* f = BinaryCache::create(fileName, tmpFileName);
+  if (! f)
+    return false;
+
+  bool ok = BinaryCache::writeHeader(f, MC_TRIGGERS_MAGIC, VERSION, mTriggers.size(), sourceHash);
+  for (const MCTriggerRange& range: mTriggers) {
+    ok = ok && BinaryCache::write(f, range.range.from());
+    ok = ok && BinaryCache::write(f, range.range.to());
+    ok = ok && BinaryCache::write<uint32_t>(f, range.triggers.size());
+
+    for (const MCTrigger& t: range.triggers) {
+      ok = ok && BinaryCache::write(f, t.name.str());
+      ok = ok && BinaryCache::write(f, t.weight);
+    }
+  }
+
+  return BinaryCache::commit(f, tmpFileName, fileName, ok);
+}
+
+int checkDataTrigger(const Triggers& triggers, unsigned int run, float pt, const std::vector<std::string>& names, const std::vector<bool>& results, const PathData*& mandatoryTrigger) {
+  mandatoryTrigger = NULL;
+
+  const RunTriggers* runTriggers = triggers.getTriggers(run);
+  if (! runTriggers)
+    return TRIGGER_RUN_NOT_FOUND;
+
+  mandatoryTrigger = runTriggers->find(pt);
+  if (! mandatoryTrigger)
+    return TRIGGER_NOT_FOUND;
+
+  // This photon must pass mandatoryTrigger->first
+  for (int i = names.size() - 1; i >= 0; i--) {
+    if (! results[i])
+      continue;
+
+    if (boost::regex_match(names[i], mandatoryTrigger->first))
+      return TRIGGER_OK;
+  }
+
+  return TRIGGER_NOT_FOUND;
+}
+
 void MCTriggers::print() {
   for (auto& trigger: mTriggers) {
-    const Range<float>& ptRange = trigger.first;
-    const auto& paths = trigger.second;
+    const Range<float>& ptRange = trigger.range;
+    const auto& paths = trigger.triggers;
 
     std::cout << "Pt range: " << ptRange << std::endl;
     for (auto& path: paths) {
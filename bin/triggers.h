@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -50,6 +53,56 @@ struct Trigger {
   float weight;
 };
 
+/**
+ * Direct index over a list of closed ranges, which may overlap. When several ranges contain a
+ * value, the last one of the list wins.
+ *
+ * All range boundaries are sorted into an edge table; for each edge, the winning range is
+ * precomputed both on the edge itself and between this edge and the next one. find() is
+ * then a single binary search.
+ */
+template<typename T>
+class RangeIndex {
+  public:
+    void build(const std::vector<Range<T>>& ranges) {
+      mEdges.clear();
+      for (const Range<T>& range: ranges) {
+        mEdges.push_back(range.from());
+        mEdges.push_back(range.to());
+      }
+
+      std::sort(mEdges.begin(), mEdges.end());
+      mEdges.erase(std::unique(mEdges.begin(), mEdges.end()), mEdges.end());
+
+      mOnEdge.assign(mEdges.size(), -1);
+      mAfterEdge.assign(mEdges.size(), -1);
+
+      for (size_t i = 0; i < mEdges.size(); i++) {
+        for (size_t r = 0; r < ranges.size(); r++) {
+          if (ranges[r].in(mEdges[i]))
+            mOnEdge[i] = r;
+
+          if (i + 1 < mEdges.size() && ranges[r].from() <= mEdges[i] && ranges[r].to() >= mEdges[i + 1])
+            mAfterEdge[i] = r;
+        }
+      }
+    }
+
+    // Index of the range containing value, or -1
+    int find(T value) const {
+      if (mEdges.empty() || value < mEdges.front() || value > mEdges.back())
+        return -1;
+
+      size_t i = std::upper_bound(mEdges.begin(), mEdges.end(), value) - mEdges.begin() - 1;
+      return (mEdges[i] == value) ? mOnEdge[i] : mAfterEdge[i];
+    }
+
+  private:
+    std::vector<T> mEdges;
+    std::vector<int> mOnEdge;
+    std::vector<int> mAfterEdge;
+};
+
 template<typename T>
 std::ostream& operator<<(std::ostream& stream, const Range<T>& range)
 {
@@ -61,25 +114,58 @@ std::ostream& operator<<(std::ostream& stream, const Range<T>& range)
 typedef std::pair<boost::regex, Trigger> PathData;
 typedef std::vector<PathData> PathVector;
 
+/**
+ * Trigger paths of one run range. When photon pt ranges overlap, the last path of the
+ * configuration wins.
+ */
+struct RunTriggers {
+  Range<unsigned int> runs;
+  PathVector paths;
+  RangeIndex<float> ptIndex;
+
+  // Path to check for this photon pt, or NULL if pt is outside of all ranges
+  const PathData* find(float pt) const {
+    int index = ptIndex.find(pt);
+    return (index < 0) ? NULL : &paths[index];
+  }
+};
+
 class Triggers {
   public:
     Triggers(const std::string& xmlFile):
-      mXmlFile(xmlFile), mCachedRange(NULL), mCachedVector(NULL) {}
+      mXmlFile(xmlFile) {}
 
     bool parse();
     void print();
 
-    //const boost::regex& getHLTPath(unsigned int run, float pt);
-    const PathVector& getTriggers(unsigned int run);
+    /**
+     * Use the compiled configuration (see compileConfig) if it's up to date with the XML
+     * file, parse the XML file otherwise.
+     */
+    bool load();
+
+    // Parse the XML file, then write the compiled configuration next to it
+    bool compile();
+
+    // Compiled configuration. read() fails if it was not compiled from this version of the XML file
+    bool read(const std::string& fileName, uint64_t sourceHash);
+    bool write(const std::string& fileName, uint64_t sourceHash) const;
+
+    // Trigger paths valid for this run, or NULL if the run is not covered by the configuration
+    const RunTriggers* getTriggers(unsigned int run) const {
+      int index = mRunIndex.find(run);
+      return (index < 0) ? NULL : &mTriggers[index];
+    }
 
   private:
     std::string mXmlFile;
-    std::map<Range<unsigned int>, PathVector> mTriggers;
 
-    const Range<unsigned int>* mCachedRange;
-    const PathVector* mCachedVector;
+    // Sorted by run, without overlap
+    std::vector<RunTriggers> mTriggers;
+    RangeIndex<unsigned int> mRunIndex;
 
     bool parseRunsElement(const tinyxml2::XMLElement* runs);
+    void buildIndexes();
 };
 
 struct MCTrigger {
@@ -87,6 +173,22 @@ struct MCTrigger {
   double weight;
 };
 
+/**
+ * Triggers emulated in MC for one photon pt range. Weights are compiled into a normalized
+ * cumulative table, whose last entry is exactly 1.
+ */
+struct MCTriggerRange {
+  Range<float> range;
+  std::vector<MCTrigger> triggers;
+  std::vector<double> cumulativeWeights;
+
+  // Choose a trigger according to the weights, random being uniform in [0, 1]
+  const MCTrigger& sample(double random) const {
+    size_t i = std::lower_bound(cumulativeWeights.begin(), cumulativeWeights.end(), random) - cumulativeWeights.begin();
+    return triggers[std::min(i, triggers.size() - 1)];
+  }
+};
+
 class MCTriggers {
   public:
     MCTriggers(const std::string& xmlFile):
@@ -95,14 +197,40 @@ class MCTriggers {
     bool parse();
     void print();
 
-    //const boost::regex& getHLTPath(unsigned int run, float pt);
-    const std::map<Range<float>, std::vector<MCTrigger>>& getTriggers() {
-      return mTriggers;
+    // Same as Triggers
+    bool load();
+    bool compile();
+    bool read(const std::string& fileName, uint64_t sourceHash);
+    bool write(const std::string& fileName, uint64_t sourceHash) const;
+
+    // Triggers for this photon pt, or NULL if pt is outside of all ranges
+    const MCTriggerRange* find(float pt) const {
+      int index = mIndex.find(pt);
+      return (index < 0) ? NULL : &mTriggers[index];
     }
 
   private:
     std::string mXmlFile;
-    std::map<Range<float>, std::vector<MCTrigger>> mTriggers;
+    std::vector<MCTriggerRange> mTriggers;
+    RangeIndex<float> mIndex;
 
-    bool parsePathElement(const tinyxml2::XMLElement* path);
+    bool parsePathElement(const tinyxml2::XMLElement* path, std::map<Range<float>, std::vector<MCTrigger>>& triggers);
+    void buildIndexes();
 };
+
+#define TRIGGER_OK                    0
+#define TRIGGER_NOT_FOUND            -1
+#define TRIGGER_FOUND_BUT_PT_OUT     -2
+#define TRIGGER_RUN_NOT_FOUND        -3
+
+/**
+ * Data trigger decision: with the photon pt, find the path this event must have fired, then look
+ * for it in the list of fired paths. mandatoryTrigger is set as soon as the path is known, even if
+ * the event did not fire it. Returns one of the TRIGGER_* codes.
+ */
+int checkDataTrigger(const Triggers& triggers, unsigned int run, float pt, const std::vector<std::string>& names, const std::vector<bool>& results, const PathData*& mandatoryTrigger);
+
+// Name of the compiled version of a configuration file
+inline std::string compiledFileName(const std::string& fileName) {
+  return fileName + ".bin";
+}
@@ -283,7 +283,13 @@ def createProcess(runOnMC, runCHS, correctMETWithT1, processCaloJets, globalTag)
   # Add our PhotonIsolationProducer to the analysisSequence. This producer compute pf isolations
   # for our photons
   process.photonPFIsolation = cms.EDProducer("PhotonIsolationProducer",
-      src = cms.InputTag("selectedPatPhotons")
+      src = cms.InputTag("selectedPatPhotons"),
+
+      # Isolation is only computed for photons which can pass the GammaJetFilter photon ID.
+      # Must be looser or equal to the cuts applied in GammaJetFilter
+      preselectionMaxAbsEta = cms.untracked.double(1.3),
+      preselectionMaxHadTowOverEm = cms.untracked.double(0.05),
+      preselectionMaxSigmaIetaIeta = cms.untracked.double(0.011)
       )
 
   process.analysisSequence *= process.photonPFIsolation
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Small helpers shared by the binary sidecar files (compiled lumi mask, lumi by LS table,
+ * compiled finalizer configuration).
+ *
+ * Every sidecar starts with a BinaryCache::Header. The source hash is a FNV-1a hash of the
+ * original text file, so a stale sidecar is never silently used.
+ */
+
+namespace BinaryCache {
+
+  struct Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t sourceHash;
+  };
+
+  inline uint64_t hash(const char* data, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+      h ^= static_cast<unsigned char>(data[i]);
+      h *= 1099511628211ULL;
+    }
+
+    return h;
+  }
+
+  /**
+   * Read-only memory mapping of a whole file. isValid() is false if the file can't be opened.
+   */
+  class MappedFile {
+    public:
+      MappedFile(const std::string& fileName):
+        mData(NULL), mSize(0) {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        if (fd < 0)
+          return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+          void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (data != MAP_FAILED) {
+            mData = static_cast<const char*>(data);
+            mSize = st.st_size;
+          }
+        }
+
+        close(fd);
+      }
+
+      ~MappedFile() {
+        if (mData)
+          munmap(const_cast<char*>(mData), mSize);
+      }
+
+      bool isValid() const {
+        return mData != NULL;
+      }
+
+      const char* begin() const {
+        return mData;
+      }
+
+      const char* end() const {
+        return mData + mSize;
+      }
+
+      size_t size() const {
+        return mSize;
+      }
+
+      uint64_t hash() const {
+        return BinaryCache::hash(mData, mSize);
+      }
+
+    private:
+      MappedFile(const MappedFile&);
+      MappedFile& operator=(const MappedFile&);
+
+      const char* mData;
+      size_t mSize;
+  };
+
+  inline bool hasMagic(const std::string& fileName, const char* magic) {
+    FILE* f = fopen(fileName.c_str(), "rb");
+    if (! f)
+      return false;
+
+    char buffer[8];
+    bool ok = fread(buffer, 1, 8, f) == 8 && memcmp(buffer, magic, 8) == 0;
+    fclose(f);
+
+    return ok;
+  }
+
+  inline bool readHeader(FILE* f, const char* magic, uint32_t version, Header& header) {
+    if (fread(&header, sizeof(Header), 1, f) != 1)
+      return false;
+
+    return memcmp(header.magic, magic, 8) == 0 && header.version == version;
+  }
+
+  inline bool writeHeader(FILE* f, const char* magic, uint32_t version, uint32_t count, uint64_t sourceHash) {
+    Header header;
+    memcpy(header.magic, magic, 8);
+    header.version = version;
+    header.count = count;
+    header.sourceHash = sourceHash;
+
+    return fwrite(&header, sizeof(Header), 1, f) == 1;
+  }
+
+  /**
+   * Sequential reader over a memory block, for sidecars with variable-length content.
+   * Strings and vectors are stored as a uint32 size followed by the data. Once a read fails,
+   * every following read fails too, so errors only need to be checked with ok() at the end.
+   */
+  class Reader {
+    public:
+      Reader(const char* begin, const char* end):
+        mCurrent(begin), mEnd(end), mOk(true) {}
+
+      template<typename T> bool read(T& value) {
+        if (! mOk || static_cast<size_t>(mEnd - mCurrent) < sizeof(T))
+          return mOk = false;
+
+        memcpy(&value, mCurrent, sizeof(T));
+        mCurrent += sizeof(T);
+        return true;
+      }
+
+      bool read(std::string& value) {
+        uint32_t size = 0;
+        if (! read(size) || static_cast<size_t>(mEnd - mCurrent) < size)
+          return mOk = false;
+
+        value.assign(mCurrent, size);
+        mCurrent += size;
+        return true;
+      }
+
+      template<typename T> bool read(std::vector<T>& values) {
+        uint32_t size = 0;
+        if (! read(size) || static_cast<size_t>(mEnd - mCurrent) / sizeof(T) < size)
+          return mOk = false;
+
+        values.resize(size);
+        memcpy(values.data(), mCurrent, size * sizeof(T));
+        mCurrent += size * sizeof(T);
+        return true;
+      }
+
+      bool readHeader(const char* magic, uint32_t version, Header& header) {
+        return read(header) && memcmp(header.magic, magic, 8) == 0 && header.version == version;
+      }
+
+      bool ok() const {
+        return mOk;
+      }
+
+    private:
+      const char* mCurrent;
+      const char* mEnd;
+      bool mOk;
+  };
+
+  template<typename T> bool write(FILE* f, const T& value) {
+    return fwrite(&value, sizeof(T), 1, f) == 1;
+  }
+
+  inline bool write(FILE* f, const std::string& value) {
+    uint32_t size = value.size();
+    return write(f, size) && fwrite(value.data(), 1, size, f) == size;
+  }
+
+  template<typename T> bool write(FILE* f, const std::vector<T>& values) {
+    uint32_t size = values.size();
+    return write(f, size) && fwrite(values.data(), sizeof(T), size, f) == size;
+  }
+
+  /**
+   * Create a new, uniquely named temporary file next to fileName, and store its name in
+   * tmpFileName. Concurrent jobs writing the same file each get their own temporary file, so
+   * that none of them can truncate or remove another's. Returns an open descriptor, or -1 on
+   * failure. Writers which open the file themselves (ROOT files) just close it: the empty
+   * file reserves the name.
+   */
+  inline int createTemporary(const std::string& fileName, std::string& tmpFileName) {
+    std::vector<char> name(fileName.begin(), fileName.end());
+    const char suffix[] = ".XXXXXX";
+    name.insert(name.end(), suffix, suffix + sizeof(suffix));
+
+    int fd = mkstemp(name.data());
+    if (fd < 0)
+      return -1;
+
+    tmpFileName = name.data();
+
+    // mkstemp creates the file as 0600: give it the mode fopen would have, umask included
+    mode_t mask = umask(0);
+    umask(mask);
+
+    if (fchmod(fd, 0666 & ~mask) != 0) {
+      close(fd);
+      remove(tmpFileName.c_str());
+      return -1;
+    }
+
+    return fd;
+  }
+
+  // Same as createTemporary, as a stdio stream. Returns NULL on failure
+  inline FILE* create(const std::string& fileName, std::string& tmpFileName) {
+    int fd = createTemporary(fileName, tmpFileName);
+    if (fd < 0)
+      return NULL;
+
+    FILE* f = fdopen(fd, "wb");
+    if (! f) {
+      close(fd);
+      remove(tmpFileName.c_str());
+    }
+
+    return f;
+  }
+
+  /**
+   * Close a sidecar written to tmpFileName (see create()) and move it to fileName. The rename
+   * is atomic, so that concurrent jobs never read a partial file.
+   */
+  inline bool commit(FILE* f, const std::string& tmpFileName, const std::string& fileName, bool ok) {
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+
+    if (! ok)
+      remove(tmpFileName.c_str());
+
+    return ok;
+  }
+}
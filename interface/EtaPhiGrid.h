@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Eta-phi grid index over a collection of objects having eta() and phi() methods.
+ *
+ * build() sorts the object indexes by cell (counting sort), so the indexes of one cell are
+ * contiguous. visit() calls a functor with the index of every object stored in a cell
+ * overlapping the square [eta +- radius] x [phi +- radius]. It's up to the caller to apply
+ * the exact deltaR cut. Objects outside [-maxEta, maxEta] are stored in the edge cells.
+ *
+ * Buffers are kept between calls to build(), so a grid can be reused event after event.
+ */
+class EtaPhiGrid {
+  public:
+    EtaPhiGrid(double maxEta, double cellSize):
+      mMaxEta(maxEta) {
+      mEtaBins = std::max<size_t>(1, std::ceil(2 * maxEta / cellSize));
+      mPhiBins = std::max<size_t>(1, std::ceil(2 * M_PI / cellSize));
+      mEtaCellSize = 2 * maxEta / mEtaBins;
+      mPhiCellSize = 2 * M_PI / mPhiBins;
+    }
+
+    template<typename Collection> void build(const Collection& objects) {
+      const size_t nCells = mEtaBins * mPhiBins;
+
+      mCells.resize(objects.size());
+      mCellStart.assign(nCells + 1, 0);
+
+      for (size_t i = 0; i < objects.size(); i++) {
+        uint32_t cell = etaBin(objects[i].eta()) * mPhiBins + phiBin(objects[i].phi());
+        mCells[i] = cell;
+        mCellStart[cell + 1]++;
+      }
+
+      for (size_t cell = 0; cell < nCells; cell++) {
+        mCellStart[cell + 1] += mCellStart[cell];
+      }
+
+      mIndexes.resize(objects.size());
+      mCursor.assign(mCellStart.begin(), mCellStart.end() - 1);
+      for (size_t i = 0; i < objects.size(); i++) {
+        mIndexes[mCursor[mCells[i]]++] = i;
+      }
+    }
+
+    template<typename F> void visit(double eta, double phi, double radius, F f) const {
+      size_t etaFrom = etaBin(eta - radius);
+      size_t etaTo = etaBin(eta + radius);
+
+      // Number of phi cells covered by the window, taking care of wrapping around
+      size_t phiFrom = phiBin(phi - radius);
+      size_t nPhi = std::min<size_t>(mPhiBins, std::floor(2 * radius / mPhiCellSize) + 2);
+
+      for (size_t etaIndex = etaFrom; etaIndex <= etaTo; etaIndex++) {
+        for (size_t i = 0; i < nPhi; i++) {
+          size_t cell = etaIndex * mPhiBins + (phiFrom + i) % mPhiBins;
+
+          for (uint32_t j = mCellStart[cell]; j < mCellStart[cell + 1]; j++) {
+            f(mIndexes[j]);
+          }
+        }
+      }
+    }
+
+  private:
+    size_t etaBin(double eta) const {
+      if (eta <= -mMaxEta)
+        return 0;
+
+      size_t bin = (eta + mMaxEta) / mEtaCellSize;
+      return std::min(bin, mEtaBins - 1);
+    }
+
+    size_t phiBin(double phi) const {
+      phi = std::fmod(phi + M_PI, 2 * M_PI);
+      if (phi < 0)
+        phi += 2 * M_PI;
+
+      size_t bin = phi / mPhiCellSize;
+      return std::min(bin, mPhiBins - 1);
+    }
+
+    double mMaxEta;
+    size_t mEtaBins;
+    size_t mPhiBins;
+    double mEtaCellSize;
+    double mPhiCellSize;
+
+    std::vector<uint32_t> mCells;
+    std::vector<uint32_t> mCellStart;
+    std::vector<uint32_t> mCursor;
+    std::vector<uint32_t> mIndexes;
+};
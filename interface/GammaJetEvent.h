@@ -0,0 +1,209 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <TLorentzVector.h>
+
+/**
+ * Plain data record of one selected event, built by GammaJetFilter without touching any
+ * output object. Field names match the branch names of the output trees.
+ *
+ * GammaJetTreeWriter is the only place where this record is turned into TTree entries.
+ */
+
+struct ParticleData {
+  int   is_present;
+  float et;
+  float pt;
+  float eta;
+  float phi;
+  float px;
+  float py;
+  float pz;
+  float e;
+
+  ParticleData():
+    is_present(0), et(0), pt(0), eta(0), phi(0), px(0), py(0), pz(0), e(0) {}
+};
+
+struct PhotonData: public ParticleData {
+  bool  has_pixel_seed;
+  float hadTowOverEm;
+  float sigmaIetaIeta;
+  float rho;
+  bool  hasMatchedPromptElectron;
+  float chargedHadronsIsolation;
+  float neutralHadronsIsolation;
+  float photonIsolation;
+
+  PhotonData():
+    has_pixel_seed(false), hadTowOverEm(0), sigmaIetaIeta(0), rho(0), hasMatchedPromptElectron(false),
+    chargedHadronsIsolation(0), neutralHadronsIsolation(0), photonIsolation(0) {}
+};
+
+struct JetData: public ParticleData {
+  float jet_area;
+  float btag_tc_high_eff;
+  float btag_tc_high_pur;
+  float btag_ssv_high_eff;
+  float btag_ssv_high_pur;
+  float btag_jet_probability;
+  float btag_jet_b_probability;
+  float btag_csv;
+  float qg_tag_mlp;
+  float qg_tag_likelihood;
+
+  JetData():
+    jet_area(0), btag_tc_high_eff(0), btag_tc_high_pur(0), btag_ssv_high_eff(0), btag_ssv_high_pur(0),
+    btag_jet_probability(0), btag_jet_b_probability(0), btag_csv(0), qg_tag_mlp(0), qg_tag_likelihood(0) {}
+};
+
+struct GenJetData: public ParticleData {
+  int            parton_pdg_id;
+  TLorentzVector parton_p4;
+  int            parton_flavour;
+
+  // Only filled for the first jet of b / c jets
+  std::vector<TLorentzVector> neutrinos;
+  std::vector<int>            neutrinos_pdg_id;
+
+  GenJetData():
+    parton_pdg_id(0), parton_flavour(0) {}
+};
+
+// One entry per lepton of the input collection, stored column by column
+struct LeptonsData {
+  std::vector<int>   id;
+  std::vector<float> isolation;
+  std::vector<float> delta_beta_isolation; // Only for muons
+  std::vector<float> pt;
+  std::vector<float> px;
+  std::vector<float> py;
+  std::vector<float> pz;
+  std::vector<float> eta;
+  std::vector<float> phi;
+  std::vector<int>   charge;
+
+  size_t size() const {
+    return id.size();
+  }
+
+  void resize(size_t n) {
+    id.resize(n);
+    isolation.resize(n);
+    delta_beta_isolation.resize(n);
+    pt.resize(n);
+    px.resize(n);
+    py.resize(n);
+    pz.resize(n);
+    eta.resize(n);
+    phi.resize(n);
+    charge.resize(n);
+  }
+};
+
+// One entry per gen particle of the event, see GenParticleTable
+struct GenParticlesData {
+  std::vector<int>   pdg_id;
+  std::vector<int>   status;
+  std::vector<int>   mother; // Index of the first mother, -1 if none
+  std::vector<float> pt;
+  std::vector<float> eta;
+  std::vector<float> phi;
+  std::vector<float> e;
+
+  size_t size() const {
+    return pdg_id.size();
+  }
+
+  void resize(size_t n) {
+    pdg_id.resize(n);
+    status.resize(n);
+    mother.resize(n);
+    pt.resize(n);
+    eta.resize(n);
+    phi.resize(n);
+    e.resize(n);
+  }
+};
+
+// Values of the jet selection debug histograms
+struct JetSelectionMonitoring {
+  bool  hasFirstGoodJet;
+  float firstGoodJetDeltaPhi;
+  float firstGoodJetDeltaR;
+  float firstGoodJetDeltaPt;
+
+  bool  hasSecondGoodJet;
+  float secondGoodJetDeltaPhi;
+  float secondGoodJetDeltaR;
+  float secondGoodJetDeltaPt;
+
+  int   selectedFirstJetIndex; // -1 if no jet was selected
+  float selectedFirstJetDeltaPhi;
+  float selectedFirstJetDeltaR;
+
+  int   selectedSecondJetIndex; // -1 if no jet was selected
+  float selectedSecondJetDeltaPhi;
+  float selectedSecondJetDeltaR;
+
+  JetSelectionMonitoring():
+    hasFirstGoodJet(false), firstGoodJetDeltaPhi(0), firstGoodJetDeltaR(0), firstGoodJetDeltaPt(0),
+    hasSecondGoodJet(false), secondGoodJetDeltaPhi(0), secondGoodJetDeltaR(0), secondGoodJetDeltaPt(0),
+    selectedFirstJetIndex(-1), selectedFirstJetDeltaPhi(0), selectedFirstJetDeltaR(0),
+    selectedSecondJetIndex(-1), selectedSecondJetDeltaPhi(0), selectedSecondJetDeltaR(0) {}
+};
+
+struct JetCollectionData {
+  JetData    firstJet;
+  JetData    secondJet;
+  JetData    firstRawJet;
+  JetData    secondRawJet;
+  GenJetData firstGenJet;
+  GenJetData secondGenJet;
+
+  ParticleData met;
+  ParticleData rawMet;
+  ParticleData genMet;
+
+  double rho;
+
+  JetSelectionMonitoring monitoring;
+
+  JetCollectionData():
+    rho(0) {}
+};
+
+struct AnalysisData {
+  unsigned int run;
+  unsigned int lumi_block;
+  unsigned int event;
+  unsigned int nvertex;
+  float        ntrue_interactions;
+  int          pu_nvertex;
+  float        event_weight;
+  double       generator_weight;
+
+  std::vector<std::string> trigger_names;
+  std::vector<bool>        trigger_results;
+
+  AnalysisData():
+    run(0), lumi_block(0), event(0), nvertex(0), ntrue_interactions(-1), pu_nvertex(-1), event_weight(1), generator_weight(1) {}
+};
+
+struct GammaJetEvent {
+  AnalysisData analysis;
+
+  PhotonData   photon;
+  ParticleData genPhoton;
+
+  LeptonsData electrons;
+  LeptonsData muons;
+
+  // Only filled when dumping all gen particles
+  GenParticlesData genParticles;
+
+  // Same order as the jet collections of the filter
+  std::vector<JetCollectionData> jets;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetEvent.h"
+
+class TFileDirectory;
+class TClonesArray;
+class TTree;
+class TH1F;
+class TH2F;
+
+/**
+ * Serialised output stage of GammaJetFilter.
+ *
+ * All the trees and debug histograms are booked at construction, with their branches bound
+ * once to an internal GammaJetEvent buffer. write() copies an event record into this buffer
+ * and fills the trees. This is the only method touching output objects, so it must be called
+ * from one thread at a time.
+ *
+ * Trees are booked in a TFileDirectory, so that both the EDM TFileService of the filter and a
+ * fwlite::TFileService (see bin/syntheticNtuples.cpp) can be used.
+ */
+class GammaJetTreeWriter {
+  public:
+    GammaJetTreeWriter(TFileDirectory& fs, const std::vector<std::string>& jetCollections, bool isMC, bool dumpGenParticles);
+    ~GammaJetTreeWriter();
+
+    void write(const GammaJetEvent& event);
+
+  private:
+    GammaJetTreeWriter(const GammaJetTreeWriter&);
+    GammaJetTreeWriter& operator=(const GammaJetTreeWriter&);
+
+    struct JetCollectionTrees {
+      TTree* firstJet;
+      TTree* secondJet;
+      TTree* firstRawJet;
+      TTree* secondRawJet;
+      TTree* firstGenJet;
+      TTree* secondGenJet;
+
+      TTree* met;
+      TTree* rawMet;
+      TTree* genMet;
+
+      TTree* misc;
+
+      // Branch addresses for objects
+      TLorentzVector* firstPartonP4;
+      TLorentzVector* secondPartonP4;
+      TClonesArray*   neutrinos;
+      TClonesArray*   neutrinosPdgId;
+    };
+
+    /**
+     * Lepton tree with its own growable buffers. Branch addresses are only updated
+     * when the buffers need to grow, never on a regular event.
+     */
+    struct LeptonTree {
+      TTree*      tree;
+      bool        isMuon;
+      int         n;
+      size_t      capacity;
+      LeptonsData buffers;
+    };
+
+    // Same as LeptonTree, for the gen particles dump
+    struct GenParticlesTree {
+      TTree*           tree;
+      int              n;
+      size_t           capacity;
+      GenParticlesData buffers;
+    };
+
+    void createTrees(const std::string& rootName, TFileDirectory& fs, JetCollectionData& data, JetCollectionTrees& trees);
+
+    void createParticleBranches(TTree* tree, ParticleData& data);
+    void createJetBranches(TTree* tree, JetData& data);
+    void createGenJetBranches(TTree* tree, GenJetData& data, TLorentzVector*& partonP4);
+    void createLeptonTree(LeptonTree& leptons, TTree* tree, bool isMuon);
+    void bindLeptonBranches(LeptonTree& leptons);
+    void bindGenParticlesBranches(GenParticlesTree& particles);
+
+    void fillMonitoring(const JetSelectionMonitoring& monitoring);
+    void fillLeptons(const LeptonsData& data, LeptonTree& leptons);
+    void fillGenParticles(const GenParticlesData& data, GenParticlesTree& particles);
+
+    bool mIsMC;
+    bool mDumpGenParticles;
+
+    // Branch buffers
+    GammaJetEvent mEvent;
+    std::vector<std::string>* mTriggerNames;
+    std::vector<bool>*        mTriggerResults;
+
+    // Trees
+    TTree* mPhotonTree;
+    TTree* mPhotonGenTree;
+    TTree* mAnalysisTree;
+
+    LeptonTree mElectrons;
+    LeptonTree mMuons;
+
+    GenParticlesTree mGenParticles;
+
+    std::vector<JetCollectionTrees> mJetTrees;
+
+    // DEBUG
+    TH1F* mFirstJetPhotonDeltaPhi;
+    TH1F* mFirstJetPhotonDeltaR;
+    TH1F* mFirstJetPhotonDeltaPt;
+    TH2F* mFirstJetPhotonDeltaPhiDeltaR;
+
+    TH1F* mSelectedFirstJetIndex;
+    TH1F* mSelectedSecondJetIndex;
+
+    TH1F* mSecondJetPhotonDeltaPhi;
+    TH1F* mSecondJetPhotonDeltaR;
+    TH1F* mSecondJetPhotonDeltaPt;
+
+    TH1F* mSelectedFirstJetPhotonDeltaPhi;
+    TH1F* mSelectedFirstJetPhotonDeltaR;
+
+    TH1F* mSelectedSecondJetPhotonDeltaPhi;
+    TH1F* mSelectedSecondJetPhotonDeltaR;
+};
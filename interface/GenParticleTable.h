@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DataFormats/HepMCCandidate/interface/GenParticleFwd.h"
+#include "DataFormats/Provenance/interface/ProductID.h"
+
+struct GenParticlesData;
+
+/**
+ * Flattened view of the gen particles of one event.
+ *
+ * build() stores, for each particle, the index of its first mother and the indexes of its
+ * daughters, so that decay chains can be walked without resolving any Ref. Indexes are the
+ * positions inside the input collection, that is the keys of the Refs pointing to it: mothers and
+ * daughters are read from the keys of their Refs, checked against the collection ProductID.
+ * Once built, the table is only read, so it can be shared between threads.
+ */
+class GenParticleTable {
+  public:
+    void build(const reco::GenParticleCollection& particles, const edm::ProductID& id);
+
+    size_t size() const {
+      return mParticles ? mParticles->size() : 0;
+    }
+
+    const reco::GenParticle& particle(uint32_t index) const {
+      return (*mParticles)[index];
+    }
+
+    // Index of the particle a Ref points to, or -1 if it points to another collection
+    int indexOf(const reco::GenParticleRef& ref) const;
+
+    /**
+     * Index of a particle inside the table, from its address, or -1 if the particle does not
+     * belong to the input collection (for example, an embedded copy).
+     */
+    int indexOf(const reco::GenParticle* particle) const;
+
+    // -1 if the particle has no mother
+    int mother(uint32_t index) const {
+      return mMothers[index];
+    }
+
+    const uint32_t* daughtersBegin(uint32_t index) const {
+      return mDaughters.data() + mDaughtersOffsets[index];
+    }
+
+    const uint32_t* daughtersEnd(uint32_t index) const {
+      return mDaughters.data() + mDaughtersOffsets[index + 1];
+    }
+
+    /**
+     * Indexes where the decay chain of parent starts: parent itself if it belongs to the table,
+     * else its daughters (parent is then a copy embedded inside a pat::Jet).
+     */
+    void decayRoots(const reco::GenParticle& parent, std::vector<uint32_t>& roots) const;
+
+    /**
+     * Indexes of all the neutrinos found in the decay chain starting at roots. Each particle is
+     * visited at most once, so a neutrino reachable through several mothers is only
+     * reported once. Only reads the table.
+     */
+    void findNeutrinos(const std::vector<uint32_t>& roots, std::vector<uint32_t>& neutrinos) const;
+
+    void toData(GenParticlesData& data) const;
+
+  private:
+    const reco::GenParticleCollection* mParticles = nullptr;
+    edm::ProductID mProductID;
+
+    std::vector<int> mMothers;
+    std::vector<uint32_t> mDaughtersOffsets;
+    std::vector<uint32_t> mDaughters;
+};
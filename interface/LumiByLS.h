@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Recorded luminosity for each (run, lumi section), as produced by
+ * 'lumiCalc2.py lumibyls', stored as a flat array sorted by (run, lumi section).
+ *
+ * The CSV is parsed directly from a memory mapping of the file. Like LumiMask, the table
+ * can be written to / read from a binary sidecar file.
+ */
+class LumiByLS {
+  public:
+    struct Entry {
+      uint32_t run;
+      uint32_t lumi;
+      double   recorded;
+    };
+
+    LumiByLS() {}
+
+    void parse(const char* begin, const char* end);
+
+    bool read(const std::string& fileName, uint64_t sourceHash);
+    bool write(const std::string& fileName, uint64_t sourceHash) const;
+
+    // Returns 0 if the lumi section is unknown
+    double get(uint32_t run, uint32_t lumi) const;
+
+    size_t size() const {
+      return mEntries.size();
+    }
+
+  private:
+    std::vector<Entry> mEntries;
+};
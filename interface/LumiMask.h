@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Json {
+  class Value;
+}
+
+/**
+ * Golden JSON compiled into a flat, sorted table of lumi sections intervals.
+ *
+ * Runs are stored sorted, each one pointing to a contiguous slice of sorted and merged
+ * [from, to] lumi ranges. Both lookups are binary searches.
+ *
+ * The table can be written to / read from a small binary file, so that jobs sharing the
+ * same certification JSON don't need to parse it again with jsoncpp.
+ */
+class LumiMask {
+  public:
+    struct LumiRange {
+      uint32_t from;
+      uint32_t to;
+    };
+
+    struct RunEntry {
+      uint32_t run;
+      uint32_t first; // Index of the first range of this run inside mRanges
+      uint32_t count; // Number of ranges for this run
+    };
+
+    LumiMask() {}
+
+    void build(const Json::Value& root);
+
+    bool read(const std::string& fileName, uint64_t sourceHash, bool checkHash = true);
+    bool write(const std::string& fileName, uint64_t sourceHash) const;
+
+    static bool isCompiled(const std::string& fileName);
+
+    // Returns NULL if the run is not certified
+    const RunEntry* getRun(uint32_t run) const;
+    bool isValid(const RunEntry& run, uint32_t lumi) const;
+    bool isValid(uint32_t run, uint32_t lumi) const;
+
+    size_t runs() const {
+      return mRuns.size();
+    }
+
+    size_t ranges() const {
+      return mRanges.size();
+    }
+
+  private:
+    std::vector<RunEntry> mRuns;
+    std::vector<LumiRange> mRanges;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * PF isolations of a photon, as produced by PhotonIsolationProducer. Isolations are not
+ * corrected for pile-up.
+ *
+ * Isolations are only meaningful if isComputed() is true: photons failing the producer
+ * preselection are stored with -1 isolations and a matched prompt electron.
+ */
+struct PhotonIsolation {
+  enum Flags {
+    COMPUTED                    = 1 << 0,
+    HAS_MATCHED_PROMPT_ELECTRON = 1 << 1
+  };
+
+  float   chargedHadronsIsolation;
+  float   neutralHadronsIsolation;
+  float   photonIsolation;
+  uint8_t flags;
+
+  PhotonIsolation():
+    chargedHadronsIsolation(-1), neutralHadronsIsolation(-1), photonIsolation(-1), flags(HAS_MATCHED_PROMPT_ELECTRON) {}
+
+  bool isComputed() const {
+    return flags & COMPUTED;
+  }
+
+  bool hasMatchedPromptElectron() const {
+    return flags & HAS_MATCHED_PROMPT_ELECTRON;
+  }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Threads started once, and reused for each batch of tasks.
+ *
+ * run() hands the tasks out to the workers and to the calling thread, and returns once they are
+ * all done. Between two batches, workers wait on a condition variable, so an event doesn't pay
+ * for thread creation.
+ */
+class WorkerPool {
+  public:
+    // 'threads' includes the calling thread: threads - 1 workers are started
+    WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    size_t threads() const {
+      return mWorkers.size() + 1;
+    }
+
+    // Call task(i) for each i in [0, n). Tasks must not throw
+    void run(size_t n, const std::function<void(size_t)>& task);
+
+  private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void work();
+    void runTasks();
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mMutex;
+    std::condition_variable mStart;
+    std::condition_variable mDone;
+
+    // Current batch. Set under the lock, before the generation changes
+    const std::function<void(size_t)>* mTask;
+    size_t mTasks;
+    std::atomic<size_t> mNext;
+    size_t mBusy; // Workers which haven't finished the current batch
+    uint64_t mGeneration;
+    bool mStopping;
+};
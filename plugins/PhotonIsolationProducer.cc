@@ -1,4 +1,5 @@
 // system include files
+#include <cmath>
 #include <memory>
 #include <iostream>
 #include <string>
@@ -19,6 +20,9 @@
 #include "EGamma/EGammaAnalysisTools/interface/PFIsolationEstimator.h"
 #include "RecoEgamma/EgammaTools/interface/ConversionTools.h"
 
+#include "JetMETCorrections/GammaJetFilter/interface/EtaPhiGrid.h"
+#include "JetMETCorrections/GammaJetFilter/interface/PhotonIsolation.h"
+
 class PhotonIsolationProducer : public edm::EDProducer {
   public:
     explicit PhotonIsolationProducer(const edm::ParameterSet&);
@@ -32,21 +36,39 @@ class PhotonIsolationProducer : public edm::EDProducer {
     // ----------member data --------------------------
     edm::InputTag src_;
 
+    bool passPreselection(const pat::Photon& photon) const;
+
     // Photon ID
     PFIsolationEstimator mPFIsolator;
+    double mConeSize;
+
+    // Cheap cuts applied before computing isolation. A negative value disables the cut
+    double mMaxAbsEta;
+    double mMaxHadTowOverEm;
+    double mMaxSigmaIetaIeta;
+
+    // PF candidates index, rebuilt each event
+    EtaPhiGrid mPFCandidatesGrid;
+    reco::PFCandidateCollection mPFCandidatesInCone;
 };
 
-PhotonIsolationProducer::PhotonIsolationProducer(const edm::ParameterSet& iConfig)
+// Isolation is computed by PFIsolationEstimator with respect to the vertex, while the grid is
+// filled with the candidates direction. Select candidates in a larger cone to stay safe
+static const double CONE_SAFETY_MARGIN = 0.2;
+
+PhotonIsolationProducer::PhotonIsolationProducer(const edm::ParameterSet& iConfig):
+  mConeSize(0.3), mPFCandidatesGrid(5., 0.25)
 {
   src_= iConfig.getParameter<edm::InputTag>("src");
 
+  mMaxAbsEta = iConfig.getUntrackedParameter<double>("preselectionMaxAbsEta", -1);
+  mMaxHadTowOverEm = iConfig.getUntrackedParameter<double>("preselectionMaxHadTowOverEm", -1);
+  mMaxSigmaIetaIeta = iConfig.getUntrackedParameter<double>("preselectionMaxSigmaIetaIeta", -1);
+
   mPFIsolator.initializePhotonIsolation(true);
-  mPFIsolator.setConeSize(0.3);
+  mPFIsolator.setConeSize(mConeSize);
 
-  produces<edm::ValueMap<double>>("chargedHadronsIsolation");
-  produces<edm::ValueMap<double>>("photonIsolation");
-  produces<edm::ValueMap<double>>("neutralHadronsIsolation");
-  produces<edm::ValueMap<bool>>("hasMatchedPromptElectron");
+  produces<edm::ValueMap<PhotonIsolation>>();
 }
 
 
@@ -55,20 +77,24 @@ PhotonIsolationProducer::~PhotonIsolationProducer()
 
 }
 
-// ------------ method called to produce the data  ------------
-void PhotonIsolationProducer::produce(edm::Event& iEvent, const edm::EventSetup& iSetup)
-{
-  std::auto_ptr<edm::ValueMap<double>> chIsoMap(new edm::ValueMap<double>());
-  edm::ValueMap<double>::Filler chFiller(*chIsoMap);
+bool PhotonIsolationProducer::passPreselection(const pat::Photon& photon) const {
+  if (mMaxAbsEta >= 0 && fabs(photon.eta()) > mMaxAbsEta)
+    return false;
 
-  std::auto_ptr<edm::ValueMap<double>> phIsoMap(new edm::ValueMap<double>());
-  edm::ValueMap<double>::Filler phFiller(*phIsoMap);
+  if (mMaxHadTowOverEm >= 0 && photon.hadTowOverEm() >= mMaxHadTowOverEm)
+    return false;
 
-  std::auto_ptr<edm::ValueMap<double>> nhIsoMap(new edm::ValueMap<double>());
-  edm::ValueMap<double>::Filler nhFiller(*nhIsoMap);
+  if (mMaxSigmaIetaIeta >= 0 && photon.sigmaIetaIeta() >= mMaxSigmaIetaIeta)
+    return false;
 
-  std::auto_ptr<edm::ValueMap<bool>> promptConvMap(new edm::ValueMap<bool>());
-  edm::ValueMap<bool>::Filler promptConvFiller(*promptConvMap);
+  return true;
+}
+
+// ------------ method called to produce the data  ------------
+void PhotonIsolationProducer::produce(edm::Event& iEvent, const edm::EventSetup& iSetup)
+{
+  std::auto_ptr<edm::ValueMap<PhotonIsolation>> isolationsMap(new edm::ValueMap<PhotonIsolation>());
+  edm::ValueMap<PhotonIsolation>::Filler filler(*isolationsMap);
 
   edm::Handle<pat::PhotonCollection> photonsHandle;
   iEvent.getByLabel(src_, photonsHandle);
@@ -95,44 +121,40 @@ void PhotonIsolationProducer::produce(edm::Event& iEvent, const edm::EventSetup&
   if (vertexCollection->empty())
     return;
 
-  std::vector<double> chIsoValues;
-  std::vector<double> phIsoValues;
-  std::vector<double> nhIsoValues;
-  std::vector<bool>   promptConvValues;
-  chIsoValues.reserve(photonsHandle->size());
-  phIsoValues.reserve(photonsHandle->size());
-  nhIsoValues.reserve(photonsHandle->size());
-  promptConvValues.reserve(photonsHandle->size());
+  // Photons failing the preselection keep the default values (not computed)
+  std::vector<PhotonIsolation> isolations(photonsHandle->size());
+
+  mPFCandidatesGrid.build(pfCandidates);
+
+  for (size_t i = 0; i < photonsHandle->size(); i++) {
+    const pat::Photon& photon = (*photonsHandle)[i];
 
-  pat::PhotonCollection::const_iterator it = photonsHandle->begin();
-  for (; it != photonsHandle->end(); ++it) {
-    pat::Photon photon = *it;
+    if (! passPreselection(photon))
+      continue;
 
-    promptConvValues.push_back(ConversionTools::hasMatchedPromptElectron(photon.superCluster(), hElectrons, hConversions, beamspot.position()));
+    PhotonIsolation& isolation = isolations[i];
+    isolation.flags = PhotonIsolation::COMPUTED;
 
-    mPFIsolator.fGetIsolation(&photon, &pfCandidates, vertexRef, vertexCollection);
+    if (ConversionTools::hasMatchedPromptElectron(photon.superCluster(), hElectrons, hConversions, beamspot.position()))
+      isolation.flags |= PhotonIsolation::HAS_MATCHED_PROMPT_ELECTRON;
 
-    chIsoValues.push_back(mPFIsolator.getIsolationCharged());
-    phIsoValues.push_back(mPFIsolator.getIsolationPhoton());
-    nhIsoValues.push_back(mPFIsolator.getIsolationNeutral());
+    // Only give to the isolation estimator the candidates around the photon
+    mPFCandidatesInCone.clear();
+    mPFCandidatesGrid.visit(photon.eta(), photon.phi(), mConeSize + CONE_SAFETY_MARGIN, [&] (size_t index) {
+        mPFCandidatesInCone.push_back(pfCandidates[index]);
+    });
+
+    mPFIsolator.fGetIsolation(&photon, &mPFCandidatesInCone, vertexRef, vertexCollection);
+
+    isolation.chargedHadronsIsolation = mPFIsolator.getIsolationCharged();
+    isolation.photonIsolation = mPFIsolator.getIsolationPhoton();
+    isolation.neutralHadronsIsolation = mPFIsolator.getIsolationNeutral();
   }
-  
-  chFiller.insert(photonsHandle, chIsoValues.begin(), chIsoValues.end());
-	chFiller.fill();
-	
-	phFiller.insert(photonsHandle, phIsoValues.begin(), phIsoValues.end());
-	phFiller.fill();
-	
-	nhFiller.insert(photonsHandle, nhIsoValues.begin(), nhIsoValues.end());
-	nhFiller.fill();
-
-  promptConvFiller.insert(photonsHandle, promptConvValues.begin(), promptConvValues.end());
-  promptConvFiller.fill();
-
-  iEvent.put(chIsoMap, "chargedHadronsIsolation");
-  iEvent.put(phIsoMap, "photonIsolation");
-  iEvent.put(nhIsoMap, "neutralHadronsIsolation");
-  iEvent.put(promptConvMap, "hasMatchedPromptElectron");
+
+  filler.insert(photonsHandle, isolations.begin(), isolations.end());
+  filler.fill();
+
+  iEvent.put(isolationsMap);
 }
 
 // ------------ method called once each job just before starting event loop  ------------
@@ -18,20 +18,21 @@ Implementation:
 
 
 // system include files
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <fstream>
+#include <iostream>
 #include <map>
-#include <unordered_map>
 #include <memory>
 #include <string>
+#include <exception>
 
 // Boost
 #include "boost/shared_ptr.hpp"
 
 // user include files
 #include "CommonTools/UtilAlgos/interface/TFileService.h"
-#include "CommonTools/Utils/interface/PtComparator.h"
 #include "CommonTools/Utils/interface/StringCutObjectSelector.h"
 
 #include "FWCore/Common/interface/TriggerNames.h"
@@ -78,10 +79,17 @@ Implementation:
 
 #include "JetMETCorrections/Objects/interface/JetCorrector.h"
 #include "JetMETCorrections/GammaJetFilter/interface/json/json.h"
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetEvent.h"
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetTreeWriter.h"
+#include "JetMETCorrections/GammaJetFilter/interface/GenParticleTable.h"
+#include "JetMETCorrections/GammaJetFilter/interface/LumiByLS.h"
+#include "JetMETCorrections/GammaJetFilter/interface/LumiMask.h"
+#include "JetMETCorrections/GammaJetFilter/interface/PhotonIsolation.h"
+#include "JetMETCorrections/GammaJetFilter/interface/WorkerPool.h"
 
 #include <TParameter.h>
 #include <TTree.h>
-#include <TClonesArray.h>
 #include <TLorentzVector.h>
 
 #include <boost/regex.hpp>
@@ -100,8 +108,6 @@ struct JetInfos {
   edm::InputTag inputTag;
 };
 
-#define FOREACH(x) for (std::vector<std::string>::const_iterator it = x.begin(); it != x.end(); ++it)
-
 class GammaJetFilter : public edm::EDFilter {
   public:
     explicit GammaJetFilter(const edm::ParameterSet&);
@@ -119,18 +125,53 @@ class GammaJetFilter : public edm::EDFilter {
     virtual bool beginLuminosityBlock(edm::LuminosityBlock&, edm::EventSetup const&);
     virtual bool endLuminosityBlock(edm::LuminosityBlock&, edm::EventSetup const&);
 
-    void correctJets(pat::JetCollection& jets, edm::Event& iEvent, const edm::EventSetup& iSetup);
-    void extractRawJets(pat::JetCollection& jets);
-    void processJets(const pat::PhotonRef& photon, pat::JetCollection& jets, const JetAlgorithm algo, edm::Handle<edm::ValueMap<float>>& qgTagMLP, edm::Handle<edm::ValueMap<float>>& qgTagLikelihood, const edm::Handle<pat::JetCollection>& handleForRef, std::vector<TTree*>& trees);
-
-    void correctMETWithTypeI(const pat::MET& rawMet, pat::MET& met, const pat::JetCollection& jets);
+    // Four-momenta of a jet after our corrections. Only selected jets are turned back into pat::Jet
+    struct CorrectedJet {
+      reco::Candidate::LorentzVector p4;
+      reco::Candidate::LorentzVector L1p4; // For TypeI correction
+    };
+
+    // Gen matching of one jet. pat::Jet resolves Refs to find them, which is not thread-safe:
+    // it's done while fetching the collection
+    struct GenMatch {
+      const reco::GenJet* genJet; // NULL if not matched
+      const reco::GenParticle* parton; // NULL if not matched
+      std::vector<uint32_t> partonDecay; // Where the decay chain of a b or c parton starts in the gen particle table
+    };
+
+    // Event products of one jet collection, fetched serially before processing
+    struct JetCollectionInputs {
+      JetAlgorithm algo;
+      edm::Handle<pat::JetCollection> jetsHandle;
+      std::vector<CorrectedJet> correctedJets; // Same order as the input collection
+      edm::Handle<edm::ValueMap<float>> qgTagMLP;
+      edm::Handle<edm::ValueMap<float>> qgTagLikelihood;
+      edm::Handle<pat::METCollection> mets;
+      edm::Handle<pat::METCollection> rawMets;
+      double rho;
+      const GenParticleTable* genParticles; // NULL for data
+      std::vector<GenMatch> genMatches; // Same order as the input collection. Empty for data
+    };
+
+    bool buildEvent(const edm::Event& iEvent, const edm::EventSetup& iSetup, GammaJetEvent& event) const;
+
+    void fetchJetCollection(const edm::Event& iEvent, const edm::EventSetup& iSetup, const std::string& name, JetCollectionInputs& inputs) const;
+    void processJetCollection(const pat::Photon& photon, JetCollectionInputs& inputs, JetCollectionData& data) const;
+    void processJetCollections(const pat::Photon& photon, std::vector<JetCollectionInputs>& inputs, std::vector<JetCollectionData>& data) const;
+
+    void correctJets(const pat::JetCollection& jets, std::vector<CorrectedJet>& correctedJets, const edm::Event& iEvent, const edm::EventSetup& iSetup) const;
+    void extractRawJets(const pat::JetCollection& jets, std::vector<CorrectedJet>& correctedJets) const;
+    void processJets(const pat::Photon& photon, const JetCollectionInputs& inputs, JetCollectionData& data) const;
+
+    void correctMETWithTypeI(const pat::MET& rawMet, pat::MET& met, const pat::JetCollection& jets, const std::vector<CorrectedJet>& correctedJets) const;
 
     //const EcalRecHitCollection* getEcalRecHitCollection(const reco::BasicCluster& cluster);
-    bool isValidPhotonEB(const pat::Photon& photon, const double rho, const EcalRecHitCollection* recHits, const CaloTopology& topology);
-    bool isValidPhotonEB2012(const pat::PhotonRef& photonRef, edm::Event& event);
+    bool isValidPhotonEB(const pat::Photon& photon, const double rho, const EcalRecHitCollection* recHits, const CaloTopology& topology) const;
+    void getPhotonIsolations(const edm::Event& event, const edm::Handle<pat::PhotonCollection>& photons, std::vector<PhotonIsolation>& isolations) const;
+    bool isValidPhotonEB2012(const pat::PhotonRef& photonRef, const PhotonIsolation& isolation, double rho) const;
     //bool isValidPhotonEE(const pat::Photon& photon, const double rho);
     //bool isValidPhotonEB(const pat::Photon& photon, const double rho);
-    bool isValidJet(const pat::Jet& jet);
+    bool isValidJet(const pat::Jet& jet, boost::shared_ptr<JetIDSelectionFunctor>& caloJetID) const;
 
     void readJSONFile();
     void readCSVFile();
@@ -140,10 +181,12 @@ class GammaJetFilter : public edm::EDFilter {
     bool mIsMC;
     bool mFilterData;
     std::string mJSONFile;
+    std::string mJSONCacheFile;
     std::string mCSVFile;
-    boost::shared_ptr<Json::Value> mValidRuns;
-    boost::shared_ptr<Json::Value> mCurrentRunValidLumis;
-    std::map<std::pair<unsigned int, unsigned int>, double> mLumiByLS;
+    std::string mCSVCacheFile;
+    LumiMask mLumiMask;
+    const LumiMask::RunEntry* mCurrentRun;
+    LumiByLS mLumiByLS;
     bool mIsValidLumiBlock;
 
     // Photon ID
@@ -153,13 +196,14 @@ class GammaJetFilter : public edm::EDFilter {
     bool mDoJEC;
     bool mJECFromRaw;
     std::string mCorrectorLabel;
-    GreaterByPt<pat::Jet> mSorter;
 
     bool mFirstJetPtCut;
     double mFirstJetThreshold;
 
     std::vector<std::string> mJetCollections;
     std::map<std::string, JetInfos> mJetCollectionsData;
+    unsigned int mJetCollectionThreads;
+    boost::shared_ptr<WorkerPool> mJetCollectionWorkers; // Started once, used by each event
 
     // Input Tags
     edm::InputTag mPhotonsIT;
@@ -168,29 +212,18 @@ class GammaJetFilter : public edm::EDFilter {
     edm::InputTag mJetsAK5CaloIT;
     edm::InputTag mJetsAK7CaloIT;
 
-    boost::shared_ptr<JetIDSelectionFunctor> mCaloJetID;
-    pat::strbitset mCaloJetIDRet;
-
     double mPtHatMin;
     double mPtHatMax;
 
-    // Trees
-    void createTrees(const std::string& rootName, TFileService& fs);
-    TTree* mGenParticlesTree;
-    TTree* mPhotonTree;
-    TTree* mPhotonGenTree;
-    TTree* mAnalysisTree;
-    TTree* mElectronsTree;
-    TTree* mMuonsTree;
+    std::vector<boost::regex> mValidTriggers;
+
+    // Output. Only touched from filter() and the lumi block transitions
+    boost::shared_ptr<GammaJetTreeWriter> mWriter;
     TParameter<double>*    mTotalLuminosity;
     float                  mEventsWeight;
     TParameter<long long>* mProcessedEvents;
     TParameter<long long>* mSelectedEvents;
 
-    std::map<std::string, std::vector<TTree*> > mJetTrees;
-    std::map<std::string, std::vector<TTree*> > mMETTrees;
-    std::map<std::string, TTree*>               mMiscTrees;
-
     // TParameters for storing current config (JEC, correctorLabel, Treshold, etc...
     TParameter<bool>*             mJECRedone;
     TParameter<bool>*             mJECFromRawParameter;
@@ -198,51 +231,15 @@ class GammaJetFilter : public edm::EDFilter {
     TParameter<bool>*             mFirstJetPtCutParameter;
     TParameter<double>*           mFirstJetThresholdParameter;
 
-    // DEBUG
-    TH1F* mFirstJetPhotonDeltaPhi;
-    TH1F* mFirstJetPhotonDeltaR;
-    TH1F* mFirstJetPhotonDeltaPt;
-    TH2F* mFirstJetPhotonDeltaPhiDeltaR;
-
-    TH1F* mSelectedFirstJetIndex;
-    TH1F* mSelectedSecondJetIndex;
-
-    TH1F* mSecondJetPhotonDeltaPhi;
-    TH1F* mSecondJetPhotonDeltaR;
-    TH1F* mSecondJetPhotonDeltaPt;
-
-    TH1F* mSelectedFirstJetPhotonDeltaPhi;
-    TH1F* mSelectedFirstJetPhotonDeltaR;
-
-    TH1F* mSelectedSecondJetPhotonDeltaPhi;
-    TH1F* mSelectedSecondJetPhotonDeltaR;
-
-    // For B / C jets neutrinos
-    TClonesArray* mNeutrinos;
-    TClonesArray* mNeutrinosPDG;
-
-    // Cache for MC particles
     bool mDumpAllMCParticles;
-    std::unordered_map<const reco::Candidate*, int> mParticlesIndexes;
-
-    void particleToTree(const reco::Candidate* particle, TTree* t, std::vector<boost::shared_ptr<void> >& addresses);
-    
-    void updateBranch(TTree* tree, void* address, const std::string& name, const std::string& type = "F");
-    template<typename U>
-      void updateBranch(TTree* tree, std::vector<U>*& address, const std::string& name);
-
-    void updateBranchArray(TTree* tree, void* address, const std::string& name, const std::string& size, const std::string& type = "F");
-
-    void photonToTree(const pat::PhotonRef& photon, const edm::Event& event);
-    void metsToTree(const pat::MET& met, const pat::MET& rawMet, const std::vector<TTree*>& trees);
-    void metToTree(const pat::MET* met, TTree* tree, TTree* genTree);
-    void jetsToTree(const pat::Jet* firstJet, const pat::Jet* secondJet, const std::vector<TTree*>& trees);
-    void jetToTree(const pat::Jet* jet, bool findNeutrinos, TTree* tree, TTree* genTree);
-    void electronsToTree(const edm::Handle<pat::ElectronCollection>& electrons, const reco::Vertex& pv);
-    void muonsToTree(const edm::Handle<pat::MuonCollection>& muons, const reco::Vertex& pv);
-
-    int getMotherIndex(const edm::Handle<reco::GenParticleCollection>& genParticles, const reco::Candidate* mother);
-    void genParticlesToTree(const edm::Handle<reco::GenParticleCollection>& genParticles);
+
+    void particleToData(const reco::Candidate* particle, ParticleData& data) const;
+    void photonToData(const pat::PhotonRef& photon, const PhotonIsolation& isolation, double rho, PhotonData& data) const;
+    void metsToData(const pat::MET& met, const pat::MET& rawMet, JetCollectionData& data) const;
+    void jetsToData(const pat::Jet* firstJet, const pat::Jet* firstRawJet, const pat::Jet* secondJet, const pat::Jet* secondRawJet, const GenMatch* firstGenMatch, const GenMatch* secondGenMatch, const GenParticleTable* genParticles, JetCollectionData& data) const;
+    void jetToData(const pat::Jet* jet, const GenMatch* genMatch, const GenParticleTable* genParticles, JetData& data, GenJetData* genData) const;
+    void electronsToData(const edm::Handle<pat::ElectronCollection>& electrons, const reco::Vertex& pv, LeptonsData& data) const;
+    void muonsToData(const edm::Handle<pat::MuonCollection>& muons, const reco::Vertex& pv, LeptonsData& data) const;
 };
 
 //
@@ -257,14 +254,16 @@ class GammaJetFilter : public edm::EDFilter {
 // constructors and destructor
 //
 GammaJetFilter::GammaJetFilter(const edm::ParameterSet& iConfig):
-  mIsMC(false), mIsValidLumiBlock(false)
+  mIsMC(false), mCurrentRun(NULL), mIsValidLumiBlock(false)
 {
 
   mIsMC = iConfig.getUntrackedParameter<bool>("isMC", "false");
 
   if (! mIsMC) {
     mJSONFile = iConfig.getParameter<std::string>("json");
+    mJSONCacheFile = iConfig.getUntrackedParameter<std::string>("jsonCache", "");
     mCSVFile = iConfig.getParameter<std::string>("csv");
+    mCSVCacheFile = iConfig.getUntrackedParameter<std::string>("csvCache", "");
     mFilterData = iConfig.getUntrackedParameter<bool>("filterData", true);
   }
 
@@ -281,6 +280,8 @@ GammaJetFilter::GammaJetFilter(const edm::ParameterSet& iConfig):
     mCorrectorLabel = iConfig.getUntrackedParameter<std::string>("correctorLabel", "ak5PFResidual");
   }
 
+  mJetCollectionThreads = iConfig.getUntrackedParameter<unsigned int>("jetCollectionThreads", 1);
+
   mFirstJetPtCut = iConfig.getUntrackedParameter<bool>("firstJetPtCut", true);
   mFirstJetThreshold = iConfig.getUntrackedParameter<double>("firstJetThreshold", 0.3);
 
@@ -302,22 +303,12 @@ GammaJetFilter::GammaJetFilter(const edm::ParameterSet& iConfig):
   }
 
   edm::Service<TFileService> fs;
-  mPhotonTree = fs->make<TTree>("photon", "photon tree");
-  
-  if (mIsMC)
-    mPhotonGenTree = fs->make<TTree>("photon_gen", "photon gen tree");
-  else
-    mPhotonGenTree = nullptr;
-
-  mAnalysisTree = fs->make<TTree>("analysis", "analysis tree");
-  mMuonsTree = fs->make<TTree>("muons", "muons tree");
-  mElectronsTree = fs->make<TTree>("electrons", "electrons tree");
-
   mTotalLuminosity = fs->make<TParameter<double> >("total_luminosity", 0.);
 
   mEventsWeight = 1.;
   mPtHatMin     = -1.;
   mPtHatMax     = -1.;
+  mDumpAllMCParticles = false;
 
   if (mIsMC) {
     // Read cross section and number of generated events
@@ -327,6 +318,8 @@ GammaJetFilter::GammaJetFilter(const edm::ParameterSet& iConfig):
 
     mPtHatMin = iConfig.getUntrackedParameter<double>("ptHatMin", -1.);
     mPtHatMax = iConfig.getUntrackedParameter<double>("ptHatMax", -1.);
+
+    mDumpAllMCParticles = iConfig.getUntrackedParameter<bool>("dumpAllGenParticles", false);
   }
 
   if (runOnNonCHS) {
@@ -361,9 +354,9 @@ GammaJetFilter::GammaJetFilter(const edm::ParameterSet& iConfig):
     mJetCollectionsData["CaloAK7"]  = {AK7, mJetsAK7CaloIT};
   }
 
-  FOREACH(mJetCollections) {
-    createTrees(*it, *fs);
-  }
+  mWriter.reset(new GammaJetTreeWriter(*fs, mJetCollections, mIsMC, mDumpAllMCParticles));
+
+  mJetCollectionWorkers.reset(new WorkerPool(std::max<size_t>(1, std::min<size_t>(mJetCollectionThreads, mJetCollections.size()))));
 
   mProcessedEvents = fs->make<TParameter<long long> >("total_events", 0);
   mSelectedEvents = fs->make<TParameter<long long> >("passed_events", 0);
@@ -379,33 +372,10 @@ GammaJetFilter::GammaJetFilter(const edm::ParameterSet& iConfig):
     mFirstJetThresholdParameter = fs->make<TParameter<double> >("cut_on_first_jet_treshold", mFirstJetThreshold);
   }
 
-  mFirstJetPhotonDeltaPhi = fs->make<TH1F>("firstJetPhotonDeltaPhi", "firstJetPhotonDeltaPhi", 50, 0., M_PI);
-  mFirstJetPhotonDeltaR = fs->make<TH1F>("firstJetPhotonDeltaR", "firstJetPhotonDeltaR", 80, 0, 10);
-  mFirstJetPhotonDeltaPt = fs->make<TH1F>("firstJetPhotonDeltaPt", "firstJetPhotonDeltaPt", 100, 0, 50);
-  mFirstJetPhotonDeltaPhiDeltaR = fs->make<TH2F>("firstJetPhotonDeltaPhiDeltaR", "firstJetPhotonDeltaPhiDeltaR", 50, 0, M_PI, 80, 0, 10);
-
-  mSelectedFirstJetIndex = fs->make<TH1F>("selectedFirstJetIndex", "selectedFirstJetIndex", 20, 0, 20);
-  mSelectedSecondJetIndex = fs->make<TH1F>("selectedSecondJetIndex", "selectedSecondJetIndex", 20, 0, 20);
-
-  mSecondJetPhotonDeltaPhi = fs->make<TH1F>("secondJetPhotonDeltaPhi", "secondJetPhotonDeltaPhi", 50, 0., M_PI);
-  mSecondJetPhotonDeltaR = fs->make<TH1F>("secondJetPhotonDeltaR", "secondJetPhotonDeltaR", 80, 0, 10);
-  mSecondJetPhotonDeltaPt = fs->make<TH1F>("secondJetPhotonDeltaPt", "secondJetPhotonDeltaPt", 100, 0, 50);
-
-  mSelectedFirstJetPhotonDeltaPhi = fs->make<TH1F>("selectedFirstJetPhotonDeltaPhi", "selectedFirstJetPhotonDeltaPhi", 50, 0., M_PI);
-  mSelectedFirstJetPhotonDeltaR = fs->make<TH1F>("selectedFirstJetPhotonDeltaR", "selectedFirstJetPhotonDeltaR", 80, 0, 10);
-
-  mSelectedSecondJetPhotonDeltaPhi = fs->make<TH1F>("selectedSecondJetPhotonDeltaPhi", "selectedSecondJetPhotonDeltaPhi", 50, 0., M_PI);
-  mSelectedSecondJetPhotonDeltaR = fs->make<TH1F>("selectedSecondJetPhotonDeltaR", "selectedSecondJetPhotonDeltaR", 80, 0, 10);
-
   mPFIsolator.initializePhotonIsolation(true);
   mPFIsolator.setConeSize(0.3);
 
-  mNeutrinos = NULL;
-  mNeutrinosPDG = NULL;
-  if (mIsMC) {
-    mNeutrinos = new TClonesArray("TLorentzVector", 3);
-    mNeutrinosPDG = new TClonesArray("TParameter<int>", 3);
-  }
+  mValidTriggers.push_back(boost::regex("HLT_.*Photon.*", boost::regex_constants::icase));
 }
 
 
@@ -415,68 +385,6 @@ GammaJetFilter::~GammaJetFilter()
   // do anything here that needs to be done at desctruction time
   // (e.g. close files, deallocate resources etc.)
 
-  delete mNeutrinos;
-  delete mNeutrinosPDG;
-}
-
-void GammaJetFilter::createTrees(const std::string& rootName, TFileService& fs) {
-
-  TFileDirectory dir = fs.mkdir(rootName);
-  std::vector<TTree*>& trees = mJetTrees[rootName];
-
-  trees.push_back(dir.make<TTree>("first_jet", "first jet tree"));
-  trees.push_back(dir.make<TTree>("second_jet", "second jet tree"));
-
-  trees.push_back(dir.make<TTree>("first_jet_raw", "first raw jet tree"));
-  trees.push_back(dir.make<TTree>("second_jet_raw", "second raw jet tree"));
-
-  if (mIsMC) {
-    trees.push_back(dir.make<TTree>("first_jet_gen", "first gen jet tree"));
-    trees.push_back(dir.make<TTree>("second_jet_gen", "second gen jet tree"));
-  } else {
-    trees.push_back(nullptr);
-    trees.push_back(nullptr);
-  }
-
-  // MET
-  std::vector<TTree*>& met = mMETTrees[rootName];
-  met.push_back(dir.make<TTree>("met", "met tree"));
-  met.push_back(dir.make<TTree>("met_raw", "met raw tree"));
-
-  if (mIsMC)
-    met.push_back(dir.make<TTree>("met_gen", "met gen tree"));
-  else
-    met.push_back(nullptr);
-
-  // Misc
-  mMiscTrees[rootName] = dir.make<TTree>("misc", "misc tree");
-}
-
-void GammaJetFilter::updateBranch(TTree* tree, void* address, const std::string& name, const std::string& type/* = "F"*/) {
-  TBranch* branch = tree->GetBranch(name.c_str());
-  if (branch == NULL) {
-    branch = tree->Branch(name.c_str(), address, std::string(name + "/" + type).c_str()); 
-  } else {
-    branch->SetAddress(address);
-  }
-}
-
-template<typename U> void GammaJetFilter::updateBranch(TTree* tree, std::vector<U>*& address, const std::string& name) {
-  TBranch* branch = tree->GetBranch(name.c_str());
-  if (branch == NULL) {
-    branch = tree->Branch(name.c_str(), &address); 
-  } else {
-    branch->SetAddress(&address);
-  }
-}
-
-void GammaJetFilter::updateBranchArray(TTree* tree, void* address, const std::string& name, const std::string& size, const std::string& type/* = "F"*/) {
-  TBranch* branch = tree->GetBranch(name.c_str());
-  if (branch == NULL) {
-    branch = tree->Branch(name.c_str(), address, std::string(name + "[" + size + "]/" +type).c_str()); 
-  } else {
-    branch->SetAddress(address);
-  }
 }
 
 //
@@ -486,14 +394,29 @@ void GammaJetFilter::updateBranchArray(TTree* tree, void* address, const std::st
 // ------------ method called on each new Event  ------------
 bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
 {
-  using namespace edm;
-
   mProcessedEvents->SetVal(mProcessedEvents->GetVal() + 1);
 
   if (! mIsMC && mFilterData && ! mIsValidLumiBlock) {
     return false;
   }
 
+  GammaJetEvent event;
+  event.jets.resize(mJetCollections.size());
+
+  if (! buildEvent(iEvent, iSetup, event))
+    return false;
+
+  mWriter->write(event);
+
+  mSelectedEvents->SetVal(mSelectedEvents->GetVal() + 1);
+  return true;
+}
+
+// ------------ selection and object building. Must not touch any output object  ------------
+bool GammaJetFilter::buildEvent(const edm::Event& iEvent, const edm::EventSetup& iSetup, GammaJetEvent& event) const
+{
+  using namespace edm;
+
   // Vertex
   edm::Handle<reco::VertexCollection> vertices;
   iEvent.getByLabel("goodOfflinePrimaryVertices", vertices);
@@ -543,6 +466,13 @@ bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
   edm::Handle<pat::PhotonCollection> photons;
   iEvent.getByLabel(mPhotonsIT, photons);
 
+  edm::Handle<double> photonRhos;
+  iEvent.getByLabel(edm::InputTag("kt6PFJets", "rho", "RECO"), photonRhos);
+  double photonRho = *photonRhos;
+
+  std::vector<PhotonIsolation> isolations;
+  getPhotonIsolations(iEvent, photons, isolations);
+
   pat::PhotonRefVector photonsRef;
 
   pat::PhotonCollection::const_iterator it = photons->begin();
@@ -551,7 +481,7 @@ bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
     //if (fabs(it->eta()) <= 1.3 && isValidPhotonEB(*it, *pFlowRho, pRecHits, *topology)) {
 
     pat::PhotonRef photon(photons, index);
-    if (fabs(it->eta()) <= 1.3 && isValidPhotonEB2012(photon, iEvent)) {
+    if (fabs(it->eta()) <= 1.3 && isValidPhotonEB2012(photon, isolations[index], photonRho)) {
       photonsRef.push_back(photon);
     }
   }
@@ -561,78 +491,43 @@ bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
     return false;
 
   const pat::PhotonRef& photon = photonsRef[0];
+  const PhotonIsolation& photonIsolation = isolations[photon.key()];
 
-  // Process jets
-
-  edm::Handle<pat::JetCollection> jetsHandle;
-
-  FOREACH(mJetCollections) {
-
-    JetInfos infos = mJetCollectionsData[*it];
-
-    iEvent.getByLabel(infos.inputTag, jetsHandle);
-    pat::JetCollection jets = *jetsHandle;
-    if (mDoJEC) {
-      correctJets(jets, iEvent, iSetup);
-    } else {
-      extractRawJets(jets);
-    }
-
-    edm::Handle<edm::ValueMap<float>>  qgTagHandleMLP;
-    edm::Handle<edm::ValueMap<float>>  qgTagHandleLikelihood;
-    iEvent.getByLabel("QGTagger" + *it,"qgMLP", qgTagHandleMLP);
-    iEvent.getByLabel("QGTagger" + *it,"qgLikelihood", qgTagHandleLikelihood);
-
-
-    processJets(photon, jets, infos.algo, qgTagHandleMLP, qgTagHandleLikelihood, jetsHandle, mJetTrees[*it]);
-
-    // MET
-    edm::Handle<pat::METCollection> metsHandle;
-    iEvent.getByLabel(std::string("patMETs" + ((*it == "AK5Calo") ? "" : *it)), metsHandle);
-
-    edm::Handle<pat::METCollection> rawMets;
-    iEvent.getByLabel(std::string("patPFMet" + ((*it == "AK5Calo") ? "" : *it)), rawMets);
-
-    pat::METCollection mets = *metsHandle;
-    pat::MET& met = mets[0];
-    const pat::MET& rawMet = rawMets->at(0);
+  // Gen particles are flattened once per event, before any concurrent access. Jet processing
+  // only reads the table when looking for neutrinos
+  GenParticleTable genParticlesTable;
+  if (mIsMC) {
+    edm::Handle<reco::GenParticleCollection> genParticles;
+    iEvent.getByLabel("genParticles", genParticles);
 
-    if (mDoJEC || mRedoTypeI) {
-      correctMETWithTypeI(rawMet, met, jets);
-    }
+    if (genParticles.isValid()) {
+      genParticlesTable.build(*genParticles, genParticles.id());
 
-    if (rawMets.isValid())
-      metsToTree(met, rawMet, mMETTrees[*it]);
-    else {
-      pat::MET emptyRawMet = pat::MET();
-      metsToTree(met, emptyRawMet, mMETTrees[*it]);
+      if (mDumpAllMCParticles)
+        genParticlesTable.toData(event.genParticles);
     }
+  }
 
-    // Rho
-    edm::Handle<double> rhos;
-    if (it->find("Calo") != std::string::npos)
-      iEvent.getByLabel(edm::InputTag("kt6CaloJets", "rho"), rhos);
-    else
-      iEvent.getByLabel(edm::InputTag("kt6PFJets", "rho"), rhos);
-
-    double rho = *rhos;
-    updateBranch(mMiscTrees[*it], &rho, "rho", "D");
-
-    mMiscTrees[*it]->Fill();
+  // Process jets. Event products are fetched serially, the processing itself can run concurrently
+  std::vector<JetCollectionInputs> inputs(mJetCollections.size());
+  for (size_t i = 0; i < mJetCollections.size(); i++) {
+    inputs[i].genParticles = (mIsMC) ? &genParticlesTable : NULL;
+    fetchJetCollection(iEvent, iSetup, mJetCollections[i], inputs[i]);
   }
 
+  processJetCollections(*photon, inputs, event.jets);
+
   // Number of vertices for pu reweighting
   edm::Handle<std::vector<PileupSummaryInfo> > puInfos;
   iEvent.getByLabel(edm::InputTag("addPileupInfo"), puInfos);
 
-  float nTrueInteractions = -1;
-  int nPUVertex = -1;
-  unsigned int nVertex = vertices->size();
+  AnalysisData& analysis = event.analysis;
 
   edm::EventID eventId = iEvent.id();
-  EventNumber_t event = eventId.event();
-  RunNumber_t run = eventId.run();
-  LuminosityBlockNumber_t lumiBlock = eventId.luminosityBlock();
+  analysis.run = eventId.run();
+  analysis.lumi_block = eventId.luminosityBlock();
+  analysis.event = eventId.event();
+  analysis.nvertex = vertices->size();
 
   if (mIsMC) {
     for (std::vector<PileupSummaryInfo>::const_iterator it = puInfos->begin(); it != puInfos->end();
@@ -640,34 +535,25 @@ bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
 
       int BX = it->getBunchCrossing();
       if (BX == 0) {
-        nPUVertex = it->getPU_NumInteractions();
-        nTrueInteractions = it->getTrueNumInteractions();
+        analysis.pu_nvertex = it->getPU_NumInteractions();
+        analysis.ntrue_interactions = it->getTrueNumInteractions();
         break;
       }
     }
 
-    if (nPUVertex < 0) {
+    if (analysis.pu_nvertex < 0) {
       throw cms::Exception("PUReweighting") << "No in-time beam crossing found!" << std::endl;
     }
   }
-  updateBranch(mAnalysisTree, &run, "run", "i");
-  updateBranch(mAnalysisTree, &lumiBlock, "lumi_block", "i");
-  updateBranch(mAnalysisTree, &event, "event", "i");
-  updateBranch(mAnalysisTree, &nVertex, "nvertex", "i");
-  updateBranch(mAnalysisTree, &nTrueInteractions, "ntrue_interactions");
-  updateBranch(mAnalysisTree, &nPUVertex, "pu_nvertex", "I");
-  updateBranch(mAnalysisTree, &mEventsWeight, "event_weight"); // Only valid for binned samples
-  updateBranch(mAnalysisTree, &generatorWeight, "generator_weight", "D"); // Only valid for flat samples
+
+  analysis.event_weight = mEventsWeight;
+  analysis.generator_weight = generatorWeight;
 
   // Triggers
   edm::Handle<edm::TriggerResults> triggerResults;
   iEvent.getByLabel(edm::InputTag("TriggerResults", "", "HLT"), triggerResults);
 
-  std::vector<std::string>* trigNames = new std::vector<std::string>();
-  std::vector<bool>* trigResults = new std::vector<bool>();
-
   if (triggerResults.isValid()) {
-    static std::vector<boost::regex> validTriggers = { boost::regex("HLT_.*Photon.*", boost::regex_constants::icase) };
     const edm::TriggerNames& triggerNames = iEvent.triggerNames(*triggerResults);
 
     size_t size = triggerResults->size();
@@ -675,7 +561,7 @@ bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
     for (size_t i = 0; i < size; i++) {
       std::string triggerName = triggerNames.triggerName(i);
       bool isValid = false;
-      for (boost::regex& validTrigger: validTriggers) {
+      for (const boost::regex& validTrigger: mValidTriggers) {
         if (boost::regex_match(triggerName, validTrigger)) {
           isValid = true;
           break;
@@ -688,84 +574,184 @@ bool GammaJetFilter::filter(edm::Event& iEvent, const edm::EventSetup& iSetup)
       unsigned int index = triggerNames.triggerIndex(triggerName);
       bool passed = triggerResults->accept(index);
 
-      trigResults->push_back(passed);
-      trigNames->push_back(triggerName);
+      analysis.trigger_results.push_back(passed);
+      analysis.trigger_names.push_back(triggerName);
     }
   }
 
-  // Create branches, even if they're empty
-  updateBranch(mAnalysisTree, trigNames, "trigger_names");
-  updateBranch(mAnalysisTree, trigResults, "trigger_results");
-
-  mAnalysisTree->Fill();
+  photonToData(photon, photonIsolation, photonRho, event.photon);
 
-  delete trigNames;
-  delete trigResults;
-
-  photonToTree(photon, iEvent);
+  if (mIsMC)
+    particleToData(photon->genPhoton(), event.genPhoton);
 
   // Electrons
   edm::Handle<pat::ElectronCollection> electrons;
   iEvent.getByLabel("selectedPatElectronsPFlowAK5chs", electrons);
-  electronsToTree(electrons, primaryVertex);
+  electronsToData(electrons, primaryVertex, event.electrons);
 
   // Muons
   edm::Handle<pat::MuonCollection> muons;
   iEvent.getByLabel("selectedPatMuonsPFlowAK5chs", muons);
-  muonsToTree(muons, primaryVertex);
+  muonsToData(muons, primaryVertex, event.muons);
 
-  mSelectedEvents->SetVal(mSelectedEvents->GetVal() + 1);
   return true;
 }
 
-void GammaJetFilter::correctJets(pat::JetCollection& jets, edm::Event& iEvent, const edm::EventSetup& iSetup) {
+void GammaJetFilter::fetchJetCollection(const edm::Event& iEvent, const edm::EventSetup& iSetup, const std::string& name, JetCollectionInputs& inputs) const {
+
+  const JetInfos& infos = mJetCollectionsData.find(name)->second;
+
+  inputs.algo = infos.algo;
+
+  iEvent.getByLabel(infos.inputTag, inputs.jetsHandle);
+
+  // Type-I MET is redone as soon as JEC is, and needs the corrected pt of every jet: correct them
+  // all here, where the jet corrector may read products from the event. The jet selection then
+  // only orders the few jets it looks at
+  if (mDoJEC) {
+    correctJets(*inputs.jetsHandle, inputs.correctedJets, iEvent, iSetup);
+  }
+
+  iEvent.getByLabel("QGTagger" + name,"qgMLP", inputs.qgTagMLP);
+  iEvent.getByLabel("QGTagger" + name,"qgLikelihood", inputs.qgTagLikelihood);
+
+  // MET
+  iEvent.getByLabel(std::string("patMETs" + ((name == "AK5Calo") ? "" : name)), inputs.mets);
+  iEvent.getByLabel(std::string("patPFMet" + ((name == "AK5Calo") ? "" : name)), inputs.rawMets);
+
+  // Rho
+  edm::Handle<double> rhos;
+  if (name.find("Calo") != std::string::npos)
+    iEvent.getByLabel(edm::InputTag("kt6CaloJets", "rho"), rhos);
+  else
+    iEvent.getByLabel(edm::InputTag("kt6PFJets", "rho"), rhos);
+
+  inputs.rho = *rhos;
+
+  // Gen matching
+  inputs.genMatches.clear();
+  if (! inputs.genParticles)
+    return;
+
+  const pat::JetCollection& jets = *inputs.jetsHandle;
+  inputs.genMatches.resize(jets.size());
+  for (size_t i = 0; i < jets.size(); i++) {
+    const pat::Jet& jet = jets[i];
+    GenMatch& match = inputs.genMatches[i];
+
+    match.genJet = jet.genJet();
+
+    // Partons of the gen particles collection are taken from the table, from the key of their Ref
+    int partonIndex = inputs.genParticles->indexOf(jet.genParticleRef());
+    match.parton = (partonIndex >= 0) ? &inputs.genParticles->particle(partonIndex) : jet.genParton();
+
+    // Neutrinos are looked for in b and c jets only
+    if (match.parton && (abs(match.parton->pdgId()) == 5 || abs(match.parton->pdgId()) == 4))
+      inputs.genParticles->decayRoots(*match.parton, match.partonDecay);
+  }
+}
+
+void GammaJetFilter::processJetCollection(const pat::Photon& photon, JetCollectionInputs& inputs, JetCollectionData& data) const {
+
+  const pat::JetCollection& jets = *inputs.jetsHandle;
+  if (! mDoJEC) {
+    extractRawJets(jets, inputs.correctedJets);
+  }
+
+  processJets(photon, inputs, data);
+
+  // MET
+  pat::METCollection mets = *inputs.mets;
+  pat::MET& met = mets[0];
+  const pat::MET& rawMet = inputs.rawMets->at(0);
+
+  if (mDoJEC || mRedoTypeI) {
+    correctMETWithTypeI(rawMet, met, jets, inputs.correctedJets);
+  }
+
+  if (inputs.rawMets.isValid())
+    metsToData(met, rawMet, data);
+  else {
+    pat::MET emptyRawMet = pat::MET();
+    metsToData(met, emptyRawMet, data);
+  }
+
+  data.rho = inputs.rho;
+}
+
+void GammaJetFilter::processJetCollections(const pat::Photon& photon, std::vector<JetCollectionInputs>& inputs, std::vector<JetCollectionData>& data) const {
+
+  if (mJetCollectionWorkers->threads() <= 1) {
+    for (size_t i = 0; i < inputs.size(); i++) {
+      processJetCollection(photon, inputs[i], data[i]);
+    }
+
+    return;
+  }
+
+  // Each collection only writes into its own slot of 'data', so the output order does
+  // not depend on scheduling
+  std::vector<std::exception_ptr> errors(inputs.size());
+
+  mJetCollectionWorkers->run(inputs.size(), [&] (size_t i) {
+    try {
+      processJetCollection(photon, inputs[i], data[i]);
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  });
+
+  for (const std::exception_ptr& error: errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+void GammaJetFilter::correctJets(const pat::JetCollection& jets, std::vector<CorrectedJet>& correctedJets, const edm::Event& iEvent, const edm::EventSetup& iSetup) const {
 
   // Get Jet corrector
   const JetCorrector* corrector = JetCorrector::getJetCorrector(mCorrectorLabel, iSetup);
 
-  // Correct jets
-  for (pat::JetCollection::iterator it = jets.begin(); it != jets.end(); ++it)  {
-    pat::Jet& jet = *it;
+  correctedJets.resize(jets.size());
+
+  // Correct jets. The input collection is left untouched, so the raw jet can always be retrieved from it
+  for (size_t i = 0; i < jets.size(); i++) {
+    const pat::Jet& jet = jets[i];
+    CorrectedJet& correctedJet = correctedJets[i];
 
-    // Store raw jet, it's not possible to get it after corrections
-    pat::Jet rawJet = jet.correctedJet("Uncorrected");
-    jet.addUserData("rawJet", rawJet, true); // Store raw jet inside our jet. This allow us to correctly sort the resulting collection
-    pat::Jet L1Jet  = jet.correctedJet("L1FastJet");
-    jet.addUserData("L1Jet", L1Jet, true); // Embed L1 corrected jet for TypeI correction
+    correctedJet.L1p4 = jet.p4() * jet.jecFactor("L1FastJet");
 
+    // Correctors may look at the concrete jet type, its constituents or its energy fractions:
+    // give them the full pat::Jet
+    pat::Jet jetToCorrect = jet;
     if (mJECFromRaw) {
-      double toRaw = jet.jecFactor("Uncorrected");
-      jet.setP4(jet.p4() * toRaw); // It's now a raw jet
+      jetToCorrect.setP4(jet.p4() * jet.jecFactor("Uncorrected")); // It's now a raw jet
     }
 
-    double corrections = corrector->correction(jet, iEvent, iSetup);
-    jet.scaleEnergy(corrections);
+    correctedJet.p4 = jetToCorrect.p4() * corrector->correction(jetToCorrect, iEvent, iSetup);
   }
-
-  // Sort collection by pt
-  std::sort(jets.begin(), jets.end(), mSorter);
 }
 
-void GammaJetFilter::correctMETWithTypeI(const pat::MET& rawMet, pat::MET& met, const pat::JetCollection& jets) {
+void GammaJetFilter::correctMETWithTypeI(const pat::MET& rawMet, pat::MET& met, const pat::JetCollection& jets, const std::vector<CorrectedJet>& correctedJets) const {
   double deltaPx = 0., deltaPy = 0.;
   //static StringCutObjectSelector<reco::Muon> skipMuonSelection("isGlobalMuon | isStandAloneMuon");
 
   // See https://indico.cern.ch/getFile.py/access?contribId=1&resId=0&materialId=slides&confId=174324 slide 4
   // and http://cmssw.cvs.cern.ch/cgi-bin/cmssw.cgi/CMSSW/JetMETCorrections/Type1MET/interface/PFJetMETcorrInputProducerT.h?revision=1.8&view=markup
-  for (pat::JetCollection::const_iterator it = jets.begin(); it != jets.end(); ++it) {
-    const pat::Jet& jet = *it;
+  for (size_t i = 0; i < jets.size(); i++) {
+    const CorrectedJet& jet = correctedJets[i];
 
-    if (jet.pt() > 10) {
+    if (jet.p4.pt() > 10) {
 
-      const pat::Jet* rawJet = jet.userData<pat::Jet>("rawJet");
-      const pat::Jet* L1Jet  = jet.userData<pat::Jet>("L1Jet");
+      // Energy fractions do not depend on the correction level
+      const pat::Jet& rawJet = jets[i];
 
-      double emEnergyFraction = rawJet->chargedEmEnergyFraction() + rawJet->neutralEmEnergyFraction();
+      double emEnergyFraction = rawJet.chargedEmEnergyFraction() + rawJet.neutralEmEnergyFraction();
       if (emEnergyFraction > 0.90)
         continue;
 
       //reco::Candidate::LorentzVector rawJetP4 = rawJet->p4();
-      reco::Candidate::LorentzVector L1JetP4  = L1Jet->p4();
+      const reco::Candidate::LorentzVector& L1JetP4  = jet.L1p4;
 
       // Skip muons
       /*std::vector<reco::PFCandidatePtr> cands = rawJet->getPFConstituents();
@@ -777,8 +763,8 @@ void GammaJetFilter::correctMETWithTypeI(const pat::MET& rawMet, pat::MET& met,
       }*/
 
 
-      deltaPx += (jet.px() - L1JetP4.px());
-      deltaPy += (jet.py() - L1JetP4.py());
+      deltaPx += (jet.p4.px() - L1JetP4.px());
+      deltaPy += (jet.p4.py() - L1JetP4.py());
     }
   }
 
@@ -789,51 +775,90 @@ void GammaJetFilter::correctMETWithTypeI(const pat::MET& rawMet, pat::MET& met,
   met.setP4(reco::Candidate::LorentzVector(correctedMetPx, correctedMetPy, 0., correctedMetPt));
 }
 
-void GammaJetFilter::extractRawJets(pat::JetCollection& jets) {
+void GammaJetFilter::extractRawJets(const pat::JetCollection& jets, std::vector<CorrectedJet>& correctedJets) const {
+
+  correctedJets.resize(jets.size());
 
-  for (pat::JetCollection::iterator it = jets.begin(); it != jets.end(); ++it) {
-    pat::Jet& jet = *it;
+  for (size_t i = 0; i < jets.size(); i++) {
+    const pat::Jet& jet = jets[i];
 
-    const pat::Jet rawJet = jet.correctedJet("Uncorrected");
-    jet.addUserData("rawJet", rawJet, true);
-    const pat::Jet L1Jet  = jet.correctedJet("L1FastJet");
-    jet.addUserData("L1Jet", L1Jet, true); // Embed L1 corrected jet for TypeI correction
+    correctedJets[i].p4 = jet.p4();
+    correctedJets[i].L1p4 = jet.p4() * jet.jecFactor("L1FastJet"); // For TypeI correction
   }
 
 }
 
-void GammaJetFilter::processJets(const pat::PhotonRef& photon, pat::JetCollection& jets, const JetAlgorithm algo, edm::Handle<edm::ValueMap<float>>& qgTagMLP, edm::Handle<edm::ValueMap<float>>& qgTagLikelihood, const edm::Handle<pat::JetCollection>& handleForRef, std::vector<TTree*>& trees) {
+void GammaJetFilter::processJets(const pat::Photon& photon, const JetCollectionInputs& inputs, JetCollectionData& data) const {
+
+  const pat::JetCollection& jets = *inputs.jetsHandle;
+  const std::vector<CorrectedJet>& correctedJets = inputs.correctedJets;
 
   pat::JetCollection selectedJets;
+  pat::JetCollection selectedRawJets;
+  std::vector<const GenMatch*> selectedGenMatches;
+  JetSelectionMonitoring& monitoring = data.monitoring;
 
-  pat::JetCollection::iterator it = jets.begin();
-  uint32_t index = 0;
+  // Calo jet ID is only created if needed. It's not const, so keep it local to this call
+  boost::shared_ptr<JetIDSelectionFunctor> caloJetID;
+
+  // Once corrected, jets must be visited by decreasing pt. Only the first few jets are
+  // looked at, so instead of sorting the whole collection, pop them one by one from a heap
+  std::vector<uint32_t> order(jets.size());
+  for (uint32_t i = 0; i < order.size(); i++)
+    order[i] = i;
+
+  auto lowerPt = [&correctedJets] (uint32_t a, uint32_t b) {
+    return correctedJets[a].p4.pt() < correctedJets[b].p4.pt();
+  };
+
+  if (mDoJEC)
+    std::make_heap(order.begin(), order.end(), lowerPt);
+
+  std::vector<uint32_t>::iterator heapEnd = order.end();
+
+  uint32_t index = 0; // Rank by decreasing pt
   uint32_t goodJetIndex = -1;
-  for (; it != jets.end(); ++it, index++) {
+  for (; index < jets.size(); index++) {
+
+    uint32_t jetIndex = index; // Index inside the input collection
+    if (mDoJEC) {
+      std::pop_heap(order.begin(), heapEnd, lowerPt);
+      jetIndex = *(--heapEnd);
+    }
+
+    // First, check if this jet has a gen jet
+    const GenMatch* genMatch = (mIsMC) ? &inputs.genMatches[jetIndex] : NULL;
+    if (genMatch && ! genMatch->genJet)
+      continue;
+
+    // Copy only the jets we look at
+    pat::Jet jet = jets[jetIndex];
+    if (mDoJEC)
+      jet.setP4(correctedJets[jetIndex].p4);
 
-    if (! isValidJet(*it))
+    if (! isValidJet(jet, caloJetID))
       continue;
 
     goodJetIndex++;
 
     if (goodJetIndex == 0) {
-      mFirstJetPhotonDeltaPhi->Fill(fabs(reco::deltaPhi(*photon, *it)));
-      mFirstJetPhotonDeltaR->Fill(reco::deltaR(*photon, *it));
-      mFirstJetPhotonDeltaPt->Fill(fabs(photon->pt() - it->pt()));
-
-      mFirstJetPhotonDeltaPhiDeltaR->Fill(fabs(reco::deltaPhi(*photon, *it)), reco::deltaR(*photon, *it));
+      monitoring.hasFirstGoodJet = true;
+      monitoring.firstGoodJetDeltaPhi = fabs(reco::deltaPhi(photon, jet));
+      monitoring.firstGoodJetDeltaR = reco::deltaR(photon, jet);
+      monitoring.firstGoodJetDeltaPt = fabs(photon.pt() - jet.pt());
     } else if (goodJetIndex == 1) {
-      mSecondJetPhotonDeltaPhi->Fill(fabs(reco::deltaPhi(*photon, *it)));
-      mSecondJetPhotonDeltaR->Fill(reco::deltaR(*photon, *it));
-      mSecondJetPhotonDeltaPt->Fill(fabs(photon->pt() - it->pt()));
+      monitoring.hasSecondGoodJet = true;
+      monitoring.secondGoodJetDeltaPhi = fabs(reco::deltaPhi(photon, jet));
+      monitoring.secondGoodJetDeltaR = reco::deltaR(photon, jet);
+      monitoring.secondGoodJetDeltaPt = fabs(photon.pt() - jet.pt());
     }
 
     // Extract Quark Gluon tagger value
-    pat::JetRef jetRef(handleForRef, index);
-    it->addUserFloat("qgTagMLP", (*qgTagMLP)[jetRef]);
-    it->addUserFloat("qgTagLikelihood", (*qgTagLikelihood)[jetRef]);
+    pat::JetRef jetRef(inputs.jetsHandle, jetIndex);
+    jet.addUserFloat("qgTagMLP", (*inputs.qgTagMLP)[jetRef]);
+    jet.addUserFloat("qgTagLikelihood", (*inputs.qgTagLikelihood)[jetRef]);
 
-    const double deltaR_threshold = (algo == AK5) ? 0.5 : 0.7;
+    const double deltaR_threshold = (inputs.algo == AK5) ? 0.5 : 0.7;
 
     if (selectedJets.size() == 0) {
       // First jet selection
@@ -844,11 +869,11 @@ void GammaJetFilter::processJets(const pat::PhotonRef& photon, pat::JetCollectio
         break;
       }
 
-      const double deltaPhi = reco::deltaPhi(*photon, *it);
+      const double deltaPhi = reco::deltaPhi(photon, jet);
       if (fabs(deltaPhi) < M_PI / 2.)
         continue; // Only back 2 back event are interesting
 
-      const double deltaR = reco::deltaR(*photon, *it);
+      const double deltaR = reco::deltaR(photon, jet);
       if (deltaR < deltaR_threshold) // This jet is inside the photon. This is probably the photon mis-reconstructed as a jet
         continue;
 
@@ -856,20 +881,24 @@ void GammaJetFilter::processJets(const pat::PhotonRef& photon, pat::JetCollectio
       // Events are supposed to be balanced between Jet and Gamma
       // If the leading jet has less than 30% of the Photon pt,
       // dump the event as it's not interesting
-      if (mFirstJetPtCut && (it->pt() < photon->pt() * mFirstJetThreshold))
+      if (mFirstJetPtCut && (jet.pt() < photon.pt() * mFirstJetThreshold))
         break;
 
-      mSelectedFirstJetIndex->Fill(goodJetIndex);
-      selectedJets.push_back(*it);
+      monitoring.selectedFirstJetIndex = goodJetIndex;
+      selectedJets.push_back(jet);
+      selectedRawJets.push_back(jets[jetIndex].correctedJet("Uncorrected"));
+      selectedGenMatches.push_back(genMatch);
 
     } else {
 
       // Second jet selection
-      const double deltaR = reco::deltaR(*photon, *it);
+      const double deltaR = reco::deltaR(photon, jet);
 
       if (deltaR > deltaR_threshold) {
-        mSelectedSecondJetIndex->Fill(goodJetIndex);
-        selectedJets.push_back(*it);
+        monitoring.selectedSecondJetIndex = goodJetIndex;
+        selectedJets.push_back(jet);
+        selectedRawJets.push_back(jets[jetIndex].correctedJet("Uncorrected"));
+        selectedGenMatches.push_back(genMatch);
       } else {
         continue;
       }
@@ -880,23 +909,31 @@ void GammaJetFilter::processJets(const pat::PhotonRef& photon, pat::JetCollectio
   }
 
   const pat::Jet* firstJet = NULL;
+  const pat::Jet* firstRawJet = NULL;
   const pat::Jet* secondJet = NULL;
+  const pat::Jet* secondRawJet = NULL;
+  const GenMatch* firstGenMatch = NULL;
+  const GenMatch* secondGenMatch = NULL;
 
   if (selectedJets.size() > 0) {
 
     firstJet = &selectedJets[0];
-    mSelectedFirstJetPhotonDeltaPhi->Fill(fabs(reco::deltaPhi(*photon, *firstJet)));
-    mSelectedFirstJetPhotonDeltaR->Fill(reco::deltaR(*photon, *firstJet));
+    firstRawJet = &selectedRawJets[0];
+    firstGenMatch = selectedGenMatches[0];
+    monitoring.selectedFirstJetDeltaPhi = fabs(reco::deltaPhi(photon, *firstJet));
+    monitoring.selectedFirstJetDeltaR = reco::deltaR(photon, *firstJet);
 
     if (selectedJets.size() > 1) {
       secondJet = &selectedJets[1];
+      secondRawJet = &selectedRawJets[1];
+      secondGenMatch = selectedGenMatches[1];
 
-      mSelectedSecondJetPhotonDeltaPhi->Fill(fabs(reco::deltaPhi(*photon, *secondJet)));
-      mSelectedSecondJetPhotonDeltaR->Fill(reco::deltaR(*photon, *secondJet));
+      monitoring.selectedSecondJetDeltaPhi = fabs(reco::deltaPhi(photon, *secondJet));
+      monitoring.selectedSecondJetDeltaR = reco::deltaR(photon, *secondJet);
     }
   }
 
-  jetsToTree(firstJet, secondJet, trees);
+  jetsToData(firstJet, firstRawJet, secondJet, secondRawJet, firstGenMatch, secondGenMatch, inputs.genParticles, data);
 
   return;
 }
@@ -915,13 +952,10 @@ bool GammaJetFilter::beginRun(edm::Run& run, edm::EventSetup const&)
 {
   if (! mIsMC && mFilterData) {
     // Check if this run is valid
-    std::stringstream stream;
-    stream << run.run();
+    mCurrentRun = mLumiMask.getRun(run.run());
 
-    if (! mValidRuns->isMember(stream.str()))
+    if (! mCurrentRun)
       return false; // Drop run
-
-    mCurrentRunValidLumis.reset(new Json::Value((*mValidRuns)[stream.str()]));
   }
 
   return true;
@@ -940,23 +974,12 @@ bool GammaJetFilter::beginLuminosityBlock(edm::LuminosityBlock& lumiBlock, edm::
 
     mIsValidLumiBlock = false;
 
-    if (! mCurrentRunValidLumis.get())
+    if (! mCurrentRun)
       return false;
 
     // Check if this lumi block is valid
-    assert(mCurrentRunValidLumis->isArray());
-    for (Json::ArrayIndex i = 0; i < mCurrentRunValidLumis->size(); i++) {
-      Json::Value lumiRange = (*mCurrentRunValidLumis)[i];
-
-      assert(lumiRange.size() == 2);
-      edm::LuminosityBlockNumber_t lumi = lumiBlock.luminosityBlock();
-      if (lumi >= lumiRange[0].asUInt64() && lumi <= lumiRange[1].asUInt64()) {
-        mIsValidLumiBlock = true;
-        return true;
-      }
-    }
-
-    return false;
+    mIsValidLumiBlock = mLumiMask.isValid(*mCurrentRun, lumiBlock.luminosityBlock());
+    return mIsValidLumiBlock;
   }
 
   return true;
@@ -980,12 +1003,8 @@ void GammaJetFilter::fillDescriptions(edm::ConfigurationDescriptions& descriptio
   descriptions.addDefault(desc);
 }
 
-bool GammaJetFilter::isValidJet(const pat::Jet& jet) {
-  // First, check if this pat::Jet has a gen jet
-  if (mIsMC && !jet.genJet()) {
-    return false;
-  }
-
+// Jets without gen jet are rejected before, from the gen matching done while fetching the collection
+bool GammaJetFilter::isValidJet(const pat::Jet& jet, boost::shared_ptr<JetIDSelectionFunctor>& caloJetID) const {
   if (jet.isPFJet()) {
 
     // Jet ID
@@ -1006,13 +1025,12 @@ bool GammaJetFilter::isValidJet(const pat::Jet& jet) {
 
   } else if (jet.isCaloJet() || jet.isJPTJet()) {
 
-    if (! mCaloJetID.get()) {
-      mCaloJetID.reset(new JetIDSelectionFunctor(JetIDSelectionFunctor::PURE09, JetIDSelectionFunctor::LOOSE));
-      mCaloJetIDRet = mCaloJetID->getBitTemplate();
+    if (! caloJetID.get()) {
+      caloJetID.reset(new JetIDSelectionFunctor(JetIDSelectionFunctor::PURE09, JetIDSelectionFunctor::LOOSE));
     }
 
-    mCaloJetIDRet.set(false);
-    return (*mCaloJetID)(jet, mCaloJetIDRet);
+    pat::strbitset ret = caloJetID->getBitTemplate();
+    return (*caloJetID)(jet, ret);
 
   } else {
     throw cms::Exception("UnsupportedJetType")
@@ -1092,8 +1110,55 @@ double getCorrectedPFIsolation(double isolation, double rho, float eta, Isolatio
   return std::max(isolation - rho * effectiveArea, 0.);
 }
 
+// Isolations are produced at PAT level by the PhotonIsolationProducer. Older PAT tuples have one
+// ValueMap per isolation instead of a single packed one
+void GammaJetFilter::getPhotonIsolations(const edm::Event& event, const edm::Handle<pat::PhotonCollection>& photons, std::vector<PhotonIsolation>& isolations) const {
+
+  isolations.resize(photons->size());
+
+  edm::Handle<edm::ValueMap<PhotonIsolation>> isolationsHandle;
+  event.getByLabel(edm::InputTag("photonPFIsolation", "", "PAT"), isolationsHandle);
+
+  if (isolationsHandle.isValid()) {
+    for (size_t i = 0; i < photons->size(); i++) {
+      isolations[i] = (*isolationsHandle)[pat::PhotonRef(photons, i)];
+    }
+
+    return;
+  }
+
+  edm::Handle<edm::ValueMap<bool>> hasMatchedPromptElectronHandle;
+  event.getByLabel(edm::InputTag("photonPFIsolation", "hasMatchedPromptElectron", "PAT"), hasMatchedPromptElectronHandle);
+
+  edm::Handle<edm::ValueMap<double>> chargedHadronsIsolationHandle;
+  event.getByLabel(edm::InputTag("photonPFIsolation", "chargedHadronsIsolation", "PAT"), chargedHadronsIsolationHandle);
+
+  edm::Handle<edm::ValueMap<double>> neutralHadronsIsolationHandle;
+  event.getByLabel(edm::InputTag("photonPFIsolation", "neutralHadronsIsolation", "PAT"), neutralHadronsIsolationHandle);
+
+  edm::Handle<edm::ValueMap<double>> photonIsolationHandle;
+  event.getByLabel(edm::InputTag("photonPFIsolation", "photonIsolation", "PAT"), photonIsolationHandle);
+
+  for (size_t i = 0; i < photons->size(); i++) {
+    pat::PhotonRef photonRef(photons, i);
+    PhotonIsolation& isolation = isolations[i];
+
+    isolation.chargedHadronsIsolation = (*chargedHadronsIsolationHandle)[photonRef];
+    isolation.neutralHadronsIsolation = (*neutralHadronsIsolationHandle)[photonRef];
+    isolation.photonIsolation = (*photonIsolationHandle)[photonRef];
+
+    // Negative isolations flag photons skipped by the producer preselection
+    isolation.flags = 0;
+    if (isolation.chargedHadronsIsolation >= 0 && isolation.neutralHadronsIsolation >= 0 && isolation.photonIsolation >= 0)
+      isolation.flags |= PhotonIsolation::COMPUTED;
+
+    if ((*hasMatchedPromptElectronHandle)[photonRef])
+      isolation.flags |= PhotonIsolation::HAS_MATCHED_PROMPT_ELECTRON;
+  }
+}
+
 // See https://twiki.cern.ch/twiki/bin/viewauth/CMS/CutBasedPhotonID2012
-bool GammaJetFilter::isValidPhotonEB2012(const pat::PhotonRef& photonRef, edm::Event& event) {
+bool GammaJetFilter::isValidPhotonEB2012(const pat::PhotonRef& photonRef, const PhotonIsolation& isolation, double rho) const {
   if (mIsMC && !photonRef->genPhoton())
     return false;
 
@@ -1105,36 +1170,24 @@ bool GammaJetFilter::isValidPhotonEB2012(const pat::PhotonRef& photonRef, edm::E
   if (! isValid)
     return false;
 
-  edm::Handle<double> rhos;
-  event.getByLabel(edm::InputTag("kt6PFJets", "rho", "RECO"), rhos);
-  double rho = *rhos;
-
-  // Isolations are produced at PAT level by the PḧotonPFIsolation producer
-  edm::Handle<edm::ValueMap<bool>> hasMatchedPromptElectronHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "hasMatchedPromptElectron", "PAT"), hasMatchedPromptElectronHandle);
+  // Photons skipped by the producer preselection have no isolation
+  if (! isolation.isComputed())
+    return false;
 
-  isValid &= ! (*hasMatchedPromptElectronHandle)[photonRef];
+  isValid &= ! isolation.hasMatchedPromptElectron();
 
   if (! isValid)
     return false;
 
   // Now, isolations
-  edm::Handle<edm::ValueMap<double>> chargedHadronsIsolationHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "chargedHadronsIsolation", "PAT"), chargedHadronsIsolationHandle);
-
-  edm::Handle<edm::ValueMap<double>> neutralHadronsIsolationHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "neutralHadronsIsolation", "PAT"), neutralHadronsIsolationHandle);
-
-  edm::Handle<edm::ValueMap<double>> photonIsolationHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "photonIsolation", "PAT"), photonIsolationHandle);
-
-  isValid &= getCorrectedPFIsolation((*chargedHadronsIsolationHandle)[photonRef], rho, photonRef->eta(), IsolationType::CHARGED_HADRONS) < 0.7;
-  isValid &= getCorrectedPFIsolation((*neutralHadronsIsolationHandle)[photonRef], rho, photonRef->eta(), IsolationType::NEUTRAL_HADRONS) < (0.4 + 0.04 * photonRef->pt());
-  isValid &= getCorrectedPFIsolation((*photonIsolationHandle)[photonRef], rho, photonRef->eta(), IsolationType::PHOTONS) < (0.5 + 0.005 * photonRef->pt());
+  isValid &= getCorrectedPFIsolation(isolation.chargedHadronsIsolation, rho, photonRef->eta(), IsolationType::CHARGED_HADRONS) < 0.7;
+  isValid &= getCorrectedPFIsolation(isolation.neutralHadronsIsolation, rho, photonRef->eta(), IsolationType::NEUTRAL_HADRONS) < (0.4 + 0.04 * photonRef->pt());
+  isValid &= getCorrectedPFIsolation(isolation.photonIsolation, rho, photonRef->eta(), IsolationType::PHOTONS) < (0.5 + 0.005 * photonRef->pt());
 
   return isValid;
 }
-bool GammaJetFilter::isValidPhotonEB(const pat::Photon& photon, const double rho, const EcalRecHitCollection* recHits, const CaloTopology& topology) {
+
+bool GammaJetFilter::isValidPhotonEB(const pat::Photon& photon, const double rho, const EcalRecHitCollection* recHits, const CaloTopology& topology) const {
   if (mIsMC && !photon.genPhoton())
     return false;
 
@@ -1189,415 +1242,236 @@ bool GammaJetFilter::isValidPhotonEB(const pat::Photon& photon, const double rho
   }*/
 
 void GammaJetFilter::readJSONFile() {
+
+  // 'json' can directly point to a lumi mask compiled by a previous job
+  if (LumiMask::isCompiled(mJSONFile)) {
+    if (! mLumiMask.read(mJSONFile, 0, false)) {
+      throw cms::Exception("ReadError")
+        << "Failed to read compiled luminosity mask '" << mJSONFile << "'" << std::endl;
+    }
+
+    return;
+  }
+
+  BinaryCache::MappedFile file(mJSONFile);
+  if (! file.isValid()) {
+    throw cms::Exception("ReadError")
+      << "Failed to open luminosity JSON file '" << mJSONFile << "'" << std::endl;
+  }
+
+  uint64_t hash = file.hash();
+
+  if (! mJSONCacheFile.empty() && mLumiMask.read(mJSONCacheFile, hash))
+    return;
+
   Json::Value root;
   Json::Reader reader;
-  std::ifstream file(mJSONFile.c_str());
-  if (! reader.parse(file, root)) {
+  if (! reader.parse(file.begin(), file.end(), root)) {
     throw cms::Exception("ReadError")
       << "Failed to parse luminosity JSON file '" << mJSONFile << "'" << std::endl;
   }
 
-  mValidRuns.reset(new Json::Value(root));
+  mLumiMask.build(root);
+
+  if (! mJSONCacheFile.empty() && ! mLumiMask.write(mJSONCacheFile, hash)) {
+    std::cout << "Warning: failed to write compiled luminosity mask to '" << mJSONCacheFile << "'" << std::endl;
+  }
 }
 
 void GammaJetFilter::readCSVFile() {
-  FILE* iff = fopen(mCSVFile.c_str(), "r");
+  BinaryCache::MappedFile file(mCSVFile);
 
-  if(iff == 0) {
+  if (! file.isValid()) {
     throw cms::Exception("ReadError")
       << "Failed to parse luminosity CSV file '" << mCSVFile << "'" << std::endl;
   }
 
-  int run = 0, fill = 0;
-  int lumiSection_left = 0, lumiSection_right = 0;
-  double lumiRecorded = 0.;
-
-
-  /* lumiCalc2 format :
-   * Run:Fill,LS,UTCTime,Beam Status,E(GeV),Delivered(/ub),Recorded(/ub),avgPU
-   * use 'lumiCalc2.py -i lumiSummary.json -o output.csv -b stable lumibyls' to generate file
-   */
+  uint64_t hash = file.hash();
 
-  // Skip header line
-  char buffer[1024];
-  fgets(buffer, 1024, iff);
-
-  while (fscanf(iff, "%d:%d,%d:%d,%*[^,],%*[^,],%*f,%*f,%lf,%*f", &run, &fill, &lumiSection_left, &lumiSection_right, &lumiRecorded) > 0 ) {
+  if (! mCSVCacheFile.empty() && mLumiByLS.read(mCSVCacheFile, hash))
+    return;
 
-    if (lumiSection_right == 0)
-      continue;
+  mLumiByLS.parse(file.begin(), file.end());
 
-    mLumiByLS[std::pair<unsigned int, unsigned int>(run, lumiSection_right)] = lumiRecorded; //in mb^(-1)
+  if (! mCSVCacheFile.empty() && ! mLumiByLS.write(mCSVCacheFile, hash)) {
+    std::cout << "Warning: failed to write compiled luminosity table to '" << mCSVCacheFile << "'" << std::endl;
   }
-
-  fclose(iff);
-
-  assert(mLumiByLS.size() > 0);
 }
 
 void GammaJetFilter::updateLuminosity(const edm::LuminosityBlock& lumiBlock) {
-  double eventLumi = mLumiByLS[std::pair<unsigned int, unsigned int>(lumiBlock.id().run(), lumiBlock.id().luminosityBlock())];
+  double eventLumi = mLumiByLS.get(lumiBlock.id().run(), lumiBlock.id().luminosityBlock());
   double newLumi = mTotalLuminosity->GetVal() + eventLumi;
   mTotalLuminosity->SetVal(newLumi);
 }
 
-void GammaJetFilter::particleToTree(const reco::Candidate* particle, TTree* t, std::vector<boost::shared_ptr<void> >& addresses) {
-  addresses.clear();
-
-  addresses.push_back(boost::shared_ptr<void>(new int((particle) ? 1 : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->et() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->pt() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->eta() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->phi() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->px() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->py() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->pz() : 0)));
-  addresses.push_back(boost::shared_ptr<void>(new float((particle) ? particle->energy() : 0)));
-
-  updateBranch(t, addresses[0].get(), "is_present", "I");
-  updateBranch(t, addresses[1].get(), "et");
-  updateBranch(t, addresses[2].get(), "pt");
-  updateBranch(t, addresses[3].get(), "eta");
-  updateBranch(t, addresses[4].get(), "phi");
-  updateBranch(t, addresses[5].get(), "px");
-  updateBranch(t, addresses[6].get(), "py");
-  updateBranch(t, addresses[7].get(), "pz");
-  updateBranch(t, addresses[8].get(), "e");
+void GammaJetFilter::particleToData(const reco::Candidate* particle, ParticleData& data) const {
+  data.is_present = (particle) ? 1 : 0;
+  data.et         = (particle) ? particle->et() : 0;
+  data.pt         = (particle) ? particle->pt() : 0;
+  data.eta        = (particle) ? particle->eta() : 0;
+  data.phi        = (particle) ? particle->phi() : 0;
+  data.px         = (particle) ? particle->px() : 0;
+  data.py         = (particle) ? particle->py() : 0;
+  data.pz         = (particle) ? particle->pz() : 0;
+  data.e          = (particle) ? particle->energy() : 0;
 }
 
-void GammaJetFilter::photonToTree(const pat::PhotonRef& photon, const edm::Event& event) {
-  std::vector<boost::shared_ptr<void> > addresses;
+void GammaJetFilter::photonToData(const pat::PhotonRef& photon, const PhotonIsolation& isolation, double rho, PhotonData& data) const {
+  particleToData(&(*photon), data);
 
-  particleToTree(&(*photon), mPhotonTree, addresses);
-  
-  bool hasPixelSeed = photon->hasPixelSeed();
-  updateBranch(mPhotonTree, &hasPixelSeed, "has_pixel_seed", "O");
+  data.has_pixel_seed = photon->hasPixelSeed();
 
   // Photon ID related
-  float hadTowOverEm = photon->hadTowOverEm();
-  updateBranch(mPhotonTree, &hadTowOverEm, "hadTowOverEm");
-
-  float sigmaIetaIeta = photon->sigmaIetaIeta();
-  updateBranch(mPhotonTree, &sigmaIetaIeta, "sigmaIetaIeta");
-
-  edm::Handle<double> rhos;
-  event.getByLabel(edm::InputTag("kt6PFJets", "rho", "RECO"), rhos);
-  float rho = *rhos;
-  updateBranch(mPhotonTree, &rho, "rho");
-
-  // Isolations are produced at PAT level by the PḧotonPFIsolation producer
-  edm::Handle<edm::ValueMap<bool>> hasMatchedPromptElectronHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "hasMatchedPromptElectron", "PAT"), hasMatchedPromptElectronHandle);
-
-  bool hasMatchedPromptElectron = (*hasMatchedPromptElectronHandle)[photon];
-  updateBranch(mPhotonTree, &hasMatchedPromptElectron, "hasMatchedPromptElectron", "O");
-
-  // Now, isolations
-  edm::Handle<edm::ValueMap<double>> chargedHadronsIsolationHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "chargedHadronsIsolation", "PAT"), chargedHadronsIsolationHandle);
-
-  edm::Handle<edm::ValueMap<double>> neutralHadronsIsolationHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "neutralHadronsIsolation", "PAT"), neutralHadronsIsolationHandle);
-
-  edm::Handle<edm::ValueMap<double>> photonIsolationHandle;
-  event.getByLabel(edm::InputTag("photonPFIsolation", "photonIsolation", "PAT"), photonIsolationHandle);
+  data.hadTowOverEm = photon->hadTowOverEm();
+  data.sigmaIetaIeta = photon->sigmaIetaIeta();
+  data.rho = rho;
 
-  float chargedHadronsIsolation = getCorrectedPFIsolation((*chargedHadronsIsolationHandle)[photon], rho, photon->eta(), IsolationType::CHARGED_HADRONS);
-  float neutralHadronsIsolation = getCorrectedPFIsolation((*neutralHadronsIsolationHandle)[photon], rho, photon->eta(), IsolationType::NEUTRAL_HADRONS);
-  float photonIsolation = getCorrectedPFIsolation((*photonIsolationHandle)[photon], rho, photon->eta(), IsolationType::PHOTONS);
+  data.hasMatchedPromptElectron = isolation.hasMatchedPromptElectron();
 
-  updateBranch(mPhotonTree, &chargedHadronsIsolation, "chargedHadronsIsolation");
-  updateBranch(mPhotonTree, &neutralHadronsIsolation, "neutralHadronsIsolation");
-  updateBranch(mPhotonTree, &photonIsolation, "photonIsolation");
-
-  mPhotonTree->Fill();
-
-  if (mIsMC) {
-    particleToTree(photon->genPhoton(), mPhotonGenTree, addresses);
-    mPhotonGenTree->Fill();
-  }
+  // The photon tree has always been filled using a float rho
+  float photonRho = rho;
+  data.chargedHadronsIsolation = getCorrectedPFIsolation(isolation.chargedHadronsIsolation, photonRho, photon->eta(), IsolationType::CHARGED_HADRONS);
+  data.neutralHadronsIsolation = getCorrectedPFIsolation(isolation.neutralHadronsIsolation, photonRho, photon->eta(), IsolationType::NEUTRAL_HADRONS);
+  data.photonIsolation = getCorrectedPFIsolation(isolation.photonIsolation, photonRho, photon->eta(), IsolationType::PHOTONS);
 }
 
-void GammaJetFilter::jetsToTree(const pat::Jet* firstJet, const pat::Jet* secondJet, const std::vector<TTree*>& trees) {
-  jetToTree(firstJet, mIsMC, trees[0], trees[4]);
-  jetToTree(secondJet, false, trees[1], trees[5]);
+void GammaJetFilter::jetsToData(const pat::Jet* firstJet, const pat::Jet* firstRawJet, const pat::Jet* secondJet, const pat::Jet* secondRawJet, const GenMatch* firstGenMatch, const GenMatch* secondGenMatch, const GenParticleTable* genParticles, JetCollectionData& data) const {
+  // Neutrinos are only looked for inside the first jet
+  jetToData(firstJet, firstGenMatch, genParticles, data.firstJet, (mIsMC) ? &data.firstGenJet : NULL);
+  jetToData(secondJet, secondGenMatch, NULL, data.secondJet, (mIsMC) ? &data.secondGenJet : NULL);
 
   // Raw jets
-  const pat::Jet* rawJet = (firstJet) ? firstJet->userData<pat::Jet>("rawJet") : NULL;
-  jetToTree(rawJet, false, trees[2], NULL);
-
-  rawJet = (secondJet) ? secondJet->userData<pat::Jet>("rawJet") : NULL;
-  jetToTree(rawJet, false, trees[3], NULL);
-}
-
-void findNeutrinos(const reco::Candidate* parent, std::vector<const reco::Candidate*>& neutrinos) {
-
-  int pdg_id = abs(parent->pdgId());
-  if (pdg_id == 12 || pdg_id == 14 || pdg_id == 16) {
-    if (std::find_if(neutrinos.begin(), neutrinos.end(), [parent] (const reco::Candidate* candidate) -> bool {
-          static double EPSILON = 0.0001;
-          bool same = (candidate->pdgId() == parent->pdgId());
-          same &= (fabs(candidate->px() - candidate->px()) < EPSILON);
-          same &= (fabs(candidate->py() - candidate->py()) < EPSILON);
-          same &= (fabs(candidate->pz() - candidate->pz()) < EPSILON);
-
-          return same;
-
-      }) == neutrinos.end()) {
-      neutrinos.push_back(parent);
-    }
-    return;
-  }
-
-  for (unsigned int i = 0; i < parent->numberOfDaughters(); i++) {
-    const reco::Candidate* d = parent->daughter(i);
-    findNeutrinos(d, neutrinos);
-  }
+  jetToData(firstRawJet, NULL, NULL, data.firstRawJet, NULL);
+  jetToData(secondRawJet, NULL, NULL, data.secondRawJet, NULL);
 }
 
-void GammaJetFilter::jetToTree(const pat::Jet* jet, bool _findNeutrinos, TTree* tree, TTree* genTree) {
-  std::vector<boost::shared_ptr<void> > addresses;
-  particleToTree(jet, tree, addresses);
-
-  if (mIsMC) {
-    mNeutrinos->Clear("C");
-    mNeutrinosPDG->Clear("C");
-  }
+void GammaJetFilter::jetToData(const pat::Jet* jet, const GenMatch* genMatch, const GenParticleTable* genParticles, JetData& data, GenJetData* genData) const {
+  particleToData(jet, data);
 
   if (jet) {
-    float area = jet->jetArea();
-    updateBranch(tree, &area, "jet_area");
+    data.jet_area = jet->jetArea();
 
     // B-Tagging
-    float tcHighEfficiency = jet->bDiscriminator("trackCountingHighEffBJetTags");
-    float tcHighPurity = jet->bDiscriminator("trackCountingHighPurBJetTags");
+    data.btag_tc_high_eff = jet->bDiscriminator("trackCountingHighEffBJetTags");
+    data.btag_tc_high_pur = jet->bDiscriminator("trackCountingHighPurBJetTags");
 
-    float ssvHighEfficiency = jet->bDiscriminator("simpleSecondaryVertexHighEffBJetTags");
-    float ssvHighPurity = jet->bDiscriminator("simpleSecondaryVertexHighPurBJetTags");
+    data.btag_ssv_high_eff = jet->bDiscriminator("simpleSecondaryVertexHighEffBJetTags");
+    data.btag_ssv_high_pur = jet->bDiscriminator("simpleSecondaryVertexHighPurBJetTags");
 
-    float jetProbability = jet->bDiscriminator("jetProbabilityBJetTags");
-    float jetBProbability = jet->bDiscriminator("jetBProbabilityBJetTags");
+    data.btag_jet_probability = jet->bDiscriminator("jetProbabilityBJetTags");
+    data.btag_jet_b_probability = jet->bDiscriminator("jetBProbabilityBJetTags");
 
     // New 2012
-    float csv = jet->bDiscriminator("combinedSecondaryVertexBJetTags");
+    data.btag_csv = jet->bDiscriminator("combinedSecondaryVertexBJetTags");
 
     // Quark Gluon tagging
-    float qgTagMLP = jet->userFloat("qgTagMLP");
-    float qgTagLikelihood = jet->userFloat("qgTagLikelihood");
-
-    updateBranch(tree, &tcHighEfficiency, "btag_tc_high_eff");
-    updateBranch(tree, &tcHighPurity, "btag_tc_high_pur");
-    updateBranch(tree, &ssvHighEfficiency, "btag_ssv_high_eff");
-    updateBranch(tree, &ssvHighPurity, "btag_ssv_high_pur");
-    updateBranch(tree, &jetProbability, "btag_jet_probability");
-    updateBranch(tree, &jetBProbability, "btag_jet_b_probability");
-    updateBranch(tree, &csv, "btag_csv");
-    updateBranch(tree, &qgTagMLP, "qg_tag_mlp");
-    updateBranch(tree, &qgTagLikelihood, "qg_tag_likelihood");
-
-    tree->Fill(); // This Fill() must be called inside the {} block, otherwise it'll crash. Don't move it!
-  } else {
-    tree->Fill();
+    data.qg_tag_mlp = jet->userFloat("qgTagMLP");
+    data.qg_tag_likelihood = jet->userFloat("qgTagLikelihood");
   }
 
-  if (genTree) {
-    particleToTree((jet) ? jet->genJet() : NULL, genTree, addresses);
-
-    if (_findNeutrinos) {
-      static bool init = false;
-      if (! init) {
-        genTree->Branch("neutrinos", &mNeutrinos, 32000, 0);
-        genTree->Branch("neutrinos_pdg_id", &mNeutrinosPDG, 32000, 0);
-        init = true;
-      }
-    }
-
-    if (jet && _findNeutrinos) {
-      const reco::Candidate* parton = (jet) ? jet->genParton() : NULL;
-
-      if (parton) {
-        if (abs(parton->pdgId()) == 5 || abs(parton->pdgId()) == 4) {
-
-          std::vector<const reco::Candidate*> neutrinos;
-          findNeutrinos(parton, neutrinos);
-
-          if (neutrinos.size() > 0) {
-            // Build TCloneArray of TLorentzVector
-            unsigned int index = 0;
-            for (const reco::Candidate* neutrino: neutrinos) {
-              TLorentzVector* p4 = (TLorentzVector*) mNeutrinos->ConstructedAt(index);
-              p4->SetPxPyPzE(neutrino->px(), neutrino->py(), neutrino->pz(), neutrino->energy());
-
-              TParameter<int>* pdg_id = (TParameter<int>*) mNeutrinosPDG->ConstructedAt(index++);
-              pdg_id->SetVal(neutrino->pdgId());
-            }
-          }
-        }
+  if (! genData)
+    return;
 
-      }
-    }
+  particleToData((genMatch) ? genMatch->genJet : NULL, *genData);
 
-    // Add parton id and pt
-    const reco::Candidate* parton = (jet) ? jet->genParton() : NULL;
-    int pdgId = (parton) ? parton->pdgId() : 0;
-    updateBranch(genTree, &pdgId, "parton_pdg_id", "I");
+  // Add parton id and pt
+  const reco::GenParticle* parton = (genMatch) ? genMatch->parton : NULL;
 
-    TLorentzVector parton_p4;
-    if (parton) {
-      parton_p4.SetPxPyPzE(parton->px(), parton->py(), parton->pz(), parton->energy());
-    }
-    TLorentzVector* p_parton_p4 = &parton_p4;
+  // Only set for b and c partons
+  if (parton && genParticles && ! genMatch->partonDecay.empty()) {
+    std::vector<uint32_t> neutrinos;
+    genParticles->findNeutrinos(genMatch->partonDecay, neutrinos);
 
-    TBranch* branch = genTree->GetBranch("parton_p4");
-    if (branch == NULL) {
-      branch = genTree->Branch("parton_p4", &p_parton_p4);
-    } else {
-      branch->SetAddress(&p_parton_p4);
+    for (uint32_t index: neutrinos) {
+      const reco::GenParticle* neutrino = &genParticles->particle(index);
+      genData->neutrinos.push_back(TLorentzVector(neutrino->px(), neutrino->py(), neutrino->pz(), neutrino->energy()));
+      genData->neutrinos_pdg_id.push_back(neutrino->pdgId());
     }
+  }
 
-    int flavour = (jet) ? jet->partonFlavour() : 0;
-    updateBranch(genTree, &flavour, "parton_flavour", "I");
+  genData->parton_pdg_id = (parton) ? parton->pdgId() : 0;
 
-    genTree->Fill();
+  if (parton) {
+    genData->parton_p4.SetPxPyPzE(parton->px(), parton->py(), parton->pz(), parton->energy());
   }
-}
 
-void GammaJetFilter::metsToTree(const pat::MET& met, const pat::MET& rawMet, const std::vector<TTree*>& trees) {
-  metToTree(&met, trees[0], trees[2]);
-  metToTree(&rawMet, trees[1], NULL);
+  genData->parton_flavour = (jet) ? jet->partonFlavour() : 0;
 }
 
-void GammaJetFilter::metToTree(const pat::MET* met, TTree* tree, TTree* genTree) {
-  std::vector<boost::shared_ptr<void> > addresses;
-  particleToTree(met, tree, addresses);
-
-  tree->Fill();
+void GammaJetFilter::metsToData(const pat::MET& met, const pat::MET& rawMet, JetCollectionData& data) const {
+  particleToData(&met, data.met);
+  particleToData(&rawMet, data.rawMet);
 
-  if (genTree) {
-    particleToTree((met) ? met->genMET() : NULL, genTree, addresses);
-    genTree->Fill();
-  }
+  if (mIsMC)
+    particleToData(met.genMET(), data.genMet);
 }
 
-void GammaJetFilter::electronsToTree(const edm::Handle<pat::ElectronCollection>& electrons, const reco::Vertex& pv) {
+void GammaJetFilter::electronsToData(const edm::Handle<pat::ElectronCollection>& electrons, const reco::Vertex& pv, LeptonsData& data) const {
 
-  int n = electrons->size();
-  static int   id[30];
-  static float isolation[30];
-  static float pt[30];
-  static float px[30];
-  static float py[30];
-  static float pz[30];
-  static float eta[30];
-  static float phi[30];
-  static int   charge[30];
+  size_t n = electrons->size();
+  data.resize(n);
 
-  int i = 0;
-  for (pat::ElectronCollection::const_iterator it = electrons->begin(); it != electrons->end(); ++it, i++) {
-    const pat::Electron& electron = *it;
-
-    if (i >= 30)
-      break;
+  for (size_t i = 0; i < n; i++) {
+    const pat::Electron& electron = (*electrons)[i];
 
     // See https://twiki.cern.ch/twiki/bin/view/CMS/TopLeptonPlusJetsRefSel_el
-    bool elecID = fabs(pv.z() - it->vertex().z()) < 1.;
-    elecID     &= it->et() > 30.;
-    elecID     &= fabs(it->eta()) < 2.5 && (it->superCluster()->eta() > 1.4442 && it->superCluster()->eta() < 1.5660);
-    elecID     &= it->dB() < 0.02;
-    elecID     &= ((int) it->electronID("eidLoose") & 0x1);
-
-    float iso     = (it->dr03TkSumPt() + it->dr03EcalRecHitSumEt() + it->dr03HcalTowerSumEt()) / it->et();
-
-    id[i]         = elecID;
-    isolation[i]  = iso;
-    pt[i]         = electron.pt();
-    px[i]         = electron.px();
-    py[i]         = electron.py();
-    pz[i]         = electron.pz();
-    eta[i]        = electron.eta();
-    phi[i]        = electron.phi();
-    charge[i]     = electron.charge();
+    bool elecID = fabs(pv.z() - electron.vertex().z()) < 1.;
+    elecID     &= electron.et() > 30.;
+    elecID     &= fabs(electron.eta()) < 2.5 && (electron.superCluster()->eta() > 1.4442 && electron.superCluster()->eta() < 1.5660);
+    elecID     &= electron.dB() < 0.02;
+    elecID     &= ((int) electron.electronID("eidLoose") & 0x1);
+
+    data.id[i]                   = elecID;
+    data.isolation[i]            = (electron.dr03TkSumPt() + electron.dr03EcalRecHitSumEt() + electron.dr03HcalTowerSumEt()) / electron.et();
+    data.delta_beta_isolation[i] = 0;
+    data.pt[i]                   = electron.pt();
+    data.px[i]                   = electron.px();
+    data.py[i]                   = electron.py();
+    data.pz[i]                   = electron.pz();
+    data.eta[i]                  = electron.eta();
+    data.phi[i]                  = electron.phi();
+    data.charge[i]               = electron.charge();
   }
-
-  updateBranch(mElectronsTree, &n, "n", "I");
-  updateBranchArray(mElectronsTree, id, "id", "n", "I");
-  updateBranchArray(mElectronsTree, isolation, "isolation", "n");
-  updateBranchArray(mElectronsTree, pt, "pt", "n");
-  updateBranchArray(mElectronsTree, px, "px", "n");
-  updateBranchArray(mElectronsTree, py, "py", "n");
-  updateBranchArray(mElectronsTree, pz, "pz", "n");
-  updateBranchArray(mElectronsTree, eta, "eta", "n");
-  updateBranchArray(mElectronsTree, phi, "phi", "n");
-  updateBranchArray(mElectronsTree, charge, "charge", "n", "I");
-
-  mElectronsTree->Fill();
 }
 
-void GammaJetFilter::muonsToTree(const edm::Handle<pat::MuonCollection>& muons, const reco::Vertex& pv) {
-
-  int n = muons->size();
-  static int   id[30];
-  static float isolation[30];
-  static float delta_beta_isolation[30];
-  static float pt[30];
-  static float px[30];
-  static float py[30];
-  static float pz[30];
-  static float eta[30];
-  static float phi[30];
-  static int   charge[30];
-
-  int i = 0;
-  for (pat::MuonCollection::const_iterator it = muons->begin(); it != muons->end(); ++it, i++) {
-    const pat::Muon& muon = *it;
-
-    if (i >= 30)
-      break;
+void GammaJetFilter::muonsToData(const edm::Handle<pat::MuonCollection>& muons, const reco::Vertex& pv, LeptonsData& data) const {
+
+  size_t n = muons->size();
+  data.resize(n);
+
+  for (size_t i = 0; i < n; i++) {
+    const pat::Muon& muon = (*muons)[i];
 
     // See https://twiki.cern.ch/twiki/bin/view/CMS/TopLeptonPlusJetsRefSel_mu
-    bool muonID = it->isGlobalMuon();
+    bool muonID = muon.isGlobalMuon();
     //FIXME: reco::Tracks need to be keept in PF2PAT.
     //It's not the case right now, so muon ID will be incorrect
-    if (it->globalTrack().isNull() || it->innerTrack().isNull() || it->muonBestTrack().isNull() || it->track().isNull()) {
+    if (muon.globalTrack().isNull() || muon.innerTrack().isNull() || muon.muonBestTrack().isNull() || muon.track().isNull()) {
       muonID = false;
     } else {
-      muonID     &= it->globalTrack()->normalizedChi2() < 10.;
-      muonID     &= it->globalTrack()->hitPattern().numberOfValidMuonHits() > 0;
-      muonID     &= it->numberOfMatchedStations() > 1;
-      muonID     &= it->dB() < 0.2;
-      muonID     &= fabs(it->muonBestTrack()->dz(pv.position())) < 0.5;
-      muonID     &= it->innerTrack()->hitPattern().numberOfValidPixelHits() > 0;
-      muonID     &= it->track()->hitPattern().trackerLayersWithMeasurement() > 5;
+      muonID     &= muon.globalTrack()->normalizedChi2() < 10.;
+      muonID     &= muon.globalTrack()->hitPattern().numberOfValidMuonHits() > 0;
+      muonID     &= muon.numberOfMatchedStations() > 1;
+      muonID     &= muon.dB() < 0.2;
+      muonID     &= fabs(muon.muonBestTrack()->dz(pv.position())) < 0.5;
+      muonID     &= muon.innerTrack()->hitPattern().numberOfValidPixelHits() > 0;
+      muonID     &= muon.track()->hitPattern().trackerLayersWithMeasurement() > 5;
     }
 
-    float relIso = (it->chargedHadronIso() + it->neutralHadronIso() + it->photonIso()) / it->pt();
-    float deltaBetaRelIso = (it->chargedHadronIso() + std::max((it->neutralHadronIso() + it->photonIso()) - 0.5 * it->puChargedHadronIso(), 0.0)) / it->pt();
-
-    id[i]          = muonID;
-    isolation[i]   = relIso;
-    delta_beta_isolation[i] = deltaBetaRelIso;
-    pt[i]          = muon.pt();
-    px[i]          = muon.px();
-    py[i]          = muon.py();
-    pz[i]          = muon.pz();
-    eta[i]         = muon.eta();
-    phi[i]         = muon.phi();
-    charge[i]      = muon.charge();
+    float chargedHadronIso = muon.chargedHadronIso();
+    float neutralIso = muon.neutralHadronIso() + muon.photonIso();
+
+    data.id[i]                   = muonID;
+    data.isolation[i]            = (chargedHadronIso + neutralIso) / muon.pt();
+    data.delta_beta_isolation[i] = (chargedHadronIso + std::max(neutralIso - 0.5 * muon.puChargedHadronIso(), 0.0)) / muon.pt();
+    data.pt[i]                   = muon.pt();
+    data.px[i]                   = muon.px();
+    data.py[i]                   = muon.py();
+    data.pz[i]                   = muon.pz();
+    data.eta[i]                  = muon.eta();
+    data.phi[i]                  = muon.phi();
+    data.charge[i]               = muon.charge();
   }
-
-  updateBranch(mMuonsTree, &n, "n", "I");
-  updateBranchArray(mMuonsTree, id, "id", "n", "I");
-  updateBranchArray(mMuonsTree, isolation, "relative_isolation", "n");
-  updateBranchArray(mMuonsTree, delta_beta_isolation, "delta_beta_relative_isolation", "n");
-  updateBranchArray(mMuonsTree, pt, "pt", "n");
-  updateBranchArray(mMuonsTree, px, "px", "n");
-  updateBranchArray(mMuonsTree, py, "py", "n");
-  updateBranchArray(mMuonsTree, pz, "pz", "n");
-  updateBranchArray(mMuonsTree, eta, "eta", "n");
-  updateBranchArray(mMuonsTree, phi, "phi", "n");
-  updateBranchArray(mMuonsTree, charge, "charge", "n", "I");
-
-  mMuonsTree->Fill();
 }
 
 //define this as a plug-in
@@ -0,0 +1,389 @@
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetTreeWriter.h"
+
+#include "CommonTools/Utils/interface/TFileDirectory.h"
+
+#include <TBranch.h>
+#include <TClonesArray.h>
+#include <TH1F.h>
+#include <TH2F.h>
+#include <TParameter.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+GammaJetTreeWriter::GammaJetTreeWriter(TFileDirectory& fs, const std::vector<std::string>& jetCollections, bool isMC, bool dumpGenParticles):
+  mIsMC(isMC), mDumpGenParticles(isMC && dumpGenParticles) {
+
+  mTriggerNames = &mEvent.analysis.trigger_names;
+  mTriggerResults = &mEvent.analysis.trigger_results;
+
+  mPhotonTree = fs.make<TTree>("photon", "photon tree");
+
+  if (mIsMC)
+    mPhotonGenTree = fs.make<TTree>("photon_gen", "photon gen tree");
+  else
+    mPhotonGenTree = nullptr;
+
+  mAnalysisTree = fs.make<TTree>("analysis", "analysis tree");
+  createLeptonTree(mMuons, fs.make<TTree>("muons", "muons tree"), true);
+  createLeptonTree(mElectrons, fs.make<TTree>("electrons", "electrons tree"), false);
+
+  mGenParticles.tree = nullptr;
+  mGenParticles.n = 0;
+  mGenParticles.capacity = 0;
+  if (mDumpGenParticles) {
+    mGenParticles.tree = fs.make<TTree>("gen_particles", "gen particles tree");
+    mGenParticles.tree->Branch("n", &mGenParticles.n, "n/I");
+    bindGenParticlesBranches(mGenParticles);
+  }
+
+  // Analysis
+  AnalysisData& analysis = mEvent.analysis;
+  mAnalysisTree->Branch("run", &analysis.run, "run/i");
+  mAnalysisTree->Branch("lumi_block", &analysis.lumi_block, "lumi_block/i");
+  mAnalysisTree->Branch("event", &analysis.event, "event/i");
+  mAnalysisTree->Branch("nvertex", &analysis.nvertex, "nvertex/i");
+  mAnalysisTree->Branch("ntrue_interactions", &analysis.ntrue_interactions, "ntrue_interactions/F");
+  mAnalysisTree->Branch("pu_nvertex", &analysis.pu_nvertex, "pu_nvertex/I");
+  mAnalysisTree->Branch("event_weight", &analysis.event_weight, "event_weight/F"); // Only valid for binned samples
+  mAnalysisTree->Branch("generator_weight", &analysis.generator_weight, "generator_weight/D"); // Only valid for flat samples
+  mAnalysisTree->Branch("trigger_names", &mTriggerNames);
+  mAnalysisTree->Branch("trigger_results", &mTriggerResults);
+
+  // Photon
+  PhotonData& photon = mEvent.photon;
+  createParticleBranches(mPhotonTree, photon);
+  mPhotonTree->Branch("has_pixel_seed", &photon.has_pixel_seed, "has_pixel_seed/O");
+  mPhotonTree->Branch("hadTowOverEm", &photon.hadTowOverEm, "hadTowOverEm/F");
+  mPhotonTree->Branch("sigmaIetaIeta", &photon.sigmaIetaIeta, "sigmaIetaIeta/F");
+  mPhotonTree->Branch("rho", &photon.rho, "rho/F");
+  mPhotonTree->Branch("hasMatchedPromptElectron", &photon.hasMatchedPromptElectron, "hasMatchedPromptElectron/O");
+  mPhotonTree->Branch("chargedHadronsIsolation", &photon.chargedHadronsIsolation, "chargedHadronsIsolation/F");
+  mPhotonTree->Branch("neutralHadronsIsolation", &photon.neutralHadronsIsolation, "neutralHadronsIsolation/F");
+  mPhotonTree->Branch("photonIsolation", &photon.photonIsolation, "photonIsolation/F");
+
+  if (mIsMC)
+    createParticleBranches(mPhotonGenTree, mEvent.genPhoton);
+
+  // Jets. Vectors are sized once, so that branch addresses never move
+  mEvent.jets.resize(jetCollections.size());
+  mJetTrees.resize(jetCollections.size());
+  for (size_t i = 0; i < jetCollections.size(); i++) {
+    createTrees(jetCollections[i], fs, mEvent.jets[i], mJetTrees[i]);
+  }
+
+  mFirstJetPhotonDeltaPhi = fs.make<TH1F>("firstJetPhotonDeltaPhi", "firstJetPhotonDeltaPhi", 50, 0., M_PI);
+  mFirstJetPhotonDeltaR = fs.make<TH1F>("firstJetPhotonDeltaR", "firstJetPhotonDeltaR", 80, 0, 10);
+  mFirstJetPhotonDeltaPt = fs.make<TH1F>("firstJetPhotonDeltaPt", "firstJetPhotonDeltaPt", 100, 0, 50);
+  mFirstJetPhotonDeltaPhiDeltaR = fs.make<TH2F>("firstJetPhotonDeltaPhiDeltaR", "firstJetPhotonDeltaPhiDeltaR", 50, 0, M_PI, 80, 0, 10);
+
+  mSelectedFirstJetIndex = fs.make<TH1F>("selectedFirstJetIndex", "selectedFirstJetIndex", 20, 0, 20);
+  mSelectedSecondJetIndex = fs.make<TH1F>("selectedSecondJetIndex", "selectedSecondJetIndex", 20, 0, 20);
+
+  mSecondJetPhotonDeltaPhi = fs.make<TH1F>("secondJetPhotonDeltaPhi", "secondJetPhotonDeltaPhi", 50, 0., M_PI);
+  mSecondJetPhotonDeltaR = fs.make<TH1F>("secondJetPhotonDeltaR", "secondJetPhotonDeltaR", 80, 0, 10);
+  mSecondJetPhotonDeltaPt = fs.make<TH1F>("secondJetPhotonDeltaPt", "secondJetPhotonDeltaPt", 100, 0, 50);
+
+  mSelectedFirstJetPhotonDeltaPhi = fs.make<TH1F>("selectedFirstJetPhotonDeltaPhi", "selectedFirstJetPhotonDeltaPhi", 50, 0., M_PI);
+  mSelectedFirstJetPhotonDeltaR = fs.make<TH1F>("selectedFirstJetPhotonDeltaR", "selectedFirstJetPhotonDeltaR", 80, 0, 10);
+
+  mSelectedSecondJetPhotonDeltaPhi = fs.make<TH1F>("selectedSecondJetPhotonDeltaPhi", "selectedSecondJetPhotonDeltaPhi", 50, 0., M_PI);
+  mSelectedSecondJetPhotonDeltaR = fs.make<TH1F>("selectedSecondJetPhotonDeltaR", "selectedSecondJetPhotonDeltaR", 80, 0, 10);
+}
+
+GammaJetTreeWriter::~GammaJetTreeWriter() {
+  for (JetCollectionTrees& trees: mJetTrees) {
+    delete trees.neutrinos;
+    delete trees.neutrinosPdgId;
+  }
+}
+
+void GammaJetTreeWriter::createTrees(const std::string& rootName, TFileDirectory& fs, JetCollectionData& data, JetCollectionTrees& trees) {
+
+  TFileDirectory dir = fs.mkdir(rootName);
+
+  trees.firstJet = dir.make<TTree>("first_jet", "first jet tree");
+  trees.secondJet = dir.make<TTree>("second_jet", "second jet tree");
+
+  trees.firstRawJet = dir.make<TTree>("first_jet_raw", "first raw jet tree");
+  trees.secondRawJet = dir.make<TTree>("second_jet_raw", "second raw jet tree");
+
+  createJetBranches(trees.firstJet, data.firstJet);
+  createJetBranches(trees.secondJet, data.secondJet);
+  createJetBranches(trees.firstRawJet, data.firstRawJet);
+  createJetBranches(trees.secondRawJet, data.secondRawJet);
+
+  trees.firstPartonP4 = &data.firstGenJet.parton_p4;
+  trees.secondPartonP4 = &data.secondGenJet.parton_p4;
+  trees.neutrinos = nullptr;
+  trees.neutrinosPdgId = nullptr;
+
+  if (mIsMC) {
+    trees.firstGenJet = dir.make<TTree>("first_jet_gen", "first gen jet tree");
+    trees.secondGenJet = dir.make<TTree>("second_jet_gen", "second gen jet tree");
+
+    createGenJetBranches(trees.firstGenJet, data.firstGenJet, trees.firstPartonP4);
+    createGenJetBranches(trees.secondGenJet, data.secondGenJet, trees.secondPartonP4);
+
+    // For B / C jets neutrinos
+    trees.neutrinos = new TClonesArray("TLorentzVector", 3);
+    trees.neutrinosPdgId = new TClonesArray("TParameter<int>", 3);
+    trees.firstGenJet->Branch("neutrinos", &trees.neutrinos, 32000, 0);
+    trees.firstGenJet->Branch("neutrinos_pdg_id", &trees.neutrinosPdgId, 32000, 0);
+  } else {
+    trees.firstGenJet = nullptr;
+    trees.secondGenJet = nullptr;
+  }
+
+  // MET
+  trees.met = dir.make<TTree>("met", "met tree");
+  trees.rawMet = dir.make<TTree>("met_raw", "met raw tree");
+
+  createParticleBranches(trees.met, data.met);
+  createParticleBranches(trees.rawMet, data.rawMet);
+
+  if (mIsMC) {
+    trees.genMet = dir.make<TTree>("met_gen", "met gen tree");
+    createParticleBranches(trees.genMet, data.genMet);
+  } else {
+    trees.genMet = nullptr;
+  }
+
+  // Misc
+  trees.misc = dir.make<TTree>("misc", "misc tree");
+  trees.misc->Branch("rho", &data.rho, "rho/D");
+}
+
+void GammaJetTreeWriter::createParticleBranches(TTree* tree, ParticleData& data) {
+  tree->Branch("is_present", &data.is_present, "is_present/I");
+  tree->Branch("et", &data.et, "et/F");
+  tree->Branch("pt", &data.pt, "pt/F");
+  tree->Branch("eta", &data.eta, "eta/F");
+  tree->Branch("phi", &data.phi, "phi/F");
+  tree->Branch("px", &data.px, "px/F");
+  tree->Branch("py", &data.py, "py/F");
+  tree->Branch("pz", &data.pz, "pz/F");
+  tree->Branch("e", &data.e, "e/F");
+}
+
+void GammaJetTreeWriter::createJetBranches(TTree* tree, JetData& data) {
+  createParticleBranches(tree, data);
+
+  tree->Branch("jet_area", &data.jet_area, "jet_area/F");
+  tree->Branch("btag_tc_high_eff", &data.btag_tc_high_eff, "btag_tc_high_eff/F");
+  tree->Branch("btag_tc_high_pur", &data.btag_tc_high_pur, "btag_tc_high_pur/F");
+  tree->Branch("btag_ssv_high_eff", &data.btag_ssv_high_eff, "btag_ssv_high_eff/F");
+  tree->Branch("btag_ssv_high_pur", &data.btag_ssv_high_pur, "btag_ssv_high_pur/F");
+  tree->Branch("btag_jet_probability", &data.btag_jet_probability, "btag_jet_probability/F");
+  tree->Branch("btag_jet_b_probability", &data.btag_jet_b_probability, "btag_jet_b_probability/F");
+  tree->Branch("btag_csv", &data.btag_csv, "btag_csv/F");
+  tree->Branch("qg_tag_mlp", &data.qg_tag_mlp, "qg_tag_mlp/F");
+  tree->Branch("qg_tag_likelihood", &data.qg_tag_likelihood, "qg_tag_likelihood/F");
+}
+
+void GammaJetTreeWriter::createGenJetBranches(TTree* tree, GenJetData& data, TLorentzVector*& partonP4) {
+  createParticleBranches(tree, data);
+
+  tree->Branch("parton_pdg_id", &data.parton_pdg_id, "parton_pdg_id/I");
+  tree->Branch("parton_p4", &partonP4);
+  tree->Branch("parton_flavour", &data.parton_flavour, "parton_flavour/I");
+}
+
+namespace {
+  template<typename T> void bindBranch(TTree* tree, const char* name, std::vector<T>& buffer, const char* leaf) {
+    TBranch* branch = tree->GetBranch(name);
+    if (branch == NULL)
+      tree->Branch(name, buffer.data(), leaf);
+    else
+      branch->SetAddress(buffer.data());
+  }
+}
+
+void GammaJetTreeWriter::createLeptonTree(LeptonTree& leptons, TTree* tree, bool isMuon) {
+  leptons.tree = tree;
+  leptons.isMuon = isMuon;
+  leptons.n = 0;
+  leptons.capacity = 0;
+
+  tree->Branch("n", &leptons.n, "n/I");
+  bindLeptonBranches(leptons);
+}
+
+void GammaJetTreeWriter::bindLeptonBranches(LeptonTree& leptons) {
+  // Branches point directly to the vectors storage, which must never be empty
+  leptons.capacity = std::max<size_t>(leptons.capacity, 16);
+
+  LeptonsData& buffers = leptons.buffers;
+  buffers.resize(leptons.capacity);
+
+  TTree* tree = leptons.tree;
+  bindBranch(tree, "id", buffers.id, "id[n]/I");
+  if (leptons.isMuon) {
+    bindBranch(tree, "relative_isolation", buffers.isolation, "relative_isolation[n]/F");
+    bindBranch(tree, "delta_beta_relative_isolation", buffers.delta_beta_isolation, "delta_beta_relative_isolation[n]/F");
+  } else {
+    bindBranch(tree, "isolation", buffers.isolation, "isolation[n]/F");
+  }
+  bindBranch(tree, "pt", buffers.pt, "pt[n]/F");
+  bindBranch(tree, "px", buffers.px, "px[n]/F");
+  bindBranch(tree, "py", buffers.py, "py[n]/F");
+  bindBranch(tree, "pz", buffers.pz, "pz[n]/F");
+  bindBranch(tree, "eta", buffers.eta, "eta[n]/F");
+  bindBranch(tree, "phi", buffers.phi, "phi[n]/F");
+  bindBranch(tree, "charge", buffers.charge, "charge[n]/I");
+}
+
+void GammaJetTreeWriter::fillLeptons(const LeptonsData& data, LeptonTree& leptons) {
+  size_t n = data.size();
+
+  if (n > leptons.capacity) {
+    leptons.capacity = std::max(n, 2 * leptons.capacity);
+    bindLeptonBranches(leptons);
+  }
+
+  LeptonsData& buffers = leptons.buffers;
+  std::copy(data.id.begin(), data.id.end(), buffers.id.begin());
+  std::copy(data.isolation.begin(), data.isolation.end(), buffers.isolation.begin());
+  std::copy(data.delta_beta_isolation.begin(), data.delta_beta_isolation.end(), buffers.delta_beta_isolation.begin());
+  std::copy(data.pt.begin(), data.pt.end(), buffers.pt.begin());
+  std::copy(data.px.begin(), data.px.end(), buffers.px.begin());
+  std::copy(data.py.begin(), data.py.end(), buffers.py.begin());
+  std::copy(data.pz.begin(), data.pz.end(), buffers.pz.begin());
+  std::copy(data.eta.begin(), data.eta.end(), buffers.eta.begin());
+  std::copy(data.phi.begin(), data.phi.end(), buffers.phi.begin());
+  std::copy(data.charge.begin(), data.charge.end(), buffers.charge.begin());
+
+  leptons.n = n;
+  leptons.tree->Fill();
+}
+
+void GammaJetTreeWriter::bindGenParticlesBranches(GenParticlesTree& particles) {
+  particles.capacity = std::max<size_t>(particles.capacity, 256);
+
+  GenParticlesData& buffers = particles.buffers;
+  buffers.resize(particles.capacity);
+
+  TTree* tree = particles.tree;
+  bindBranch(tree, "pdg_id", buffers.pdg_id, "pdg_id[n]/I");
+  bindBranch(tree, "status", buffers.status, "status[n]/I");
+  bindBranch(tree, "mother", buffers.mother, "mother[n]/I");
+  bindBranch(tree, "pt", buffers.pt, "pt[n]/F");
+  bindBranch(tree, "eta", buffers.eta, "eta[n]/F");
+  bindBranch(tree, "phi", buffers.phi, "phi[n]/F");
+  bindBranch(tree, "e", buffers.e, "e[n]/F");
+}
+
+void GammaJetTreeWriter::fillGenParticles(const GenParticlesData& data, GenParticlesTree& particles) {
+  size_t n = data.size();
+
+  if (n > particles.capacity) {
+    particles.capacity = std::max(n, 2 * particles.capacity);
+    bindGenParticlesBranches(particles);
+  }
+
+  GenParticlesData& buffers = particles.buffers;
+  std::copy(data.pdg_id.begin(), data.pdg_id.end(), buffers.pdg_id.begin());
+  std::copy(data.status.begin(), data.status.end(), buffers.status.begin());
+  std::copy(data.mother.begin(), data.mother.end(), buffers.mother.begin());
+  std::copy(data.pt.begin(), data.pt.end(), buffers.pt.begin());
+  std::copy(data.eta.begin(), data.eta.end(), buffers.eta.begin());
+  std::copy(data.phi.begin(), data.phi.end(), buffers.phi.begin());
+  std::copy(data.e.begin(), data.e.end(), buffers.e.begin());
+
+  particles.n = n;
+  particles.tree->Fill();
+}
+
+void GammaJetTreeWriter::fillMonitoring(const JetSelectionMonitoring& monitoring) {
+  if (monitoring.hasFirstGoodJet) {
+    mFirstJetPhotonDeltaPhi->Fill(monitoring.firstGoodJetDeltaPhi);
+    mFirstJetPhotonDeltaR->Fill(monitoring.firstGoodJetDeltaR);
+    mFirstJetPhotonDeltaPt->Fill(monitoring.firstGoodJetDeltaPt);
+
+    mFirstJetPhotonDeltaPhiDeltaR->Fill(monitoring.firstGoodJetDeltaPhi, monitoring.firstGoodJetDeltaR);
+  }
+
+  if (monitoring.hasSecondGoodJet) {
+    mSecondJetPhotonDeltaPhi->Fill(monitoring.secondGoodJetDeltaPhi);
+    mSecondJetPhotonDeltaR->Fill(monitoring.secondGoodJetDeltaR);
+    mSecondJetPhotonDeltaPt->Fill(monitoring.secondGoodJetDeltaPt);
+  }
+
+  if (monitoring.selectedFirstJetIndex >= 0) {
+    mSelectedFirstJetIndex->Fill(monitoring.selectedFirstJetIndex);
+    mSelectedFirstJetPhotonDeltaPhi->Fill(monitoring.selectedFirstJetDeltaPhi);
+    mSelectedFirstJetPhotonDeltaR->Fill(monitoring.selectedFirstJetDeltaR);
+  }
+
+  if (monitoring.selectedSecondJetIndex >= 0) {
+    mSelectedSecondJetIndex->Fill(monitoring.selectedSecondJetIndex);
+    mSelectedSecondJetPhotonDeltaPhi->Fill(monitoring.selectedSecondJetDeltaPhi);
+    mSelectedSecondJetPhotonDeltaR->Fill(monitoring.selectedSecondJetDeltaR);
+  }
+}
+
+void GammaJetTreeWriter::write(const GammaJetEvent& event) {
+
+  assert(event.jets.size() == mEvent.jets.size());
+
+  // Jets. Assign element by element so that the buffers used as branch addresses never move
+  for (size_t i = 0; i < mJetTrees.size(); i++) {
+    const JetCollectionData& data = event.jets[i];
+    JetCollectionTrees& trees = mJetTrees[i];
+
+    mEvent.jets[i] = data;
+
+    fillMonitoring(data.monitoring);
+
+    trees.firstJet->Fill();
+    trees.secondJet->Fill();
+    trees.firstRawJet->Fill();
+    trees.secondRawJet->Fill();
+
+    if (mIsMC) {
+      trees.neutrinos->Clear("C");
+      trees.neutrinosPdgId->Clear("C");
+
+      const GenJetData& genJet = data.firstGenJet;
+      for (size_t j = 0; j < genJet.neutrinos.size(); j++) {
+        TLorentzVector* p4 = (TLorentzVector*) trees.neutrinos->ConstructedAt(j);
+        *p4 = genJet.neutrinos[j];
+
+        TParameter<int>* pdg_id = (TParameter<int>*) trees.neutrinosPdgId->ConstructedAt(j);
+        pdg_id->SetVal(genJet.neutrinos_pdg_id[j]);
+      }
+
+      trees.firstGenJet->Fill();
+      trees.secondGenJet->Fill();
+    }
+
+    trees.met->Fill();
+    trees.rawMet->Fill();
+    if (mIsMC)
+      trees.genMet->Fill();
+
+    trees.misc->Fill();
+  }
+
+  // Analysis
+  mEvent.analysis = event.analysis;
+  mAnalysisTree->Fill();
+
+  // Photon
+  mEvent.photon = event.photon;
+  mPhotonTree->Fill();
+
+  if (mIsMC) {
+    mEvent.genPhoton = event.genPhoton;
+    mPhotonGenTree->Fill();
+  }
+
+  // Leptons
+  fillLeptons(event.electrons, mElectrons);
+  fillLeptons(event.muons, mMuons);
+
+  if (mDumpGenParticles)
+    fillGenParticles(event.genParticles, mGenParticles);
+}
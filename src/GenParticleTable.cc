@@ -0,0 +1,107 @@
+#include "JetMETCorrections/GammaJetFilter/interface/GenParticleTable.h"
+#include "JetMETCorrections/GammaJetFilter/interface/GammaJetEvent.h"
+
+#include "DataFormats/HepMCCandidate/interface/GenParticle.h"
+
+#include <cstdlib>
+#include <functional>
+#include <unordered_set>
+
+void GenParticleTable::build(const reco::GenParticleCollection& particles, const edm::ProductID& id) {
+
+  mParticles = &particles;
+  mProductID = id;
+  size_t n = particles.size();
+
+  mMothers.resize(n);
+  mDaughtersOffsets.resize(n + 1);
+  mDaughters.clear();
+
+  for (size_t i = 0; i < n; i++) {
+    const reco::GenParticle& particle = particles[i];
+
+    mMothers[i] = (particle.numberOfMothers() > 0) ? indexOf(particle.motherRef(0)) : -1;
+
+    mDaughtersOffsets[i] = mDaughters.size();
+    for (size_t j = 0; j < particle.numberOfDaughters(); j++) {
+      int daughter = indexOf(particle.daughterRef(j));
+      if (daughter >= 0)
+        mDaughters.push_back(daughter);
+    }
+  }
+  mDaughtersOffsets[n] = mDaughters.size();
+}
+
+int GenParticleTable::indexOf(const reco::GenParticleRef& ref) const {
+  return (ref.id() == mProductID && ref.key() < size()) ? static_cast<int>(ref.key()) : -1;
+}
+
+int GenParticleTable::indexOf(const reco::GenParticle* particle) const {
+  if (! particle || size() == 0)
+    return -1;
+
+  // The collection is contiguous
+  const reco::GenParticle* first = &mParticles->front();
+  std::less<const reco::GenParticle*> before;
+  if (before(particle, first) || ! before(particle, first + size()))
+    return -1;
+
+  return particle - first;
+}
+
+void GenParticleTable::decayRoots(const reco::GenParticle& parent, std::vector<uint32_t>& roots) const {
+
+  roots.clear();
+
+  // The parent may be a copy embedded inside a pat::Jet. Its daughters still belong to the table
+  int parentIndex = indexOf(&parent);
+  if (parentIndex >= 0) {
+    roots.push_back(parentIndex);
+  } else {
+    for (size_t j = 0; j < parent.numberOfDaughters(); j++) {
+      int daughter = indexOf(parent.daughterRef(j));
+      if (daughter >= 0)
+        roots.push_back(daughter);
+    }
+  }
+}
+
+void GenParticleTable::findNeutrinos(const std::vector<uint32_t>& roots, std::vector<uint32_t>& neutrinos) const {
+
+  std::vector<uint32_t> toVisit(roots);
+
+  std::unordered_set<uint32_t> visited;
+  while (! toVisit.empty()) {
+    uint32_t index = toVisit.back();
+    toVisit.pop_back();
+
+    if (! visited.insert(index).second)
+      continue;
+
+    int pdg_id = abs((*mParticles)[index].pdgId());
+    if (pdg_id == 12 || pdg_id == 14 || pdg_id == 16) {
+      neutrinos.push_back(index);
+      continue;
+    }
+
+    toVisit.insert(toVisit.end(), daughtersBegin(index), daughtersEnd(index));
+  }
+}
+
+void GenParticleTable::toData(GenParticlesData& data) const {
+
+  size_t n = size();
+  data.resize(n);
+
+  for (size_t i = 0; i < n; i++) {
+    const reco::GenParticle& particle = (*mParticles)[i];
+
+    data.pdg_id[i] = particle.pdgId();
+    data.status[i] = particle.status();
+    data.mother[i] = mMothers[i];
+    data.pt[i]     = particle.pt();
+    data.eta[i]    = particle.eta();
+    data.phi[i]    = particle.phi();
+    data.e[i]      = particle.energy();
+  }
+}
@@ -0,0 +1,166 @@
+#include "JetMETCorrections/GammaJetFilter/interface/LumiByLS.h"
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+  const char MAGIC[8] = {'G', 'J', 'L', 'U', 'M', 'I', 'L', 'S'};
+  const uint32_t VERSION = 1;
+
+  bool parseUnsigned(const char*& p, const char* end, uint32_t& value) {
+    const char* start = p;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      value = value * 10 + (*p - '0');
+      p++;
+    }
+
+    return p != start;
+  }
+
+  bool expect(const char*& p, const char* end, char c) {
+    if (p >= end || *p != c)
+      return false;
+
+    p++;
+    return true;
+  }
+
+  void skipField(const char*& p, const char* end) {
+    while (p < end && *p != ',' && *p != '\n')
+      p++;
+
+    if (p < end && *p == ',')
+      p++;
+  }
+
+  bool parseDouble(const char*& p, const char* end, double& value) {
+    // strtod needs a null terminated string, and the mapping is not
+    char buffer[64];
+    size_t length = 0;
+    while (p < end && *p != ',' && *p != '\n' && *p != '\r' && length < sizeof(buffer) - 1)
+      buffer[length++] = *p++;
+    buffer[length] = '\0';
+
+    char* last = NULL;
+    value = strtod(buffer, &last);
+    return length > 0 && last != buffer;
+  }
+
+  const char* nextLine(const char* p, const char* end) {
+    while (p < end && *p != '\n')
+      p++;
+
+    return (p < end) ? p + 1 : end;
+  }
+}
+
+void LumiByLS::parse(const char* begin, const char* end) {
+
+  /* lumiCalc2 format :
+   * Run:Fill,LS,UTCTime,Beam Status,E(GeV),Delivered(/ub),Recorded(/ub),avgPU
+   * use 'lumiCalc2.py -i lumiSummary.json -o output.csv -b stable lumibyls' to generate file
+   */
+
+  mEntries.clear();
+
+  // Skip header line
+  const char* line = nextLine(begin, end);
+
+  for (; line < end; line = nextLine(line, end)) {
+    const char* p = line;
+
+    uint32_t run = 0, fill = 0;
+    uint32_t lumiSection_left = 0, lumiSection_right = 0;
+    double lumiRecorded = 0.;
+
+    bool ok = parseUnsigned(p, end, run) && expect(p, end, ':') && parseUnsigned(p, end, fill) && expect(p, end, ',');
+    ok = ok && parseUnsigned(p, end, lumiSection_left) && expect(p, end, ':') && parseUnsigned(p, end, lumiSection_right) && expect(p, end, ',');
+
+    if (! ok) {
+      // Empty or truncated line
+      continue;
+    }
+
+    skipField(p, end); // UTCTime
+    skipField(p, end); // Beam status
+    skipField(p, end); // E
+    skipField(p, end); // Delivered
+
+    if (! parseDouble(p, end, lumiRecorded))
+      continue;
+
+    if (lumiSection_right == 0)
+      continue;
+
+    Entry entry = { run, lumiSection_right, lumiRecorded }; //in mb^(-1)
+    mEntries.push_back(entry);
+  }
+
+  // Keep the last value in case of duplicates, as the previous std::map based implementation did
+  std::stable_sort(mEntries.begin(), mEntries.end(), [] (const Entry& a, const Entry& b) {
+      return (a.run < b.run) || (a.run == b.run && a.lumi < b.lumi);
+  });
+
+  std::vector<Entry> unique;
+  unique.reserve(mEntries.size());
+  for (const Entry& entry: mEntries) {
+    if (! unique.empty() && unique.back().run == entry.run && unique.back().lumi == entry.lumi)
+      unique.back() = entry;
+    else
+      unique.push_back(entry);
+  }
+  mEntries.swap(unique);
+
+  if (mEntries.empty()) {
+    throw cms::Exception("ReadError")
+      << "No luminosity found in CSV file" << std::endl;
+  }
+}
+
+bool LumiByLS::read(const std::string& fileName, uint64_t sourceHash) {
+  FILE* f = fopen(fileName.c_str(), "rb");
+  if (! f)
+    return false;
+
+  BinaryCache::Header header;
+  bool ok = BinaryCache::readHeader(f, MAGIC, VERSION, header) && header.sourceHash == sourceHash;
+
+  if (ok) {
+    mEntries.resize(header.count);
+    ok = fread(mEntries.data(), sizeof(Entry), mEntries.size(), f) == mEntries.size();
+  }
+
+  fclose(f);
+
+  if (! ok)
+    mEntries.clear();
+
+  return ok && ! mEntries.empty();
+}
+
+bool LumiByLS::write(const std::string& fileName, uint64_t sourceHash) const {
+  std::string tmpFileName;
+  FILE* f = BinaryCache::create(fileName, tmpFileName);
+  if (! f)
+    return false;
+
+  bool ok = BinaryCache::writeHeader(f, MAGIC, VERSION, mEntries.size(), sourceHash);
+  ok = ok && fwrite(mEntries.data(), sizeof(Entry), mEntries.size(), f) == mEntries.size();
+
+  return BinaryCache::commit(f, tmpFileName, fileName, ok);
+}
+
+double LumiByLS::get(uint32_t run, uint32_t lumi) const {
+  std::vector<Entry>::const_iterator it = std::lower_bound(mEntries.begin(), mEntries.end(), std::make_pair(run, lumi), [] (const Entry& entry, const std::pair<uint32_t, uint32_t>& key) {
+      return (entry.run < key.first) || (entry.run == key.first && entry.lumi < key.second);
+  });
+
+  if (it == mEntries.end() || it->run != run || it->lumi != lumi)
+    return 0.;
+
+  return it->recorded;
+}
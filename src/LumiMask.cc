@@ -0,0 +1,166 @@
+#include "JetMETCorrections/GammaJetFilter/interface/LumiMask.h"
+#include "JetMETCorrections/GammaJetFilter/interface/BinaryCache.h"
+#include "JetMETCorrections/GammaJetFilter/interface/json/json.h"
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+  const char MAGIC[8] = {'G', 'J', 'L', 'U', 'M', 'I', 'M', 'K'};
+  const uint32_t VERSION = 1;
+}
+
+void LumiMask::build(const Json::Value& root) {
+  mRuns.clear();
+  mRanges.clear();
+
+  if (! root.isObject()) {
+    throw cms::Exception("InvalidJSON")
+      << "Luminosity JSON file must contain an object of runs" << std::endl;
+  }
+
+  std::vector<std::pair<uint32_t, std::vector<LumiRange>>> runs;
+
+  const Json::Value::Members members = root.getMemberNames();
+  for (const std::string& member: members) {
+    char* end = NULL;
+    uint32_t run = strtoul(member.c_str(), &end, 10);
+    if (end == member.c_str() || *end != '\0') {
+      throw cms::Exception("InvalidJSON")
+        << "Invalid run number '" << member << "' in luminosity JSON file" << std::endl;
+    }
+
+    const Json::Value& lumis = root[member];
+    if (! lumis.isArray()) {
+      throw cms::Exception("InvalidJSON")
+        << "Lumi ranges of run " << run << " must be an array" << std::endl;
+    }
+
+    std::vector<LumiRange> ranges;
+    ranges.reserve(lumis.size());
+    for (Json::ArrayIndex i = 0; i < lumis.size(); i++) {
+      const Json::Value& lumiRange = lumis[i];
+      if (! lumiRange.isArray() || lumiRange.size() != 2) {
+        throw cms::Exception("InvalidJSON")
+          << "Invalid lumi range for run " << run << std::endl;
+      }
+
+      LumiRange range = { lumiRange[0u].asUInt(), lumiRange[1u].asUInt() };
+      ranges.push_back(range);
+    }
+
+    runs.push_back(std::make_pair(run, ranges));
+  }
+
+  std::sort(runs.begin(), runs.end(), [] (const std::pair<uint32_t, std::vector<LumiRange>>& a, const std::pair<uint32_t, std::vector<LumiRange>>& b) {
+      return a.first < b.first;
+  });
+
+  for (auto& run: runs) {
+    std::vector<LumiRange>& ranges = run.second;
+    std::sort(ranges.begin(), ranges.end(), [] (const LumiRange& a, const LumiRange& b) {
+        return a.from < b.from;
+    });
+
+    RunEntry entry = { run.first, static_cast<uint32_t>(mRanges.size()), 0 };
+
+    // Merge overlapping or contiguous ranges
+    for (const LumiRange& range: ranges) {
+      if (entry.count > 0 && range.from <= static_cast<uint64_t>(mRanges.back().to) + 1) {
+        mRanges.back().to = std::max(mRanges.back().to, range.to);
+        continue;
+      }
+
+      mRanges.push_back(range);
+      entry.count++;
+    }
+
+    mRuns.push_back(entry);
+  }
+}
+
+bool LumiMask::isCompiled(const std::string& fileName) {
+  return BinaryCache::hasMagic(fileName, MAGIC);
+}
+
+bool LumiMask::read(const std::string& fileName, uint64_t sourceHash, bool checkHash/* = true*/) {
+  FILE* f = fopen(fileName.c_str(), "rb");
+  if (! f)
+    return false;
+
+  BinaryCache::Header header;
+  uint32_t nRanges = 0;
+  bool ok = BinaryCache::readHeader(f, MAGIC, VERSION, header);
+  ok = ok && (! checkHash || header.sourceHash == sourceHash);
+  ok = ok && fread(&nRanges, sizeof(uint32_t), 1, f) == 1;
+
+  if (ok) {
+    mRuns.resize(header.count);
+    mRanges.resize(nRanges);
+
+    ok = fread(mRuns.data(), sizeof(RunEntry), mRuns.size(), f) == mRuns.size();
+    ok = ok && fread(mRanges.data(), sizeof(LumiRange), mRanges.size(), f) == mRanges.size();
+
+    for (const RunEntry& run: mRuns) {
+      ok = ok && (static_cast<uint64_t>(run.first) + run.count <= mRanges.size());
+    }
+  }
+
+  fclose(f);
+
+  if (! ok) {
+    mRuns.clear();
+    mRanges.clear();
+  }
+
+  return ok;
+}
+
+bool LumiMask::write(const std::string& fileName, uint64_t sourceHash) const {
+  std::string tmpFileName;
+  FILE* f = BinaryCache::create(fileName, tmpFileName);
+  if (! f)
+    return false;
+
+  uint32_t nRanges = mRanges.size();
+  bool ok = BinaryCache::writeHeader(f, MAGIC, VERSION, mRuns.size(), sourceHash);
+  ok = ok && fwrite(&nRanges, sizeof(uint32_t), 1, f) == 1;
+  ok = ok && fwrite(mRuns.data(), sizeof(RunEntry), mRuns.size(), f) == mRuns.size();
+  ok = ok && fwrite(mRanges.data(), sizeof(LumiRange), mRanges.size(), f) == mRanges.size();
+
+  return BinaryCache::commit(f, tmpFileName, fileName, ok);
+}
+
+const LumiMask::RunEntry* LumiMask::getRun(uint32_t run) const {
+  std::vector<RunEntry>::const_iterator it = std::lower_bound(mRuns.begin(), mRuns.end(), run, [] (const RunEntry& entry, uint32_t run) {
+      return entry.run < run;
+  });
+
+  if (it == mRuns.end() || it->run != run)
+    return NULL;
+
+  return &(*it);
+}
+
+bool LumiMask::isValid(const RunEntry& run, uint32_t lumi) const {
+  std::vector<LumiRange>::const_iterator begin = mRanges.begin() + run.first;
+  std::vector<LumiRange>::const_iterator end = begin + run.count;
+
+  // First range starting after this lumi. The candidate is the one just before
+  std::vector<LumiRange>::const_iterator it = std::upper_bound(begin, end, lumi, [] (uint32_t lumi, const LumiRange& range) {
+      return lumi < range.from;
+  });
+
+  if (it == begin)
+    return false;
+
+  --it;
+  return lumi <= it->to;
+}
+
+bool LumiMask::isValid(uint32_t run, uint32_t lumi) const {
+  const RunEntry* entry = getRun(run);
+  return entry && isValid(*entry, lumi);
+}
@@ -0,0 +1,75 @@
+#include "JetMETCorrections/GammaJetFilter/interface/WorkerPool.h"
+
+WorkerPool::WorkerPool(size_t threads):
+  mTask(NULL), mTasks(0), mNext(0), mBusy(0), mGeneration(0), mStopping(false) {
+
+  for (size_t i = 1; i < threads; i++) {
+    mWorkers.push_back(std::thread(&WorkerPool::work, this));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mStart.notify_all();
+
+  for (std::thread& worker: mWorkers) {
+    worker.join();
+  }
+}
+
+void WorkerPool::run(size_t n, const std::function<void(size_t)>& task) {
+  if (mWorkers.empty()) {
+    for (size_t i = 0; i < n; i++) {
+      task(i);
+    }
+
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTask = &task;
+    mTasks = n;
+    mNext = 0;
+    mBusy = mWorkers.size();
+    mGeneration++;
+  }
+  mStart.notify_all();
+
+  runTasks();
+
+  // Every worker must be done with this batch before 'task' goes out of scope
+  std::unique_lock<std::mutex> lock(mMutex);
+  mDone.wait(lock, [this] { return mBusy == 0; });
+  mTask = NULL;
+}
+
+void WorkerPool::work() {
+  uint64_t generation = 0;
+
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mStart.wait(lock, [this, generation] { return mStopping || mGeneration != generation; });
+    if (mStopping)
+      break;
+
+    generation = mGeneration;
+    lock.unlock();
+
+    runTasks();
+
+    lock.lock();
+    if (--mBusy == 0)
+      mDone.notify_one();
+  }
+}
+
+void WorkerPool::runTasks() {
+  size_t i;
+  while ((i = mNext++) < mTasks) {
+    (*mTask)(i);
+  }
+}
@@ -0,0 +1,15 @@
+#include "DataFormats/Common/interface/Wrapper.h"
+#include "DataFormats/Common/interface/ValueMap.h"
+
+#include "JetMETCorrections/GammaJetFilter/interface/PhotonIsolation.h"
+
+#include <vector>
+
+namespace {
+  struct dictionary {
+    PhotonIsolation isolation;
+    std::vector<PhotonIsolation> isolations;
+    edm::ValueMap<PhotonIsolation> isolationsMap;
+    edm::Wrapper<edm::ValueMap<PhotonIsolation> > isolationsMapWrapper;
+  };
+}